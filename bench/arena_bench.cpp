@@ -0,0 +1,111 @@
+#include "microbench.h"
+#include "server/server.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace {
+
+// What a browser sends for a stylesheet, and for a page it already holds
+constexpr std::string_view STYLESHEET_REQUEST =
+    "GET /assets/css/site.css HTTP/1.1\r\n"
+    "Host: localhost\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+    "Accept: text/css,*/*;q=0.1\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+constexpr std::string_view PAGE_REQUEST =
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: localhost\r\n"
+    "Accept: text/html\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+// A small site
+const std::string& siteDirectory() {
+    static std::string directory;
+    if (!directory.empty()) {
+        return directory;
+    }
+
+    auto root = microbench::scratchDirectory("thermal_arena_bench");
+    std::filesystem::create_directories(root / "assets/css");
+    std::string stylesheet;
+    while (stylesheet.size() < 8 * 1024) {
+        stylesheet += ".card { margin: 0 auto; padding: 1rem; }\n";
+    }
+    std::ofstream(root / "assets/css/site.css") << stylesheet;
+    std::ofstream(root / "index.html") << "<!DOCTYPE html><html><body><p>bench</p></body></html>";
+
+    directory = root.string();
+    return directory;
+}
+
+// Requests are answered in-process from a warm cache
+Server& siteServer(bool watchMode) {
+    static std::unique_ptr<Server> servers[2];
+    auto& server = servers[watchMode];
+    if (!server) {
+        microbench::silenceStdout(); // construction logs to stdout
+        server = std::make_unique<Server>(siteDirectory(), watchMode, 0);
+    }
+    return *server;
+}
+
+// One keep-alive request after another, the way a worker loop answers
+// them; with an arena it is reset once each response is done
+void runRequests(size_t iterations, std::string_view request, bool watchMode, bool arena) {
+    Server& server = siteServer(watchMode);
+    static RequestArena requestArena; // its chunk comes from the warm-up run
+    std::optional<RequestArena::Scope> scope;
+    if (arena) {
+        scope.emplace(requestArena);
+    }
+    char input[512];
+    HttpParser parser;
+    for (size_t i = 0; i < iterations; ++i) {
+        std::memcpy(input, request.data(), request.size());
+        {
+            Response response;
+            server.handleRequest(std::span<char>(input, request.size()), parser, 0, response);
+            microbench::doNotOptimize(response);
+        }
+        requestArena.reset();
+    }
+}
+
+// The allocation-counting test for the cache-hit path. The runner's warm-up
+// call fills the cache and the arena's chunk; after that a single heap
+// allocation on this thread aborts the benchmark.
+void runWithoutAllocations(const char* name, size_t iterations, std::string_view request, bool watchMode,
+                           bool& warm) {
+    const uint64_t before = microbench::allocations();
+    runRequests(iterations, request, watchMode, true);
+    const uint64_t made = microbench::allocations() - before;
+    if (warm && made > 0) {
+        std::fprintf(stderr, "%s: %llu heap allocations in %zu cache hits, expected none\n", name,
+                     static_cast<unsigned long long>(made), iterations);
+        std::abort();
+    }
+    warm = true;
+}
+
+}
+
+MICROBENCH("arena/cache-hit") {
+    static bool warm = false;
+    runWithoutAllocations("arena/cache-hit", iterations, STYLESHEET_REQUEST, false, warm);
+}
+MICROBENCH("arena/cache-hit-hot-reload-page") {
+    static bool warm = false;
+    runWithoutAllocations("arena/cache-hit-hot-reload-page", iterations, PAGE_REQUEST, true, warm);
+}
+MICROBENCH("arena/baseline-cache-hit-heap") { runRequests(iterations, STYLESHEET_REQUEST, false, false); }
+MICROBENCH("arena/baseline-hot-reload-page-heap") { runRequests(iterations, PAGE_REQUEST, true, false); }
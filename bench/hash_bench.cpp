@@ -0,0 +1,82 @@
+#include "microbench.h"
+#include "server/content_hash.h"
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+// Generated once per size, so the runs only time the hashing
+const std::string& randomBytes(size_t size) {
+    static std::map<size_t, std::string> buffers;
+    std::string& bytes = buffers[size];
+    if (bytes.empty()) {
+        bytes.resize(size);
+        std::mt19937_64 random(size);
+        for (char& byte : bytes) {
+            byte = static_cast<char>(random());
+        }
+    }
+    return bytes;
+}
+
+// A file of random bytes
+const std::string& randomFile(size_t size) {
+    static const std::filesystem::path directory = microbench::scratchDirectory("thermal_hash_bench");
+    static std::map<size_t, std::string> files;
+    auto [it, inserted] = files.try_emplace(size);
+    if (inserted) {
+        it->second = (directory / ("random_" + std::to_string(size))).string();
+        std::ofstream(it->second, std::ios::binary) << randomBytes(size);
+    }
+    return it->second;
+}
+
+void runHash(size_t iterations, size_t size) {
+    const std::string& bytes = randomBytes(size);
+    microbench::setBytesPerOp(size);
+    for (size_t i = 0; i < iterations; ++i) {
+        microbench::doNotOptimize(hashBytes(bytes));
+    }
+}
+
+// What the standard library offers for the same job
+void runStdHash(size_t iterations, size_t size) {
+    const std::string& bytes = randomBytes(size);
+    microbench::setBytesPerOp(size);
+    for (size_t i = 0; i < iterations; ++i) {
+        microbench::doNotOptimize(std::hash<std::string_view>()(bytes));
+    }
+}
+
+// The watcher's check of a saved file: read it back from the page cache and hash it
+void runHashFile(size_t iterations, size_t size) {
+    int fd = open(randomFile(size).c_str(), O_RDONLY | O_CLOEXEC);
+    microbench::setBytesPerOp(size);
+    for (size_t i = 0; i < iterations; ++i) {
+        uint64_t hash = 0;
+        if (!hashFile(fd, hash)) {
+            std::perror("hash benchmark: read");
+            std::exit(1);
+        }
+        microbench::doNotOptimize(hash);
+    }
+    close(fd);
+}
+
+}
+
+MICROBENCH("hash/bytes-64") { runHash(iterations, 64); }
+MICROBENCH("hash/bytes-4k") { runHash(iterations, 4096); }
+MICROBENCH("hash/bytes-1m") { runHash(iterations, 1 << 20); }
+MICROBENCH("hash/baseline-std-hash-4k") { runStdHash(iterations, 4096); }
+MICROBENCH("hash/baseline-std-hash-1m") { runStdHash(iterations, 1 << 20); }
+MICROBENCH("hash/file-64k") { runHashFile(iterations, 64 * 1024); }
+MICROBENCH("hash/file-16m") { runHashFile(iterations, 16 << 20); }
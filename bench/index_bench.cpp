@@ -0,0 +1,91 @@
+#include "microbench.h"
+#include "server/path_index.h"
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t FILES = 10000;
+constexpr size_t FILES_PER_DIRECTORY = 100;
+
+std::string relativePath(size_t i) {
+    return "dir" + std::to_string(i / FILES_PER_DIRECTORY) + "/file" + std::to_string(i) + ".js";
+}
+
+const PathIndex& liveIndex() {
+    static PathIndex* index = [] {
+        auto* built = new PathIndex;
+        IndexedFile file;
+        file.size = 1;
+        for (size_t i = 0; i < FILES; ++i) {
+            built->update(relativePath(i), file);
+        }
+        built->setLive();
+        return built;
+    }();
+    return *index;
+}
+
+// A small on-disk tree for the syscall baselines
+const std::string& diskRoot() {
+    static const std::string root = [] {
+        auto path = microbench::scratchDirectory("thermal_index_bench");
+        std::filesystem::create_directories(path / "dir0");
+        std::ofstream(path / "dir0" / "file0.js") << "x";
+        return path.string();
+    }();
+    return root;
+}
+
+}
+
+MICROBENCH("index/normalize") {
+    std::pmr::string relative;
+    for (size_t i = 0; i < iterations; ++i) {
+        bool ok = normalizePath("/assets/js/vendor/../app.js", relative);
+        microbench::doNotOptimize(ok);
+    }
+}
+
+MICROBENCH("index/lookup-hit") {
+    const PathIndex& index = liveIndex();
+    const std::string path = relativePath(4242);
+    IndexedFile file;
+    for (size_t i = 0; i < iterations; ++i) {
+        PathIndex::Lookup result = index.find(path, &file);
+        microbench::doNotOptimize(result);
+    }
+}
+
+MICROBENCH("index/lookup-miss") {
+    const PathIndex& index = liveIndex();
+    for (size_t i = 0; i < iterations; ++i) {
+        PathIndex::Lookup result = index.find("dir7/missing.js");
+        microbench::doNotOptimize(result);
+    }
+}
+
+// What a 404 cost before the index: exists() and is_regular_file() on the path
+MICROBENCH("index/baseline-miss-stat") {
+    const std::string path = diskRoot() + "/dir0/missing.js";
+    for (size_t i = 0; i < iterations; ++i) {
+        bool found = std::filesystem::exists(path) && std::filesystem::is_regular_file(path);
+        microbench::doNotOptimize(found);
+    }
+}
+
+// The open and fstat a served file still takes
+MICROBENCH("index/baseline-hit-open") {
+    const std::string path = diskRoot() + "/dir0/file0.js";
+    for (size_t i = 0; i < iterations; ++i) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat info;
+        fstat(fd, &info);
+        close(fd);
+        microbench::doNotOptimize(info);
+    }
+}
@@ -0,0 +1,116 @@
+#include "microbench.h"
+#include "server/server.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace {
+
+constexpr size_t KB = 1024;
+
+constexpr std::string_view REQUEST = "GET /page.html HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+// Script of the original implementation, to make the baseline's copy as big
+constexpr std::string_view BASELINE_SCRIPT = R"(
+<script>
+(function() {
+    console.log('🔥 Hot reload enabled');
+    const eventSource = new EventSource('/sse');
+    eventSource.onmessage = function(event) {
+        if (event.data === 'reload') {
+            console.log('🔄 Reloading page due to file change');
+            window.location.reload();
+        }
+    };
+    eventSource.onerror = function(event) {
+        console.log('❌ Hot reload connection lost');
+    };
+})();
+</script>
+)";
+
+// A directory holding page.html of the given size, with </body> at the end
+// like a real page
+const std::string& pageDirectory(size_t size) {
+    static std::map<size_t, std::string> directories;
+    auto it = directories.find(size);
+    if (it != directories.end()) {
+        return it->second;
+    }
+
+    auto directory = microbench::scratchDirectory("thermal_inject_bench_" + std::to_string(size));
+    std::string page = "<!DOCTYPE html><html><head><title>bench</title></head><body>";
+    while (page.size() + 20 < size) {
+        page += "<p>paragraph</p>\n";
+    }
+    page += "</body></html>";
+    std::ofstream(directory / "page.html") << page;
+    return directories.emplace(size, directory.string()).first->second;
+}
+
+// A watch-mode server over the page, requests answered in-process
+Server& pageServer(size_t size, bool cached) {
+    static std::map<std::pair<size_t, bool>, std::unique_ptr<Server>> servers;
+    auto& server = servers[{size, cached}];
+    if (!server) {
+        microbench::silenceStdout(); // construction logs to stdout
+        ServerOptions options;
+        options.cacheBytes = cached ? 64 * 1024 * 1024 : 0;
+        server = std::make_unique<Server>(pageDirectory(size), true, 0, options);
+    }
+    return *server;
+}
+
+void runRequests(size_t iterations, size_t size, bool cached) {
+    Server& server = pageServer(size, cached);
+    char input[REQUEST.size()];
+    HttpParser parser;
+    for (size_t i = 0; i < iterations; ++i) {
+        std::memcpy(input, REQUEST.data(), REQUEST.size());
+        Response response;
+        server.handleRequest(input, parser, 0, response);
+        microbench::doNotOptimize(response);
+    }
+    microbench::setBytesPerOp(size);
+}
+
+// What serveHTMLWithHotReload() did before the page was cached: read the
+// file into a string, splice the script in, concatenate a head
+void runBaseline(size_t iterations, size_t size) {
+    const std::string path = pageDirectory(size) + "/page.html";
+    for (size_t i = 0; i < iterations; ++i) {
+        std::ifstream file(path);
+        std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        std::string hotReloadScript(BASELINE_SCRIPT);
+        size_t insertPos = content.find("</body>");
+        if (insertPos == std::string::npos) {
+            insertPos = content.find("</html>");
+        }
+        if (insertPos != std::string::npos) {
+            content.insert(insertPos, hotReloadScript);
+        } else {
+            content += hotReloadScript;
+        }
+        std::string headers =
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: text/html\r\n"
+            "Content-Length: " + std::to_string(content.length()) + "\r\n"
+            "\r\n";
+        microbench::doNotOptimize(headers);
+        microbench::doNotOptimize(content);
+    }
+    microbench::setBytesPerOp(size);
+}
+
+}
+
+MICROBENCH("inject/cached-page-8KB") { runRequests(iterations, 8 * KB, true); }
+MICROBENCH("inject/uncached-page-8KB") { runRequests(iterations, 8 * KB, false); }
+MICROBENCH("inject/baseline-read-insert-8KB") { runBaseline(iterations, 8 * KB); }
+MICROBENCH("inject/cached-page-256KB") { runRequests(iterations, 256 * KB, true); }
+MICROBENCH("inject/uncached-page-256KB") { runRequests(iterations, 256 * KB, false); }
+MICROBENCH("inject/baseline-read-insert-256KB") { runBaseline(iterations, 256 * KB); }
@@ -0,0 +1,156 @@
+#include "microbench.h"
+#include "server/server.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t PAGE_SIZE = 4096;
+constexpr size_t CONNECTIONS_PER_WORKER = 2;
+constexpr size_t MAX_CONNECTIONS = 64;
+
+// A port nothing listens on right now
+int freePort() {
+    int probe = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (probe < 0 || bind(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+        getsockname(probe, reinterpret_cast<sockaddr*>(&address), &length) < 0) {
+        std::perror("io benchmark: port");
+        std::exit(1);
+    }
+    close(probe);
+    return ntohs(address.sin_port);
+}
+
+int connectTo(int port) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+        return fd;
+    }
+    if (fd >= 0) close(fd);
+    return -1;
+}
+
+// One running server per mode and worker count, started on first use and
+// left running for the rest of the process
+int serverPort(IoMode mode, unsigned workers) {
+    static std::map<std::pair<IoMode, unsigned>, int> ports;
+    auto it = ports.find({mode, workers});
+    if (it != ports.end()) {
+        return it->second;
+    }
+
+    static const std::string root = [] {
+        microbench::silenceStdout();
+        auto directory = microbench::scratchDirectory("thermal_io_bench");
+        std::ofstream(directory / "page.html") << std::string(PAGE_SIZE, 'x');
+        return directory.string();
+    }();
+
+    ServerOptions options;
+    options.ioMode = mode;
+    options.workers = workers;
+    options.logLevel = accesslog::Level::Off; // a log line per request would cost more than the request
+    const int port = freePort();
+    auto* server = new Server(root, false, port, options); // lives as long as its loops
+    std::thread([server]() { server->startServer(); }).detach();
+
+    for (int attempt = 0; attempt < 1000; ++attempt) {
+        int probe = connectTo(port);
+        if (probe >= 0) {
+            close(probe);
+            ports.emplace(std::make_pair(mode, workers), port);
+            return port;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    std::fprintf(stderr, "io benchmark: server on port %d did not start\n", port);
+    std::exit(1);
+}
+
+// Reads one response off a keep-alive connection, head and body
+bool readResponse(int fd, std::string& buffer) {
+    size_t headEnd;
+    while ((headEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+        char chunk[8192];
+        ssize_t result = recv(fd, chunk, sizeof(chunk), 0);
+        if (result <= 0) return false;
+        buffer.append(chunk, result);
+    }
+    size_t length = 0;
+    const size_t header = buffer.find("Content-Length: ");
+    if (header < headEnd) {
+        length = std::strtoul(buffer.c_str() + header + 16, nullptr, 10);
+    }
+    const size_t total = headEnd + 4 + length;
+    while (buffer.size() < total) {
+        char chunk[8192];
+        ssize_t result = recv(fd, chunk, sizeof(chunk), 0);
+        if (result <= 0) return false;
+        buffer.append(chunk, result);
+    }
+    buffer.erase(0, total);
+    return true;
+}
+
+// Keep-alive GETs of a small cached page from several connections at once;
+// each operation is one request answered
+void runRequests(size_t iterations, IoMode mode, unsigned workers) {
+    const int port = serverPort(mode, workers);
+    const size_t connections = std::min(MAX_CONNECTIONS, workers * CONNECTIONS_PER_WORKER);
+    const std::string request = "GET /page.html HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    microbench::setBytesPerOp(PAGE_SIZE);
+
+    std::vector<std::thread> clients;
+    for (size_t c = 0; c < connections; ++c) {
+        const size_t count = iterations / connections + (c < iterations % connections ? 1 : 0);
+        clients.emplace_back([&, count]() {
+            // A fresh connection whenever the server retires one after its
+            // request limit
+            int fd = -1;
+            std::string buffer;
+            for (size_t i = 0; i < count; ++i) {
+                if (fd < 0 && (fd = connectTo(port)) < 0) {
+                    std::perror("io benchmark: connect");
+                    std::exit(1);
+                }
+                if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) < 0 || !readResponse(fd, buffer)) {
+                    close(fd);
+                    fd = -1;
+                    buffer.clear();
+                    --i; // retried on the new connection
+                }
+            }
+            if (fd >= 0) close(fd);
+        });
+    }
+    for (auto& client : clients) {
+        client.join();
+    }
+}
+
+}
+
+MICROBENCH("io/epoll-1-worker") { runRequests(iterations, IoMode::Epoll, 1); }
+MICROBENCH("io/uring-1-worker") { runRequests(iterations, IoMode::Uring, 1); }
+MICROBENCH("io/epoll-8-workers") { runRequests(iterations, IoMode::Epoll, 8); }
+MICROBENCH("io/uring-8-workers") { runRequests(iterations, IoMode::Uring, 8); }
+MICROBENCH("io/epoll-32-workers") { runRequests(iterations, IoMode::Epoll, 32); }
+MICROBENCH("io/uring-32-workers") { runRequests(iterations, IoMode::Uring, 32); }
@@ -0,0 +1,45 @@
+#include "microbench.h"
+#include "server/access_log.h"
+#include <fcntl.h>
+#include <fstream>
+#include <string_view>
+
+namespace {
+
+constexpr std::string_view METHOD = "GET";
+constexpr std::string_view PATH = "/css/style.css";
+
+// Output goes nowhere, so the numbers are the logging path itself
+void startLog() {
+    static const bool started = [] {
+        accesslog::Options options;
+        options.fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        accesslog::start(options);
+        return true;
+    }();
+    microbench::doNotOptimize(started);
+}
+
+}
+
+// What a request costs the serving thread: the decision, copying method and
+// path into the response, and handing the entry to the ring
+MICROBENCH("log/ring-submit") {
+    startLog();
+    accesslog::Entry entry;
+    for (size_t i = 0; i < iterations; ++i) {
+        if (accesslog::wanted(200)) {
+            entry.status = 200;
+            accesslog::describe(entry, METHOD, PATH);
+            accesslog::submit(entry);
+        }
+    }
+}
+
+// The line handleClient() used to print for every request, flushed each time
+MICROBENCH("log/baseline-iostream-endl") {
+    std::ofstream out("/dev/null");
+    for (size_t i = 0; i < iterations; ++i) {
+        out << "Request: " << METHOD << " " << PATH << std::endl;
+    }
+}
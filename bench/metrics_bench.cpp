@@ -0,0 +1,51 @@
+#include "microbench.h"
+#include "server/metrics.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace {
+
+// What the counters would cost as shared atomics bumped by every thread
+std::atomic<uint64_t> sharedCounter{0};
+
+}
+
+// One latency sample as the request path takes it: a clock read to start,
+// and record() reading the clock again to finish
+MICROBENCH("metrics/record-stage") {
+    for (size_t i = 0; i < iterations; ++i) {
+        metrics::record(metrics::Stage::Parse, metrics::now());
+    }
+}
+
+// The bucket index and the two counter updates alone, without the clock
+MICROBENCH("metrics/histogram-record") {
+    metrics::LatencyHistogram& histogram = metrics::local().stages[static_cast<size_t>(metrics::Stage::Send)];
+    for (size_t i = 0; i < iterations; ++i) {
+        histogram.record(200 + (i & 0xffff));
+    }
+}
+
+MICROBENCH("metrics/count-status") {
+    for (size_t i = 0; i < iterations; ++i) {
+        metrics::countStatus(200);
+        metrics::countBytesOut(1024);
+    }
+}
+
+MICROBENCH("metrics/baseline-shared-fetch-add") {
+    for (size_t i = 0; i < iterations; ++i) {
+        sharedCounter.fetch_add(1, std::memory_order_relaxed);
+        sharedCounter.fetch_add(1024, std::memory_order_relaxed);
+    }
+}
+
+// A scrape: sum every thread's block and render the exposition text
+MICROBENCH("metrics/scrape") {
+    for (size_t i = 0; i < iterations; ++i) {
+        std::string out;
+        metrics::appendSnapshot(out, metrics::snapshot());
+        microbench::doNotOptimize(out);
+    }
+}
@@ -0,0 +1,157 @@
+#include "microbench.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <new>
+#include <streambuf>
+#include <string_view>
+#include <vector>
+#include <unistd.h>
+
+// Every heap allocation of the process goes through these, so the runner
+// can report how many a benchmark makes per operation. Only the calling
+// thread's are counted, which keeps the counter out of the way of the
+// server threads some benchmarks start.
+namespace {
+
+thread_local uint64_t allocationCount = 0;
+
+void* allocate(size_t size, size_t alignment = 0) {
+    ++allocationCount;
+    void* memory = alignment > alignof(std::max_align_t)
+        ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+        : std::malloc(size ? size : 1);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+}
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void* operator new(size_t size, std::align_val_t alignment) { return allocate(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment) { return allocate(size, static_cast<size_t>(alignment)); }
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete(void* memory, size_t, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept { std::free(memory); }
+
+namespace microbench {
+
+namespace {
+
+struct Entry {
+    std::string name;
+    Body body;
+};
+
+std::vector<Entry>& registry() {
+    static std::vector<Entry> entries;
+    return entries;
+}
+
+constexpr auto MIN_RUN_TIME = std::chrono::milliseconds(200);
+
+size_t bytesPerOp = 0;
+
+double threadCpuSeconds() {
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+}
+
+void add(std::string name, Body body) {
+    registry().push_back({std::move(name), std::move(body)});
+}
+
+void setBytesPerOp(size_t bytes) {
+    bytesPerOp = bytes;
+}
+
+std::filesystem::path scratchDirectory(const std::string& prefix) {
+    static std::vector<std::filesystem::path> directories;
+    if (directories.empty()) {
+        std::atexit([] {
+            for (const auto& directory : directories) {
+                std::error_code error;
+                std::filesystem::remove_all(directory, error);
+            }
+        });
+    }
+    auto directory = std::filesystem::temp_directory_path() / (prefix + "_" + std::to_string(getpid()));
+    std::filesystem::create_directories(directory);
+    directories.push_back(directory);
+    return directory;
+}
+
+void silenceStdout() {
+    class NullBuffer : public std::streambuf {
+    protected:
+        int overflow(int c) override { return c; }
+    };
+    static NullBuffer nullBuffer;
+    std::cout.rdbuf(&nullBuffer);
+}
+
+uint64_t allocations() {
+    return allocationCount;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    using Clock = std::chrono::steady_clock;
+
+    // Optional substring filter, e.g. `thermal_microbench parser/`
+    std::string_view filter = argc > 1 ? argv[1] : "";
+
+    std::printf("%-44s %14s %14s %12s %12s %12s\n", "benchmark", "ns/op", "iterations", "allocs/op", "MB/s",
+                "cpu-ms/GB");
+    for (auto& entry : microbench::registry()) {
+        if (entry.name.find(filter) == std::string::npos) {
+            continue;
+        }
+
+        microbench::bytesPerOp = 0;
+        entry.body(1); // warm caches and lazy initialization
+
+        size_t iterations = 1;
+        Clock::duration elapsed{};
+        double cpuSeconds = 0;
+        uint64_t allocations = 0;
+        while (true) {
+            auto start = Clock::now();
+            double cpuStart = microbench::threadCpuSeconds();
+            const uint64_t allocationsBefore = allocationCount;
+            entry.body(iterations);
+            allocations = allocationCount - allocationsBefore;
+            cpuSeconds = microbench::threadCpuSeconds() - cpuStart;
+            elapsed = Clock::now() - start;
+            if (elapsed >= microbench::MIN_RUN_TIME || iterations >= (size_t{1} << 40)) {
+                break;
+            }
+            iterations *= 2;
+        }
+
+        double nanoseconds = std::chrono::duration<double, std::nano>(elapsed).count();
+        std::printf("%-44s %14.1f %14zu %12.2f", entry.name.c_str(), nanoseconds / iterations, iterations,
+                    static_cast<double>(allocations) / iterations);
+        if (microbench::bytesPerOp > 0) {
+            double bytes = static_cast<double>(microbench::bytesPerOp) * iterations;
+            std::printf(" %12.1f %12.1f", bytes / (nanoseconds / 1e9) / 1e6, cpuSeconds * 1e3 / (bytes / 1e9));
+        }
+        std::printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+
+// Minimal harness for the thermal_microbench target. A benchmark body runs
+// its measured operation `iterations` times; the runner grows the count
+// until the timing is stable and reports the cost per operation.
+namespace microbench {
+
+using Body = std::function<void(size_t iterations)>;
+
+void add(std::string name, Body body);
+
+// Declares how many payload bytes one operation moves; the runner then also
+// reports throughput and the calling thread's CPU time per GB
+void setBytesPerOp(size_t bytes);
+
+struct Registrar {
+    Registrar(const char* name, Body body) { add(name, std::move(body)); }
+};
+
+// A new directory under the system temp directory, named after prefix and
+// the process, removed with everything in it when the process exits
+std::filesystem::path scratchDirectory(const std::string& prefix);
+
+// Discards what the server logs to std::cout, which would otherwise cost
+// more than what is measured; results go out through printf
+void silenceStdout();
+
+// Heap allocations the calling thread has made so far, for benchmarks that
+// must not make any
+uint64_t allocations();
+
+// Keeps the compiler from discarding a result that is otherwise unused
+template <typename T>
+inline void doNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+}
+
+#define MICROBENCH_CONCAT_INNER(a, b) a##b
+#define MICROBENCH_CONCAT(a, b) MICROBENCH_CONCAT_INNER(a, b)
+
+// MICROBENCH("group/name") { for (size_t i = 0; i < iterations; ++i) ... }
+#define MICROBENCH(name)                                                         \
+    static void MICROBENCH_CONCAT(microbench_, __LINE__)(size_t iterations);   \
+    static ::microbench::Registrar MICROBENCH_CONCAT(microbench_registrar_, __LINE__)( \
+        name, MICROBENCH_CONCAT(microbench_, __LINE__));                       \
+    static void MICROBENCH_CONCAT(microbench_, __LINE__)([[maybe_unused]] size_t iterations)
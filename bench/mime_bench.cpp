@@ -0,0 +1,95 @@
+#include "microbench.h"
+#include "server/mime_types.h"
+#include <string>
+#include <string_view>
+
+namespace {
+
+// What one page load of a typical site asks for
+constexpr std::string_view PATHS[] = {
+    "index.html", "css/style.css", "js/app.js", "js/vendor.js.map", "img/hero.webp",
+    "img/logo.svg", "fonts/inter.woff2", "favicon.ico", "site.webmanifest", "media/intro.mp4",
+    "img/photo.JPG", "robots.txt", "data/feed.json", "wasm/module.wasm", "LICENSE",
+    "img/icon.png",
+};
+
+constexpr std::string_view VALIDATORS =
+    "ETag: \"ce8012-445c-6ad28730.358d4945\"\r\n"
+    "Last-Modified: Fri, 16 Oct 2026 20:21:04 GMT\r\n"
+    "Cache-Control: no-cache\r\n";
+
+// The lookup this table replaced: substr into a new string, then a chain of
+// comparisons that fell through to octet-stream for most web types
+std::string baselineContentType(const std::string& path) {
+    size_t dotPos = path.find_last_of('.');
+    if (dotPos == std::string::npos) {
+        return "application/octet-stream";
+    }
+
+    std::string extension = path.substr(dotPos + 1);
+
+    if (extension == "html" || extension == "htm") return "text/html";
+    if (extension == "css") return "text/css";
+    if (extension == "js") return "application/javascript";
+    if (extension == "json") return "application/json";
+    if (extension == "png") return "image/png";
+    if (extension == "jpg" || extension == "jpeg") return "image/jpeg";
+    if (extension == "gif") return "image/gif";
+    if (extension == "txt") return "text/plain";
+
+    return "application/octet-stream";
+}
+
+}
+
+MICROBENCH("mime/perfect-hash") {
+    for (size_t i = 0; i < iterations; ++i) {
+        const MimeType& type = mimeTypeFor(PATHS[i % std::size(PATHS)]);
+        microbench::doNotOptimize(type.contentType);
+    }
+}
+
+MICROBENCH("mime/baseline-if-chain") {
+    // The old signature took a std::string, as serveFile() had one at hand
+    std::string paths[std::size(PATHS)];
+    for (size_t i = 0; i < std::size(PATHS); ++i) {
+        paths[i] = PATHS[i];
+    }
+    for (size_t i = 0; i < iterations; ++i) {
+        std::string type = baselineContentType(paths[i % std::size(paths)]);
+        microbench::doNotOptimize(type);
+    }
+}
+
+// Status line through Content-Length plus the validators: the part of a 200
+// head that does not depend on the connection
+MICROBENCH("head/prebuilt-prefix") {
+    const MimeType& type = mimeTypeFor("css/style.css");
+    for (size_t i = 0; i < iterations; ++i) {
+        std::string head = okHead(type, 17500 + (i & 0xff));
+        head += VALIDATORS;
+        microbench::doNotOptimize(head);
+    }
+}
+
+// The whole head prebuilt once per cached file, as cache hits send it
+MICROBENCH("head/cached-copy") {
+    std::string cached = okHead(mimeTypeFor("css/style.css"), 17500);
+    cached += VALIDATORS;
+    for (size_t i = 0; i < iterations; ++i) {
+        std::string head = cached;
+        microbench::doNotOptimize(head);
+    }
+}
+
+MICROBENCH("head/baseline-concatenated") {
+    const std::string contentType = "text/css; charset=utf-8";
+    for (size_t i = 0; i < iterations; ++i) {
+        std::string head =
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: " + contentType + "\r\n"
+            "Content-Length: " + std::to_string(17500 + (i & 0xff)) + "\r\n";
+        head += VALIDATORS;
+        microbench::doNotOptimize(head);
+    }
+}
@@ -0,0 +1,113 @@
+#include "microbench.h"
+#include "server/http_parser.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+constexpr std::string_view MINIMAL_REQUEST =
+    "GET /index.html HTTP/1.1\r\n"
+    "\r\n";
+
+// What a desktop browser sends for a stylesheet on an h5bp page
+constexpr std::string_view BROWSER_REQUEST =
+    "GET /css/style.css?v=3 HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0 Safari/537.36\r\n"
+    "sec-ch-ua-platform: \"Linux\"\r\n"
+    "Accept: text/css,*/*;q=0.1\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Dest: style\r\n"
+    "Referer: http://localhost:8080/\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: en-US,en;q=0.9\r\n"
+    "If-None-Match: \"1a2b-5f3c\"\r\n"
+    "\r\n";
+
+constexpr std::string_view ENCODED_REQUEST =
+    "GET /img/my%20holiday%20photos/caf%C3%A9%20terrace.jpg HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "\r\n";
+
+// The parser decodes in place, so every iteration starts from a fresh copy,
+// as it would after a recv() into the connection buffer
+void runParser(size_t iterations, std::string_view request) {
+    std::vector<char> buffer(request.size());
+    HttpParser parser;
+    HttpRequest parsed;
+    for (size_t i = 0; i < iterations; ++i) {
+        memcpy(buffer.data(), request.data(), request.size());
+        auto status = parser.parse(buffer, parsed);
+        parser.reset();
+        microbench::doNotOptimize(status);
+        microbench::doNotOptimize(parsed.path);
+    }
+}
+
+}
+
+MICROBENCH("parser/minimal") {
+    runParser(iterations, MINIMAL_REQUEST);
+}
+
+MICROBENCH("parser/browser") {
+    runParser(iterations, BROWSER_REQUEST);
+}
+
+MICROBENCH("parser/percent-encoded") {
+    runParser(iterations, ENCODED_REQUEST);
+}
+
+// The same request arriving in 16-byte TCP segments, parsed after each one.
+// The result must match a one-shot parse, so a broken resume path fails loudly.
+MICROBENCH("parser/browser-split-16") {
+    std::string expected;
+    {
+        std::vector<char> whole(BROWSER_REQUEST.begin(), BROWSER_REQUEST.end());
+        HttpParser parser;
+        HttpRequest parsed;
+        parser.parse(whole, parsed);
+        expected = std::string(parsed.path) + " " + std::to_string(parsed.headerCount);
+    }
+
+    std::vector<char> buffer(BROWSER_REQUEST.size());
+    HttpParser parser;
+    HttpRequest parsed;
+    for (size_t i = 0; i < iterations; ++i) {
+        memcpy(buffer.data(), BROWSER_REQUEST.data(), BROWSER_REQUEST.size());
+        HttpParser::Status status = HttpParser::Status::Incomplete;
+        for (size_t received = 16; status == HttpParser::Status::Incomplete; received += 16) {
+            received = std::min(received, buffer.size());
+            status = parser.parse(std::span<char>(buffer.data(), received), parsed);
+        }
+        parser.reset();
+        if (status != HttpParser::Status::Complete ||
+            std::string(parsed.path) + " " + std::to_string(parsed.headerCount) != expected) {
+            std::fprintf(stderr, "parser/browser-split-16: resumed parse disagrees with one-shot parse\n");
+            std::abort();
+        }
+    }
+}
+
+// The request line handling this parser replaced: copy into a std::string,
+// then tokenize with an istringstream, headers ignored
+MICROBENCH("parser/baseline-istringstream") {
+    std::vector<char> buffer(BROWSER_REQUEST.size() + 1);
+    for (size_t i = 0; i < iterations; ++i) {
+        memcpy(buffer.data(), BROWSER_REQUEST.data(), BROWSER_REQUEST.size());
+        buffer[BROWSER_REQUEST.size()] = '\0';
+        std::string request(buffer.data());
+        std::istringstream iss(request);
+        std::string method, path, version;
+        iss >> method >> path >> version;
+        microbench::doNotOptimize(path);
+    }
+}
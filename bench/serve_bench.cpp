@@ -0,0 +1,143 @@
+#include "microbench.h"
+#include "server/response.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+// Loopback TCP connection whose far end is drained by a background thread,
+// standing in for a client that reads as fast as the kernel delivers
+class LoopbackSink {
+public:
+    LoopbackSink() {
+        int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+            listen(listener, 1) < 0 || getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length) < 0) {
+            std::perror("serve benchmark: listen");
+            std::exit(1);
+        }
+
+        sender = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(sender, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+            std::perror("serve benchmark: connect");
+            std::exit(1);
+        }
+        receiver = accept(listener, nullptr, nullptr);
+        close(listener);
+
+        drainer = std::thread([this]() {
+            std::vector<char> buffer(256 * 1024);
+            ssize_t result;
+            while ((result = recv(receiver, buffer.data(), buffer.size(), 0)) > 0) {
+                received.fetch_add(result, std::memory_order_release);
+            }
+        });
+    }
+
+    ~LoopbackSink() {
+        shutdown(sender, SHUT_WR);
+        drainer.join();
+        close(sender);
+        close(receiver);
+    }
+
+    int socket() const { return sender; }
+
+    // Blocks until the client side has read everything written so far
+    void drain(uint64_t bytesWritten) {
+        expected += bytesWritten;
+        while (received.load(std::memory_order_acquire) < expected) {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    int sender = -1;
+    int receiver = -1;
+    uint64_t expected = 0;
+    std::atomic<uint64_t> received{0};
+    std::thread drainer;
+};
+
+// A file of the given size, written once and unlinked right away so it
+// disappears with the process; its pages stay hot in the page cache
+int fixtureFile(size_t size) {
+    static std::map<size_t, int> files;
+    auto it = files.find(size);
+    if (it != files.end()) {
+        return it->second;
+    }
+
+    auto path = std::filesystem::temp_directory_path() / ("thermal_serve_bench_" + std::to_string(size));
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        std::perror("serve benchmark: fixture");
+        std::exit(1);
+    }
+    unlink(path.c_str());
+
+    std::vector<char> block(1024 * 1024);
+    for (size_t i = 0; i < block.size(); ++i) {
+        block[i] = static_cast<char>('a' + i % 26);
+    }
+    for (size_t written = 0; written < size;) {
+        ssize_t result = write(fd, block.data(), std::min(block.size(), size - written));
+        if (result <= 0) {
+            std::perror("serve benchmark: fixture");
+            std::exit(1);
+        }
+        written += result;
+    }
+
+    files.emplace(size, fd);
+    return fd;
+}
+
+void runServe(size_t iterations, size_t size, bool buffered) {
+    static LoopbackSink sink;
+    const int file = fixtureFile(size);
+    const std::string head = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(size) + "\r\n\r\n";
+    microbench::setBytesPerOp(size);
+
+    for (size_t i = 0; i < iterations; ++i) {
+        Response response;
+        response.head = head;
+        response.file = UniqueFd(dup(file));
+        response.fileLength = size;
+        response.bufferedFile = buffered;
+        if (writeResponse(sink.socket(), response) != WriteStatus::Complete) {
+            std::fprintf(stderr, "serve benchmark: write failed\n");
+            std::exit(1);
+        }
+    }
+    sink.drain(iterations * (head.size() + size));
+}
+
+constexpr size_t MB = 1024 * 1024;
+
+}
+
+MICROBENCH("serve/sendfile-1MB") { runServe(iterations, MB, false); }
+MICROBENCH("serve/buffered-1MB") { runServe(iterations, MB, true); }
+MICROBENCH("serve/sendfile-16MB") { runServe(iterations, 16 * MB, false); }
+MICROBENCH("serve/buffered-16MB") { runServe(iterations, 16 * MB, true); }
+MICROBENCH("serve/sendfile-256MB") { runServe(iterations, 256 * MB, false); }
+MICROBENCH("serve/buffered-256MB") { runServe(iterations, 256 * MB, true); }
+MICROBENCH("serve/sendfile-1GB") { runServe(iterations, 1024 * MB, false); }
+MICROBENCH("serve/buffered-1GB") { runServe(iterations, 1024 * MB, true); }
@@ -0,0 +1,654 @@
+// End-to-end load generator. Starts the thermal binary over a generated
+// fixture tree, drives it from one thread per connection and prints the
+// throughput and latency percentiles as JSON, so runs can be compared
+// between releases.
+//
+//   thermal_bench [--mode=closed|open] [--rate=<rps>] [--connections=<n>]
+//                 [--duration=<s>] [--warmup=<s>] [--server=<path>]
+//                 [--no-watch] [--slowloris=<n>] [--slow-readers=<n>]
+//                 [-- <extra thermal options>]
+//
+// Closed loop: every connection sends its next request as soon as the last
+// response is in, which measures peak throughput. Open loop: requests are
+// scheduled at a constant total rate and latency is taken from the moment
+// each one was due, not when it was sent, so a stalled server cannot hide
+// the queueing it causes (coordinated omission).
+//
+// Under attack: --slowloris holds that many connections open by sending a
+// request head one byte a second, reconnecting whenever the server drops
+// one; --slow-readers request a large file and never read it. The load is
+// measured as usual alongside them, and the report adds how long the
+// server let the trickling connections live and the timeouts and
+// rejections it counted.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Latency histogram with a fixed relative error: values are bucketed by
+// their power of two, and each power of two is split into 64 linear steps
+// (under 1.6% error). Recording is an increment, merging is an addition.
+class Histogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 6;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr int MAGNITUDES = 40; // up to ~2^40 ns, about 18 minutes
+
+    void record(uint64_t nanoseconds) {
+        ++counts[index(nanoseconds)];
+        ++total;
+        sum += nanoseconds;
+        maximum = std::max(maximum, nanoseconds);
+    }
+
+    void merge(const Histogram& other) {
+        for (size_t i = 0; i < counts.size(); ++i) {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        sum += other.sum;
+        maximum = std::max(maximum, other.maximum);
+    }
+
+    uint64_t count() const { return total; }
+    double mean() const { return total ? static_cast<double>(sum) / total : 0; }
+    uint64_t max() const { return maximum; }
+
+    // Upper bound of the bucket holding the given quantile
+    uint64_t percentile(double quantile) const {
+        if (total == 0) {
+            return 0;
+        }
+        const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(quantile * total)));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            seen += counts[i];
+            if (seen >= rank) {
+                return std::min(upperBound(i), maximum);
+            }
+        }
+        return maximum;
+    }
+
+private:
+    std::array<uint64_t, (MAGNITUDES + 1) * SUB_BUCKETS> counts{};
+    uint64_t total = 0;
+    uint64_t sum = 0;
+    uint64_t maximum = 0;
+
+    static size_t index(uint64_t value) {
+        if (value < SUB_BUCKETS) {
+            return value;
+        }
+        // The top SUB_BUCKET_BITS bits below the leading one pick the step
+        const int magnitude = 63 - __builtin_clzll(value) - SUB_BUCKET_BITS + 1;
+        if (magnitude > MAGNITUDES) {
+            return (MAGNITUDES + 1) * SUB_BUCKETS - 1;
+        }
+        const uint64_t sub = (value >> (magnitude - 1)) & (SUB_BUCKETS - 1);
+        return magnitude * SUB_BUCKETS + sub;
+    }
+
+    static uint64_t upperBound(size_t index) {
+        if (index < SUB_BUCKETS) {
+            return index;
+        }
+        const size_t magnitude = index / SUB_BUCKETS;
+        const uint64_t sub = index % SUB_BUCKETS;
+        return ((SUB_BUCKETS + sub + 1) << (magnitude - 1)) - 1;
+    }
+};
+
+// What the fixture tree holds and how often each kind is requested
+struct FixtureClass {
+    const char* name;
+    size_t files;
+    size_t size;
+    unsigned weight;
+};
+
+constexpr FixtureClass FIXTURE_CLASSES[] = {
+    {"small", 200, 1024, 60},            // icons, small scripts, JSON
+    {"medium", 50, 64 * 1024, 25},       // stylesheets and bundles, still cached
+    {"large", 4, 4 * 1024 * 1024, 5},    // media, sent from disk
+    {"html", 50, 8 * 1024, 10},          // pages, with the hot reload script injected
+};
+constexpr size_t CLASS_COUNT = std::size(FIXTURE_CLASSES);
+
+struct Options {
+    bool openLoop = false;
+    double rate = 0; // requests per second over all connections, open loop only
+    unsigned connections = 64;
+    double duration = 10;
+    double warmup = 1;
+    std::string server;
+    bool watch = true;
+    unsigned slowloris = 0;   // connections trickling a request head
+    unsigned slowReaders = 0; // connections that never read their response
+    std::vector<std::string> serverArgs;
+};
+
+// Time between the bytes of a trickled request head
+constexpr auto TRICKLE_INTERVAL = std::chrono::seconds(1);
+// How often the attacker looks for connections the server closed
+constexpr auto ATTACK_POLL_INTERVAL = std::chrono::milliseconds(50);
+
+std::string fixturePath(size_t classIndex, size_t file) {
+    const FixtureClass& fixture = FIXTURE_CLASSES[classIndex];
+    return std::string("/") + fixture.name + "/" + std::to_string(file) +
+        (std::strcmp(fixture.name, "html") == 0 ? ".html" : std::strcmp(fixture.name, "small") == 0 ? ".json" : ".css");
+}
+
+void writeFixtures(const fs::path& root) {
+    std::mt19937 random(42);
+    for (size_t c = 0; c < CLASS_COUNT; ++c) {
+        const FixtureClass& fixture = FIXTURE_CLASSES[c];
+        fs::create_directories(root / fixture.name);
+        for (size_t i = 0; i < fixture.files; ++i) {
+            std::string content;
+            content.reserve(fixture.size);
+            const bool html = std::strcmp(fixture.name, "html") == 0;
+            if (html) {
+                content = "<!DOCTYPE html><html><head><title>page</title></head><body>";
+            }
+            // Text that compresses like real assets: words, not noise
+            static const char* const words[] = {"thermal ", "server ", "static ", "reload ", "cache ",
+                                                "epoll ", "header ", "request "};
+            while (content.size() + 16 < fixture.size) {
+                content += words[random() % std::size(words)];
+            }
+            if (html) {
+                content += "</body></html>";
+            }
+            content.resize(fixture.size, '\n');
+            std::ofstream(root / fixturePath(c, i).substr(1), std::ios::binary) << content;
+        }
+    }
+}
+
+int freePort() {
+    int probe = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (probe < 0 || bind(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+        getsockname(probe, reinterpret_cast<sockaddr*>(&address), &length) < 0) {
+        std::perror("thermal_bench: port");
+        std::exit(1);
+    }
+    close(probe);
+    return ntohs(address.sin_port);
+}
+
+int connectTo(int port) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// The thermal binary next to this one, unless --server names another
+std::string defaultServerPath() {
+    std::error_code error;
+    fs::path self = fs::read_symlink("/proc/self/exe", error);
+    return error ? "thermal" : (self.parent_path() / "thermal").string();
+}
+
+pid_t startServer(const Options& options, const fs::path& root, int port) {
+    std::vector<std::string> args{options.server, "-p", std::to_string(port)};
+    if (options.watch) {
+        args.push_back("-w");
+    }
+    args.insert(args.end(), options.serverArgs.begin(), options.serverArgs.end());
+    args.push_back(root.string());
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // The server logs every request; keep that out of the JSON
+        int devNull = open("/dev/null", O_WRONLY);
+        dup2(devNull, STDOUT_FILENO);
+        std::vector<char*> argv;
+        for (std::string& arg : args) {
+            argv.push_back(arg.data());
+        }
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        std::perror("thermal_bench: exec");
+        _exit(127);
+    }
+    if (pid < 0) {
+        std::perror("thermal_bench: fork");
+        std::exit(1);
+    }
+
+    for (int attempt = 0; attempt < 500; ++attempt) {
+        int probe = connectTo(port);
+        if (probe >= 0) {
+            close(probe);
+            return pid;
+        }
+        int status;
+        if (waitpid(pid, &status, WNOHANG) == pid) {
+            std::fprintf(stderr, "thermal_bench: server exited during startup\n");
+            std::exit(1);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::fprintf(stderr, "thermal_bench: server did not start listening\n");
+    kill(pid, SIGTERM);
+    std::exit(1);
+}
+
+// Reads one response; false on a broken connection. Sets close when the
+// server ends the connection after it.
+bool readResponse(int fd, std::string& buffer, int& status, size_t& bodyBytes, bool& close) {
+    size_t headEnd;
+    char chunk[65536];
+    while ((headEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+        ssize_t result = recv(fd, chunk, sizeof(chunk), 0);
+        if (result <= 0) return false;
+        buffer.append(chunk, result);
+    }
+    const std::string_view head(buffer.data(), headEnd);
+    status = head.size() > 12 ? std::atoi(buffer.c_str() + 9) : 0;
+    bodyBytes = 0;
+    const size_t length = head.find("Content-Length: ");
+    if (length != std::string_view::npos) {
+        bodyBytes = std::strtoull(buffer.c_str() + length + 16, nullptr, 10);
+    }
+    close = head.find("Connection: close") != std::string_view::npos;
+
+    size_t remaining = headEnd + 4 + bodyBytes;
+    if (buffer.size() >= remaining) {
+        buffer.erase(0, remaining);
+        return true;
+    }
+    remaining -= buffer.size();
+    buffer.clear();
+    // Large bodies are counted, not kept
+    while (remaining > 0) {
+        ssize_t result = recv(fd, chunk, std::min(sizeof(chunk), remaining), 0);
+        if (result <= 0) return false;
+        remaining -= result;
+    }
+    return true;
+}
+
+struct ConnectionResult {
+    Histogram latency;
+    std::array<Histogram, CLASS_COUNT> byClass;
+    uint64_t errors = 0;
+    uint64_t bytes = 0;
+};
+
+void runConnection(const Options& options, int port, unsigned index, Clock::time_point start,
+                   ConnectionResult& result) {
+    std::mt19937 random(1000 + index);
+    unsigned totalWeight = 0;
+    for (const FixtureClass& fixture : FIXTURE_CLASSES) {
+        totalWeight += fixture.weight;
+    }
+
+    const Clock::time_point measureFrom = start + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(options.warmup));
+    const Clock::time_point end = measureFrom + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(options.duration));
+    // Each connection carries an equal share of the open-loop rate,
+    // staggered so the connections do not fire in lockstep
+    const auto interval = options.openLoop ? std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(options.connections / options.rate)) : Clock::duration::zero();
+    Clock::time_point due = start + interval * index / options.connections;
+
+    int fd = -1;
+    std::string buffer;
+    while (true) {
+        Clock::time_point sent = Clock::now();
+        if (options.openLoop) {
+            if (due > sent) {
+                std::this_thread::sleep_until(due);
+            }
+            sent = due; // late sends count against the server, not the client
+            due += interval;
+        }
+        if (sent >= end) {
+            break;
+        }
+
+        unsigned pick = random() % totalWeight;
+        size_t classIndex = 0;
+        while (pick >= FIXTURE_CLASSES[classIndex].weight) {
+            pick -= FIXTURE_CLASSES[classIndex++].weight;
+        }
+        const std::string request = "GET " + fixturePath(classIndex, random() % FIXTURE_CLASSES[classIndex].files) +
+            " HTTP/1.1\r\nHost: localhost\r\nAccept-Encoding: gzip, br\r\n\r\n";
+
+        int status = 0;
+        size_t bodyBytes = 0;
+        bool close = false;
+        bool ok = false;
+        if (fd < 0) {
+            fd = connectTo(port);
+            buffer.clear();
+        }
+        if (fd >= 0 && send(fd, request.data(), request.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(request.size())) {
+            ok = readResponse(fd, buffer, status, bodyBytes, close);
+        }
+        const Clock::time_point done = Clock::now();
+
+        if (!ok || close) {
+            if (fd >= 0) ::close(fd);
+            fd = -1;
+        }
+        if (sent < measureFrom) {
+            continue;
+        }
+        if (!ok || status < 200 || status >= 400) {
+            ++result.errors;
+            continue;
+        }
+        const uint64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(done - sent).count();
+        result.latency.record(nanoseconds);
+        result.byClass[classIndex].record(nanoseconds);
+        result.bytes += bodyBytes;
+    }
+    if (fd >= 0) ::close(fd);
+}
+
+struct AttackResult {
+    Histogram held; // connect to close by the server, of trickling connections
+    uint64_t refused = 0; // connects that failed outright
+};
+
+// Whether the server closed fd, or answered it, which it only does to end it
+bool closedByServer(int fd) {
+    char byte;
+    const ssize_t result = recv(fd, &byte, 1, MSG_DONTWAIT | MSG_PEEK);
+    return result >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+}
+
+void runAttack(const Options& options, int port, Clock::time_point start, AttackResult& result) {
+    const Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(options.warmup + options.duration));
+
+    // Slow readers shrink their receive window to nothing and stall the
+    // server's writes for good
+    std::vector<int> readers;
+    const std::string largeRequest = "GET " + fixturePath(2, 0) + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    for (unsigned i = 0; i < options.slowReaders; ++i) {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int small = 4096;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+            send(fd, largeRequest.data(), largeRequest.size(), MSG_NOSIGNAL) < 0) {
+            ++result.refused;
+        }
+        readers.push_back(fd);
+    }
+
+    struct Trickler {
+        int fd = -1;
+        Clock::time_point connectedAt;
+        Clock::time_point nextByte;
+    };
+    std::vector<Trickler> tricklers(options.slowloris);
+    const std::string_view head = "GET / HTTP/1.1\r\nHost: localhost\r\nX-Trickle: ";
+    while (Clock::now() < end) {
+        const Clock::time_point now = Clock::now();
+        for (Trickler& trickler : tricklers) {
+            if (trickler.fd >= 0 && closedByServer(trickler.fd)) {
+                const auto held = std::chrono::duration_cast<std::chrono::nanoseconds>(now - trickler.connectedAt);
+                result.held.record(held.count());
+                close(trickler.fd);
+                trickler.fd = -1;
+            }
+            if (trickler.fd < 0) {
+                trickler.fd = connectTo(port);
+                if (trickler.fd < 0) {
+                    ++result.refused;
+                    continue;
+                }
+                trickler.connectedAt = now;
+                trickler.nextByte = now + TRICKLE_INTERVAL;
+                send(trickler.fd, head.data(), head.size(), MSG_NOSIGNAL);
+            } else if (now >= trickler.nextByte) {
+                send(trickler.fd, "a", 1, MSG_NOSIGNAL); // a failure shows as a close on the next pass
+                trickler.nextByte += TRICKLE_INTERVAL;
+            }
+        }
+        std::this_thread::sleep_for(ATTACK_POLL_INTERVAL);
+    }
+
+    for (const Trickler& trickler : tricklers) {
+        if (trickler.fd >= 0) close(trickler.fd);
+    }
+    for (int fd : readers) {
+        close(fd);
+    }
+}
+
+// Timeouts and rejections as the server counted them, from its telemetry endpoint
+struct ServerCounts {
+    std::array<uint64_t, 4> timeouts{}; // idle, header, body, send
+    uint64_t rejected = 0;
+};
+
+ServerCounts scrapeServer(int port) {
+    ServerCounts counts;
+    int fd = connectTo(port);
+    if (fd < 0) {
+        return counts;
+    }
+    const std::string_view request = "GET /__thermal/metrics HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+    send(fd, request.data(), request.size(), MSG_NOSIGNAL);
+    std::string text;
+    char chunk[16384];
+    ssize_t result;
+    while ((result = recv(fd, chunk, sizeof(chunk), 0)) > 0) {
+        text.append(chunk, result);
+    }
+    close(fd);
+
+    constexpr const char* PHASES[] = {"idle", "header", "body", "send"};
+    for (size_t i = 0; i < counts.timeouts.size(); ++i) {
+        const std::string name = std::string("thermal_connection_timeouts_total{phase=\"") + PHASES[i] + "\"} ";
+        const size_t at = text.find(name);
+        if (at != std::string::npos) {
+            counts.timeouts[i] = std::strtoull(text.c_str() + at + name.size(), nullptr, 10);
+        }
+    }
+    const std::string_view rejected = "\nthermal_connections_rejected_total ";
+    const size_t at = text.find(rejected);
+    if (at != std::string::npos) {
+        counts.rejected = std::strtoull(text.c_str() + at + rejected.size(), nullptr, 10);
+    }
+    return counts;
+}
+
+void printLatency(const Histogram& histogram) {
+    auto us = [](uint64_t nanoseconds) { return nanoseconds / 1000.0; };
+    std::printf("{\"mean\": %.1f, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}",
+                histogram.mean() / 1000.0, us(histogram.percentile(0.5)), us(histogram.percentile(0.9)),
+                us(histogram.percentile(0.99)), us(histogram.percentile(0.999)), us(histogram.max()));
+}
+
+bool parseNumber(const std::string& arg, size_t prefix, double& value) {
+    char* end = nullptr;
+    value = std::strtod(arg.c_str() + prefix, &end);
+    return end && *end == '\0' && value >= 0;
+}
+
+int usage(const char* name) {
+    std::fprintf(stderr,
+                 "Usage: %s [--mode=closed|open] [--rate=<rps>] [--connections=<n>] [--duration=<s>]\n"
+                 "       [--warmup=<s>] [--server=<path>] [--no-watch] [--slowloris=<n>]\n"
+                 "       [--slow-readers=<n>] [-- <thermal options>]\n",
+                 name);
+    return 1;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    options.server = defaultServerPath();
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        double value = 0;
+        if (arg == "--") {
+            options.serverArgs.assign(argv + i + 1, argv + argc);
+            break;
+        } else if (arg == "--mode=closed" || arg == "--mode=open") {
+            options.openLoop = arg == "--mode=open";
+        } else if (arg.starts_with("--rate=") && parseNumber(arg, 7, value) && value > 0) {
+            options.rate = value;
+        } else if (arg.starts_with("--connections=") && parseNumber(arg, 14, value) && value >= 1) {
+            options.connections = static_cast<unsigned>(value);
+        } else if (arg.starts_with("--duration=") && parseNumber(arg, 11, value) && value > 0) {
+            options.duration = value;
+        } else if (arg.starts_with("--warmup=") && parseNumber(arg, 9, value)) {
+            options.warmup = value;
+        } else if (arg.starts_with("--server=")) {
+            options.server = arg.substr(9);
+        } else if (arg == "--no-watch") {
+            options.watch = false;
+        } else if (arg.starts_with("--slowloris=") && parseNumber(arg, 12, value)) {
+            options.slowloris = static_cast<unsigned>(value);
+        } else if (arg.starts_with("--slow-readers=") && parseNumber(arg, 15, value)) {
+            options.slowReaders = static_cast<unsigned>(value);
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if (options.openLoop && options.rate <= 0) {
+        std::fprintf(stderr, "thermal_bench: --mode=open needs --rate\n");
+        return 1;
+    }
+
+    const fs::path root = fs::temp_directory_path() / ("thermal_bench_" + std::to_string(getpid()));
+    writeFixtures(root);
+    const int port = freePort();
+    const pid_t server = startServer(options, root, port);
+
+    std::vector<ConnectionResult> results(options.connections);
+    std::vector<std::thread> threads;
+    const bool underAttack = options.slowloris > 0 || options.slowReaders > 0;
+    AttackResult attack;
+    const Clock::time_point start = Clock::now();
+    if (underAttack) {
+        threads.emplace_back(runAttack, std::cref(options), port, start, std::ref(attack));
+    }
+    for (unsigned i = 0; i < options.connections; ++i) {
+        threads.emplace_back(runConnection, std::cref(options), port, i, start, std::ref(results[i]));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    const ServerCounts serverCounts = underAttack ? scrapeServer(port) : ServerCounts();
+
+    kill(server, SIGTERM);
+    waitpid(server, nullptr, 0);
+    std::error_code error;
+    fs::remove_all(root, error);
+
+    ConnectionResult total;
+    for (const ConnectionResult& result : results) {
+        total.latency.merge(result.latency);
+        for (size_t c = 0; c < CLASS_COUNT; ++c) {
+            total.byClass[c].merge(result.byClass[c]);
+        }
+        total.errors += result.errors;
+        total.bytes += result.bytes;
+    }
+
+    std::string serverArgs = options.watch ? "-w" : "";
+    for (const std::string& arg : options.serverArgs) {
+        serverArgs += (serverArgs.empty() ? "" : " ") + arg;
+    }
+    // Shell quoting survives into the JSON string only escaped
+    std::string escaped;
+    for (char c : serverArgs) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    std::printf("{\n");
+    std::printf("  \"mode\": \"%s\",\n", options.openLoop ? "open" : "closed");
+    if (options.openLoop) {
+        std::printf("  \"target_rps\": %.1f,\n", options.rate);
+    }
+    std::printf("  \"connections\": %u,\n", options.connections);
+    std::printf("  \"duration_s\": %.1f,\n", options.duration);
+    std::printf("  \"server_args\": \"%s\",\n", escaped.c_str());
+    std::printf("  \"requests\": %llu,\n", static_cast<unsigned long long>(total.latency.count()));
+    std::printf("  \"errors\": %llu,\n", static_cast<unsigned long long>(total.errors));
+    std::printf("  \"rps\": %.1f,\n", total.latency.count() / options.duration);
+    std::printf("  \"mb_per_s\": %.1f,\n", total.bytes / options.duration / 1e6);
+    std::printf("  \"latency_us\": ");
+    printLatency(total.latency);
+    std::printf(",\n  \"by_class\": {\n");
+    for (size_t c = 0; c < CLASS_COUNT; ++c) {
+        std::printf("    \"%s\": {\"requests\": %llu, \"latency_us\": ", FIXTURE_CLASSES[c].name,
+                    static_cast<unsigned long long>(total.byClass[c].count()));
+        printLatency(total.byClass[c]);
+        std::printf("}%s\n", c + 1 < CLASS_COUNT ? "," : "");
+    }
+    std::printf("  }");
+    if (underAttack) {
+        auto ms = [](uint64_t nanoseconds) { return nanoseconds / 1e6; };
+        std::printf(",\n  \"attack\": {\"slowloris\": %u, \"slow_readers\": %u, \"refused\": %llu, "
+                    "\"slowloris_closed\": %llu,\n             \"slowloris_held_ms\": "
+                    "{\"p50\": %.0f, \"p99\": %.0f, \"max\": %.0f}},\n",
+                    options.slowloris, options.slowReaders, static_cast<unsigned long long>(attack.refused),
+                    static_cast<unsigned long long>(attack.held.count()), ms(attack.held.percentile(0.5)),
+                    ms(attack.held.percentile(0.99)), ms(attack.held.max()));
+        std::printf("  \"server\": {\"timeouts\": {\"idle\": %llu, \"header\": %llu, \"body\": %llu, "
+                    "\"send\": %llu}, \"rejected\": %llu}",
+                    static_cast<unsigned long long>(serverCounts.timeouts[0]),
+                    static_cast<unsigned long long>(serverCounts.timeouts[1]),
+                    static_cast<unsigned long long>(serverCounts.timeouts[2]),
+                    static_cast<unsigned long long>(serverCounts.timeouts[3]),
+                    static_cast<unsigned long long>(serverCounts.rejected));
+    }
+    std::printf("\n}\n");
+    return 0;
+}
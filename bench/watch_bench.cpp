@@ -0,0 +1,190 @@
+#include "microbench.h"
+#include "server/tree_scan.h"
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+namespace {
+
+constexpr size_t FILES_PER_DIRECTORY = 100;
+
+// The watcher's scan before FileTree: a single-threaded recursive_directory_iterator
+// walk and a stat per file, diffed against a map holding every full path
+namespace baseline {
+
+using FileTimestamps = std::unordered_map<std::string, std::filesystem::file_time_type>;
+
+struct ScannedFile {
+    std::string path;
+    std::filesystem::file_time_type modified;
+};
+
+std::filesystem::file_time_type toFileTime(const timespec& time) {
+    const std::chrono::sys_time<std::chrono::nanoseconds> since(std::chrono::seconds(time.tv_sec) +
+                                                               std::chrono::nanoseconds(time.tv_nsec));
+    return std::chrono::time_point_cast<std::filesystem::file_time_type::duration>(
+        std::chrono::file_clock::from_sys(since));
+}
+
+void scanTree(const std::string& directory, std::vector<ScannedFile>& files) {
+    namespace fs = std::filesystem;
+    for (const auto& entry : fs::recursive_directory_iterator(directory, fs::directory_options::skip_permission_denied)) {
+        if (!entry.is_regular_file() || isIgnoredFile(entry.path().filename().string())) {
+            continue;
+        }
+        struct stat fileStat;
+        if (stat(entry.path().c_str(), &fileStat) == 0 && S_ISREG(fileStat.st_mode)) {
+            files.push_back({entry.path().string(), toFileTime(fileStat.st_mtim)});
+        }
+    }
+}
+
+TreeChanges diffTree(FileTimestamps& known, const std::vector<ScannedFile>& files, const std::string& directory) {
+    TreeChanges changes;
+    std::unordered_set<std::string_view> seen;
+    for (const ScannedFile& file : files) {
+        seen.insert(file.path);
+        auto it = known.find(file.path);
+        if (it == known.end()) {
+            known.emplace(file.path, file.modified);
+            changes.added.push_back(file.path);
+        } else if (it->second != file.modified) {
+            it->second = file.modified;
+            changes.modified.push_back(file.path);
+        }
+    }
+    const std::string prefix = directory + "/";
+    for (auto it = known.begin(); it != known.end();) {
+        if (it->first.starts_with(prefix) && !seen.contains(it->first)) {
+            changes.deleted.push_back(it->first);
+            it = known.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return changes;
+}
+
+}
+
+// An on-disk tree of the given size
+const std::string& diskTree(size_t files) {
+    static std::map<size_t, std::string> trees;
+    auto it = trees.find(files);
+    if (it != trees.end()) {
+        return it->second;
+    }
+
+    auto root = microbench::scratchDirectory("thermal_watch_bench_" + std::to_string(files));
+    for (size_t i = 0; i < files; ++i) {
+        auto directory = root / ("dir" + std::to_string(i / FILES_PER_DIRECTORY));
+        if (i % FILES_PER_DIRECTORY == 0) {
+            std::filesystem::create_directories(directory);
+        }
+        std::ofstream(directory / ("file" + std::to_string(i) + ".js")) << "x";
+    }
+    // Directories modified within the last second are listed again on every
+    // scan; let the new tree settle so rescans measure the steady state
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    return trees.emplace(files, root.string()).first->second;
+}
+
+// Startup: walk the whole tree into an empty map
+void runBaselineInitial(size_t iterations, size_t files) {
+    const std::string& root = diskTree(files);
+    for (size_t i = 0; i < iterations; ++i) {
+        baseline::FileTimestamps known;
+        std::vector<baseline::ScannedFile> scan;
+        baseline::scanTree(root, scan);
+        TreeChanges changes = baseline::diffTree(known, scan, root);
+        microbench::doNotOptimize(changes);
+    }
+}
+
+// A poll that finds nothing new: walk the tree again, then diff it. The
+// map of the first walk is kept between runs so only the poll is timed.
+void runBaselineRescan(size_t iterations, size_t files) {
+    const std::string& root = diskTree(files);
+    static std::map<size_t, baseline::FileTimestamps> knownTrees;
+    auto [it, inserted] = knownTrees.try_emplace(files);
+    std::vector<baseline::ScannedFile> scan;
+    if (inserted) {
+        baseline::scanTree(root, scan);
+        baseline::diffTree(it->second, scan, root);
+    }
+    for (size_t i = 0; i < iterations; ++i) {
+        scan.clear();
+        baseline::scanTree(root, scan);
+        TreeChanges changes = baseline::diffTree(it->second, scan, root);
+        microbench::doNotOptimize(changes);
+    }
+}
+
+void runInitial(size_t iterations, size_t files, unsigned threads) {
+    const std::string& root = diskTree(files);
+    for (size_t i = 0; i < iterations; ++i) {
+        FileTree tree;
+        tree.build(root, threads);
+        microbench::doNotOptimize(tree.size());
+    }
+}
+
+// A tree built once per size, so rescans are timed without the build
+FileTree& builtTree(size_t files) {
+    static std::map<size_t, std::unique_ptr<FileTree>> trees;
+    auto& tree = trees[files];
+    if (!tree) {
+        tree = std::make_unique<FileTree>();
+        tree->build(diskTree(files), 1);
+    }
+    return *tree;
+}
+
+void runRescan(size_t iterations, size_t files, unsigned threads) {
+    const std::string& root = diskTree(files);
+    FileTree& tree = builtTree(files);
+    for (size_t i = 0; i < iterations; ++i) {
+        TreeChanges changes = tree.scan(root, threads);
+        microbench::doNotOptimize(changes);
+    }
+}
+
+// A poll right after one file was saved in place
+void runRescanOneChange(size_t iterations, size_t files) {
+    const std::string& root = diskTree(files);
+    const std::string saved = root + "/dir" + std::to_string(files / 2 / FILES_PER_DIRECTORY) + "/file" +
+        std::to_string(files / 2) + ".js";
+    FileTree& tree = builtTree(files);
+    for (size_t i = 0; i < iterations; ++i) {
+        const timespec times[2] = {{0, UTIME_OMIT}, {static_cast<time_t>(1000000 + i), 0}};
+        utimensat(AT_FDCWD, saved.c_str(), times, 0);
+        TreeChanges changes = tree.scan(root, 1);
+        microbench::doNotOptimize(changes);
+    }
+}
+
+}
+
+MICROBENCH("watch/baseline-initial-100k") { runBaselineInitial(iterations, 100000); }
+MICROBENCH("watch/baseline-initial-1M") { runBaselineInitial(iterations, 1000000); }
+MICROBENCH("watch/baseline-rescan-1k") { runBaselineRescan(iterations, 1000); }
+MICROBENCH("watch/baseline-rescan-100k") { runBaselineRescan(iterations, 100000); }
+MICROBENCH("watch/baseline-rescan-1M") { runBaselineRescan(iterations, 1000000); }
+MICROBENCH("watch/initial-100k") { runInitial(iterations, 100000, 1); }
+MICROBENCH("watch/initial-1M") { runInitial(iterations, 1000000, 1); }
+MICROBENCH("watch/initial-1M-4-threads") { runInitial(iterations, 1000000, 4); }
+MICROBENCH("watch/rescan-1k") { runRescan(iterations, 1000, 1); }
+MICROBENCH("watch/rescan-100k") { runRescan(iterations, 100000, 1); }
+MICROBENCH("watch/rescan-1M") { runRescan(iterations, 1000000, 1); }
+MICROBENCH("watch/rescan-1M-4-threads") { runRescan(iterations, 1000000, 4); }
+MICROBENCH("watch/rescan-one-change-100k") { runRescanOneChange(iterations, 100000); }
@@ -0,0 +1,253 @@
+#include "server/http_parser.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Fuzz target for HttpParser and percentDecode. Every input is parsed as a
+// connection buffer twice: in one go, and resumed as it arrives in small
+// pieces, the way a worker loop feeds it after each read. Pipelined requests
+// are consumed one after another in both. The two must agree on every
+// request and on how parsing stops, and every view of a completed request
+// must lie inside it. The path bytes also go through percentDecode next to
+// a plain reference decoder.
+//
+// Built with -fsanitize=fuzzer this is a libFuzzer target. Elsewhere main()
+// mutates a handful of real requests at random instead:
+//   thermal_parser_fuzz [runs] [seed]
+// Either way a disagreement prints the input and aborts.
+
+namespace {
+
+void printInput(std::string_view input) {
+    std::fprintf(stderr, "input (%zu bytes): \"", input.size());
+    for (unsigned char c : input) {
+        if (c == '\\' || c == '"') {
+            std::fprintf(stderr, "\\%c", c);
+        } else if (c >= 0x20 && c < 0x7f) {
+            std::fputc(c, stderr);
+        } else {
+            std::fprintf(stderr, "\\x%02x", c);
+        }
+    }
+    std::fprintf(stderr, "\"\n");
+}
+
+[[noreturn]] void failInput(std::string_view input, const char* what, const std::string& expected,
+                            const std::string& actual) {
+    std::fprintf(stderr, "parser_fuzz: %s\n", what);
+    printInput(input);
+    std::fprintf(stderr, "expected:\n%s\nactual:\n%s\n", expected.c_str(), actual.c_str());
+    std::abort();
+}
+
+bool within(std::string_view view, const char* begin, const char* end) {
+    return view.empty() || (view.data() >= begin && view.data() + view.size() <= end);
+}
+
+// One completed request as text, so the two parses compare as strings
+std::string describe(const HttpRequest& request, size_t length) {
+    std::string text = "length " + std::to_string(length) + " content-length " +
+                       std::to_string(request.contentLength) + "\n";
+    text.append(request.method).append(" ").append(request.path).append(" ?").append(request.query);
+    text.append(" ").append(request.version).append("\n");
+    for (size_t i = 0; i < request.headerCount; ++i) {
+        text.append(request.headers[i].name).append(": ").append(request.headers[i].value).append("\n");
+    }
+    return text;
+}
+
+// Parses every request in buffer, reading it in pieces of the sizes next()
+// returns (or all at once when it returns 0). Returns the requests and how
+// parsing ended, one block of text each.
+std::string parseAll(std::string_view input, const std::function<size_t()>& next) {
+    std::vector<char> buffer(input.size());
+    HttpParser parser;
+    HttpRequest request;
+    std::string result;
+
+    size_t received = 0;
+    size_t offset = 0; // start of the request being parsed
+    while (true) {
+        if (received < input.size()) {
+            size_t piece = next();
+            piece = piece == 0 ? input.size() - received : std::min(piece, input.size() - received);
+            std::memcpy(buffer.data() + received, input.data() + received, piece);
+            received += piece;
+        }
+
+        std::span<char> unread(buffer.data() + offset, received - offset);
+        HttpParser::Status status = parser.parse(unread, request);
+        if (status == HttpParser::Status::Complete) {
+            const size_t length = parser.requestLength();
+            const char* begin = unread.data();
+            const char* end = begin + length;
+            bool inside = length <= unread.size() && within(request.method, begin, end) &&
+                          within(request.path, begin, end) && within(request.query, begin, end) &&
+                          within(request.version, begin, end) && request.headerCount <= HttpRequest::MAX_HEADERS;
+            for (size_t i = 0; inside && i < request.headerCount; ++i) {
+                inside = within(request.headers[i].name, begin, end) && within(request.headers[i].value, begin, end);
+            }
+            if (!inside) {
+                failInput(input, "a completed request points outside its bytes", "", describe(request, length));
+            }
+
+            result += describe(request, length);
+            parser.reset();
+            offset += length;
+            continue;
+        }
+        if (status == HttpParser::Status::Error) {
+            return result + "error " + std::to_string(parser.errorStatus()) + "\n";
+        }
+        if (received == input.size()) {
+            return result + "incomplete\n";
+        }
+    }
+}
+
+int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// The decoding percentDecode must match, written the obvious way
+std::string referenceDecode(std::string_view text) {
+    std::string out;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] != '%') {
+            out += text[i];
+            continue;
+        }
+        if (i + 2 >= text.size() || hexDigit(text[i + 1]) < 0 || hexDigit(text[i + 2]) < 0) {
+            return "malformed";
+        }
+        char c = static_cast<char>(hexDigit(text[i + 1]) * 16 + hexDigit(text[i + 2]));
+        if (c == '\0') {
+            return "malformed";
+        }
+        out += c;
+        i += 2;
+    }
+    return out;
+}
+
+void checkPercentDecode(std::string_view input) {
+    std::vector<char> buffer(input.begin(), input.end());
+    size_t length = percentDecode(buffer.data(), buffer.size());
+    std::string actual = length == std::string_view::npos ? "malformed" : std::string(buffer.data(), length);
+    std::string expected = referenceDecode(input);
+    if (actual != expected) {
+        failInput(input, "percentDecode disagrees with the reference decoder", expected, actual);
+    }
+}
+
+void checkInput(std::string_view input) {
+    const std::string oneShot = parseAll(input, [] { return size_t(0); });
+
+    // A byte at a time covers every split point, random pieces the usual reads
+    const std::string byByte = parseAll(input, [] { return size_t(1); });
+    if (byByte != oneShot) {
+        failInput(input, "a parse fed a byte at a time disagrees with a one-shot parse", oneShot, byByte);
+    }
+    std::minstd_rand random(static_cast<uint32_t>(std::hash<std::string_view>{}(input)));
+    const std::string pieces = parseAll(input, [&random] { return size_t(1 + random() % 48); });
+    if (pieces != oneShot) {
+        failInput(input, "a parse fed in random pieces disagrees with a one-shot parse", oneShot, pieces);
+    }
+
+    checkPercentDecode(input);
+}
+
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    checkInput(std::string_view(reinterpret_cast<const char*>(data), size));
+    return 0;
+}
+
+#ifndef THERMAL_LIBFUZZER
+
+namespace {
+
+// What the random mutations start from: real requests and the edges the
+// parser handles specially
+constexpr std::string_view SEEDS[] = {
+    "GET /index.html HTTP/1.1\r\n\r\n",
+    "GET /css/style.css?v=3 HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0\r\n"
+    "Accept: text/css,*/*;q=0.1\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "If-None-Match: \"1a2b-5f3c\"\r\n"
+    "\r\n",
+    "GET /img/my%20holiday%20photos/caf%C3%A9%20terrace.jpg HTTP/1.1\r\nHost: localhost\r\n\r\n",
+    "POST /form HTTP/1.1\r\nHost: localhost\r\nContent-Length: 11\r\n\r\nhello=world",
+    "GET /a HTTP/1.1\r\nHost: x\r\n\r\nGET /b?q=1 HTTP/1.1\r\nHost: x\r\n\r\nHEAD /c HTTP/1.0\r\n\r\n",
+    "\r\n\r\nGET / HTTP/1.1\nHost: bare-lf\n\n",
+    "GET http://localhost:8080/path%2Fname HTTP/1.1\r\nContent-Length: 0\r\ncontent-length: 0\r\n\r\n",
+    "OPTIONS * HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n",
+    "GET /%00%zz%4 HTTP/1.1\r\n\r\n",
+};
+
+// Characters the parser branches on, favored over arbitrary bytes
+constexpr std::string_view INTERESTING = "\r\n :%/?*\t0123456789aFG";
+
+std::string mutate(std::string input, std::mt19937_64& random) {
+    auto pick = [&random](size_t bound) { return static_cast<size_t>(random() % bound); };
+    auto byte = [&]() {
+        return pick(2) ? INTERESTING[pick(INTERESTING.size())] : static_cast<char>(pick(256));
+    };
+
+    const size_t mutations = pick(9);
+    for (size_t i = 0; i < mutations; ++i) {
+        const size_t at = input.empty() ? 0 : pick(input.size());
+        switch (pick(6)) {
+        case 0:
+            if (!input.empty()) input[at] = byte();
+            break;
+        case 1:
+            input.insert(input.begin() + at, byte());
+            break;
+        case 2:
+            if (!input.empty()) input.erase(at, 1 + pick(8));
+            break;
+        case 3:
+            input.insert(at, input.substr(pick(input.size() + 1), 1 + pick(32))); // repeat a piece
+            break;
+        case 4:
+            input.resize(at); // cut short
+            break;
+        case 5:
+            input.insert(at, SEEDS[pick(std::size(SEEDS))]); // splice in another request
+            break;
+        }
+    }
+    return input;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    const unsigned long long runs = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+    const unsigned long long seed = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : std::random_device{}();
+    std::printf("parser_fuzz: %llu runs, seed %llu\n", runs, seed);
+
+    std::mt19937_64 random(seed);
+    for (unsigned long long run = 0; run < runs; ++run) {
+        checkInput(mutate(std::string(SEEDS[random() % std::size(SEEDS)]), random));
+    }
+    std::printf("parser_fuzz: no disagreements\n");
+    return 0;
+}
+
+#endif
@@ -19,6 +19,28 @@ int main(int argc, char* argv[])
 		std::cerr << "Options:" << std::endl;
 		std::cerr << "  -w           Enable watch mode (hot reload)" << std::endl;
 		std::cerr << "  -p <port>    Specify port number (default: 8080)" << std::endl;
+		std::cerr << "  --io=<mode>  I/O model: thread (default), epoll or uring" << std::endl;
+		std::cerr << "  --workers=<n> Number of epoll/uring worker loops (default: one per core)" << std::endl;
+		std::cerr << "  --reuseport  Give every worker loop its own SO_REUSEPORT listener" << std::endl;
+		std::cerr << "  --pin        Pin each worker loop to a CPU of its own" << std::endl;
+		std::cerr << "  --numa       Pin workers spread over NUMA nodes, with a file cache per node" << std::endl;
+		std::cerr << "  --keep-alive=<s> Idle keep-alive timeout in seconds, 0 disables (default: 5)" << std::endl;
+		std::cerr << "  --max-requests=<n> Requests served per connection (default: 100)" << std::endl;
+		std::cerr << "  --header-timeout=<s> Time to receive a request head, 0 disables (default: 10)" << std::endl;
+		std::cerr << "  --body-timeout=<s> Time to receive a request body after its head, 0 disables (default: 30)" << std::endl;
+		std::cerr << "  --send-timeout=<s> Time a response may go without a byte written, 0 disables (default: 30)" << std::endl;
+		std::cerr << "  --max-connections=<n> Open connections before new ones get 503, 0 = no limit (default: 0)" << std::endl;
+		std::cerr << "  --max-connections-per-ip=<n> Open connections per client address, 0 = no limit (default: 0)" << std::endl;
+		std::cerr << "  --no-sendfile Copy file bodies through userspace instead of sendfile(2)" << std::endl;
+		std::cerr << "  --cache-size=<MB> In-memory file cache budget, 0 disables (default: 64)" << std::endl;
+		std::cerr << "  --precompress Compress text files with gzip/brotli at startup and on change" << std::endl;
+		std::cerr << "  --index      Keep an in-memory index of the served files, so lookups and 404s skip the disk (implied by -w)" << std::endl;
+		std::cerr << "  --debounce=<ms> Collapse file changes this close together into one reload (default: 100)" << std::endl;
+		std::cerr << "  --pool-threads=<n> Threads for blocking file reads and compression (default: one per core)" << std::endl;
+		std::cerr << "  --pool-queue=<n> Queued blocking tasks before requests get 503 (default: 1024)" << std::endl;
+		std::cerr << "  --access-log=<file> Write the structured access log here (default: stdout)" << std::endl;
+		std::cerr << "  --log-level=<level> info, warn (4xx and up), error (5xx) or off (default: info)" << std::endl;
+		std::cerr << "  --log-sample=<n> Log one in n successful requests; failures are always logged (default: 1)" << std::endl;
 		std::cerr << "Example: " << argv[0] << " -w -p 3000 ./public" << std::endl;
 		return 1;
 	}
@@ -27,6 +49,7 @@ int main(int argc, char* argv[])
 	bool watchMode = false;
 	int port = 8080; // default portD
 	std::string pathArg;
+	ServerOptions options;
 	
 	// Parse arguments into a vector of strings
 	std::vector<std::string> args(argv + 1, argv + argc);
@@ -48,6 +71,189 @@ int main(int argc, char* argv[])
 				std::cerr << "Error: Invalid port number '" << args[i + 1] << "'" << std::endl;
 				return 1;
 			}
+		} else if (args[i].starts_with("--io=")) {
+			std::string mode = args[i].substr(5);
+			if (mode == "thread") {
+				options.ioMode = IoMode::Thread;
+			} else if (mode == "epoll") {
+				options.ioMode = IoMode::Epoll;
+			} else if (mode == "uring") {
+				options.ioMode = IoMode::Uring;
+			} else {
+				std::cerr << "Error: Unknown I/O mode '" << mode << "' (expected thread, epoll or uring)" << std::endl;
+				return 1;
+			}
+		} else if (args[i].starts_with("--workers=")) {
+			try {
+				int workers = std::stoi(args[i].substr(10));
+				if (workers < 1) {
+					std::cerr << "Error: Worker count must be at least 1" << std::endl;
+					return 1;
+				}
+				options.workers = workers;
+			} catch (const std::exception& e) {
+				std::cerr << "Error: Invalid worker count '" << args[i].substr(10) << "'" << std::endl;
+				return 1;
+			}
+		} else if (args[i] == "--reuseport") {
+			options.reusePort = true;
+		} else if (args[i] == "--pin") {
+			options.pinWorkers = true;
+		} else if (args[i] == "--numa") {
+			options.pinWorkers = true;
+			options.numaAware = true;
+		} else if (args[i] == "--no-sendfile") {
+			options.sendfile = false;
+		} else if (args[i] == "--precompress") {
+			options.precompress = true;
+		} else if (args[i] == "--index") {
+			options.pathIndex = true;
+		} else if (args[i].starts_with("--debounce=")) {
+			try {
+				options.reloadDebounceMs = std::stoi(args[i].substr(11));
+				if (options.reloadDebounceMs < 0) {
+					std::cerr << "Error: Debounce window cannot be negative" << std::endl;
+					return 1;
+				}
+			} catch (const std::exception& e) {
+				std::cerr << "Error: Invalid debounce window '" << args[i].substr(11) << "'" << std::endl;
+				return 1;
+			}
+		} else if (args[i].starts_with("--pool-threads=")) {
+			try {
+				int threads = std::stoi(args[i].substr(15));
+				if (threads < 1) {
+					std::cerr << "Error: Pool thread count must be at least 1" << std::endl;
+					return 1;
+				}
+				options.poolThreads = threads;
+			} catch (const std::exception& e) {
+				std::cerr << "Error: Invalid pool thread count '" << args[i].substr(15) << "'" << std::endl;
+				return 1;
+			}
+		} else if (args[i].starts_with("--pool-queue=")) {
+			try {
+				int queueLimit = std::stoi(args[i].substr(13));
+				if (queueLimit < 1) {
+					std::cerr << "Error: Pool queue limit must be at least 1" << std::endl;
+					return 1;
+				}
+				options.poolQueueLimit = queueLimit;
+			} catch (const std::exception& e) {
+				std::cerr << "Error: Invalid pool queue limit '" << args[i].substr(13) << "'" << std::endl;
+				return 1;
+			}
+		} else if (args[i].starts_with("--cache-size=")) {
+			try {
+				int cacheMegabytes = std::stoi(args[i].substr(13));
+				if (cacheMegabytes < 0) {
+					std::cerr << "Error: Cache size cannot be negative" << std::endl;
+					return 1;
+				}
+				options.cacheBytes = static_cast<size_t>(cacheMegabytes) * 1024 * 1024;
+			} catch (const std::exception& e) {
+				std::cerr << "Error: Invalid cache size '" << args[i].substr(13) << "'" << std::endl;
+				return 1;
+			}
+		} else if (args[i].starts_with("--keep-alive=")) {
+			try {
+				options.keepAliveTimeout = std::stoi(args[i].substr(13));
+				if (options.keepAliveTimeout < 0) {
+					std::cerr << "Error: Keep-alive timeout cannot be negative" << std::endl;
+					return 1;
+				}
+			} catch (const std::exception& e) {
+				std::cerr << "Error: Invalid keep-alive timeout '" << args[i].substr(13) << "'" << std::endl;
+				return 1;
+			}
+		} else if (args[i].starts_with("--header-timeout=")) {
+			try {
+				options.headerTimeout = std::stoi(args[i].substr(17));
+				if (options.headerTimeout < 0) {
+					std::cerr << "Error: Header timeout cannot be negative" << std::endl;
+					return 1;
+				}
+			} catch (const std::exception& e) {
+				std::cerr << "Error: Invalid header timeout '" << args[i].substr(17) << "'" << std::endl;
+				return 1;
+			}
+		} else if (args[i].starts_with("--body-timeout=")) {
+			try {
+				options.bodyTimeout = std::stoi(args[i].substr(15));
+				if (options.bodyTimeout < 0) {
+					std::cerr << "Error: Body timeout cannot be negative" << std::endl;
+					return 1;
+				}
+			} catch (const std::exception& e) {
+				std::cerr << "Error: Invalid body timeout '" << args[i].substr(15) << "'" << std::endl;
+				return 1;
+			}
+		} else if (args[i].starts_with("--send-timeout=")) {
+			try {
+				options.sendTimeout = std::stoi(args[i].substr(15));
+				if (options.sendTimeout < 0) {
+					std::cerr << "Error: Send timeout cannot be negative" << std::endl;
+					return 1;
+				}
+			} catch (const std::exception& e) {
+				std::cerr << "Error: Invalid send timeout '" << args[i].substr(15) << "'" << std::endl;
+				return 1;
+			}
+		} else if (args[i].starts_with("--max-connections=")) {
+			try {
+				int maxConnections = std::stoi(args[i].substr(18));
+				if (maxConnections < 0) {
+					std::cerr << "Error: Connection limit cannot be negative" << std::endl;
+					return 1;
+				}
+				options.maxConnections = maxConnections;
+			} catch (const std::exception& e) {
+				std::cerr << "Error: Invalid connection limit '" << args[i].substr(18) << "'" << std::endl;
+				return 1;
+			}
+		} else if (args[i].starts_with("--max-connections-per-ip=")) {
+			try {
+				int maxConnections = std::stoi(args[i].substr(25));
+				if (maxConnections < 0) {
+					std::cerr << "Error: Per-address connection limit cannot be negative" << std::endl;
+					return 1;
+				}
+				options.maxConnectionsPerIp = maxConnections;
+			} catch (const std::exception& e) {
+				std::cerr << "Error: Invalid per-address connection limit '" << args[i].substr(25) << "'" << std::endl;
+				return 1;
+			}
+		} else if (args[i].starts_with("--access-log=")) {
+			options.accessLogPath = args[i].substr(13);
+		} else if (args[i].starts_with("--log-level=")) {
+			if (!accesslog::parseLevel(args[i].substr(12), options.logLevel)) {
+				std::cerr << "Error: Unknown log level '" << args[i].substr(12) << "' (expected info, warn, error or off)" << std::endl;
+				return 1;
+			}
+		} else if (args[i].starts_with("--log-sample=")) {
+			try {
+				int sample = std::stoi(args[i].substr(13));
+				if (sample < 1) {
+					std::cerr << "Error: Log sample rate must be at least 1" << std::endl;
+					return 1;
+				}
+				options.logSample = sample;
+			} catch (const std::exception& e) {
+				std::cerr << "Error: Invalid log sample rate '" << args[i].substr(13) << "'" << std::endl;
+				return 1;
+			}
+		} else if (args[i].starts_with("--max-requests=")) {
+			try {
+				int maxRequests = std::stoi(args[i].substr(15));
+				if (maxRequests < 1) {
+					std::cerr << "Error: Max requests must be at least 1" << std::endl;
+					return 1;
+				}
+				options.maxRequestsPerConnection = maxRequests;
+			} catch (const std::exception& e) {
+				std::cerr << "Error: Invalid max requests '" << args[i].substr(15) << "'" << std::endl;
+				return 1;
+			}
 		} else {
 			// arg is something other than flags, we hope its a path
 			// Verify the path exists and is a directory
@@ -61,11 +267,11 @@ int main(int argc, char* argv[])
 	// Check if we found a path
 	if (!pathArg.empty()) {
 		// if path is found, create a server
-		Server server(pathArg, watchMode, port);
+		Server server(pathArg, watchMode, port, options);
 		
 		std::cout << "Server will run on port: " << port << std::endl;
 		
-		if (watchMode) {
+		if (watchMode || options.pathIndex) {
 			// In watch mode, start server in a separate thread and then watch
 			std::thread serverThread([&server]() {
 				server.startServer();
@@ -0,0 +1,278 @@
+#include "access_log.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+namespace accesslog {
+
+namespace {
+
+constexpr size_t RING_CAPACITY = 512;
+
+// The writer sleeps this long after a pass that found nothing to write
+constexpr auto IDLE_INTERVAL = std::chrono::milliseconds(20);
+
+// Formatted output is written once it grows past this, or at the end of a pass
+constexpr size_t BATCH_SIZE = 64 * 1024;
+
+// Single producer, the owning thread; single consumer, the writer
+struct Ring {
+    alignas(64) std::atomic<uint64_t> head{0}; // next slot the owner fills
+    alignas(64) std::atomic<uint64_t> tail{0}; // next slot the writer takes
+    alignas(64) std::atomic<uint64_t> dropped{0};
+    uint64_t sampleCounter = 0;
+    Entry entries[RING_CAPACITY];
+};
+
+// Rings outlive their threads and pass to the next thread that starts, like
+// the metrics blocks
+struct Registry {
+    std::mutex mutex;
+    std::deque<Ring> rings;
+    std::vector<Ring*> freeRings;
+};
+
+Registry& registry() {
+    static Registry* instance = new Registry;
+    return *instance;
+}
+
+thread_local Ring* currentRing = nullptr;
+
+struct Release {
+    ~Release() {
+        if (currentRing != nullptr) {
+            Registry& rings = registry();
+            std::lock_guard<std::mutex> lock(rings.mutex);
+            rings.freeRings.push_back(currentRing);
+            currentRing = nullptr;
+        }
+    }
+};
+
+thread_local Release release;
+
+std::atomic<unsigned> sampleRate{1};
+
+Ring& localRing() {
+    if (currentRing != nullptr) {
+        return *currentRing;
+    }
+    Registry& rings = registry();
+    {
+        std::lock_guard<std::mutex> lock(rings.mutex);
+        if (!rings.freeRings.empty()) {
+            currentRing = rings.freeRings.back();
+            rings.freeRings.pop_back();
+        } else {
+            currentRing = &rings.rings.emplace_back();
+        }
+    }
+    [[maybe_unused]] Release* armed = &release; // constructs it, so its destructor runs at thread exit
+    return *currentRing;
+}
+
+size_t copyTruncated(char* destination, size_t capacity, std::string_view text) {
+    const size_t length = std::min(text.size(), capacity);
+    memcpy(destination, text.data(), length);
+    return length;
+}
+
+const char* levelName(Level level) {
+    switch (level) {
+    case Level::Warn: return "warn";
+    case Level::Error: return "error";
+    default: return "info";
+    }
+}
+
+void appendEscaped(std::string& out, std::string_view text) {
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buffer[8];
+            snprintf(buffer, sizeof(buffer), "\\u%04x", static_cast<unsigned char>(c));
+            out += buffer;
+        } else {
+            out += c;
+        }
+    }
+}
+
+// One JSON object per line
+class Formatter {
+public:
+    void append(std::string& out, const Entry& entry) {
+        const time_t second = entry.time / 1000000000;
+        if (second != cachedSecond) {
+            tm parts;
+            gmtime_r(&second, &parts);
+            strftime(secondText, sizeof(secondText), "%Y-%m-%dT%H:%M:%S", &parts);
+            cachedSecond = second;
+        }
+        char buffer[96];
+        int length = snprintf(buffer, sizeof(buffer), "{\"time\":\"%s.%03dZ\",\"level\":\"%s\"", secondText,
+                              static_cast<int>(entry.time / 1000000 % 1000), levelName(entry.level));
+        out.append(buffer, length);
+
+        const std::string_view text(entry.text, entry.textLength);
+        if (entry.status == 0) {
+            out += ",\"msg\":\"";
+            appendEscaped(out, text);
+            out += "\"}\n";
+            return;
+        }
+        out += ",\"method\":\"";
+        appendEscaped(out, std::string_view(entry.method, entry.methodLength));
+        out += "\",\"path\":\"";
+        appendEscaped(out, text);
+        length = snprintf(buffer, sizeof(buffer), "\",\"status\":%u,\"bytes\":%ju,\"duration_us\":%.1f}\n",
+                          entry.status, static_cast<uintmax_t>(entry.bytes), entry.duration / 1000.0);
+        out.append(buffer, length);
+    }
+
+private:
+    time_t cachedSecond = -1;
+    char secondText[32] = {};
+};
+
+bool writeAll(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t result = write(fd, data.data() + written, data.size() - written);
+        if (result < 0 && errno == EINTR) continue;
+        if (result <= 0) return false;
+        written += result;
+    }
+    return true;
+}
+
+void runWriter(int fd) {
+    Formatter formatter;
+    std::string batch;
+    batch.reserve(2 * BATCH_SIZE);
+    std::vector<Ring*> rings;
+    uint64_t reportedDrops = 0;
+
+    while (true) {
+        {
+            Registry& registered = registry();
+            std::lock_guard<std::mutex> lock(registered.mutex);
+            rings.clear();
+            for (Ring& ring : registered.rings) {
+                rings.push_back(&ring);
+            }
+        }
+
+        uint64_t drops = 0;
+        bool found = false;
+        for (Ring* ring : rings) {
+            uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+            const uint64_t head = ring->head.load(std::memory_order_acquire);
+            found |= tail != head;
+            for (; tail != head; ++tail) {
+                formatter.append(batch, ring->entries[tail % RING_CAPACITY]);
+                if (batch.size() >= BATCH_SIZE) {
+                    // Free the slots before blocking in write()
+                    ring->tail.store(tail + 1, std::memory_order_release);
+                    writeAll(fd, batch);
+                    batch.clear();
+                }
+            }
+            ring->tail.store(tail, std::memory_order_release);
+            drops += ring->dropped.load(std::memory_order_relaxed);
+        }
+
+        if (drops > reportedDrops && enabled(Level::Warn)) {
+            Entry entry;
+            entry.level = Level::Warn;
+            entry.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            const std::string text = "log writer fell behind, dropped " + std::to_string(drops - reportedDrops) +
+                " entries";
+            entry.textLength = copyTruncated(entry.text, Entry::TEXT_SIZE, text);
+            formatter.append(batch, entry);
+        }
+        reportedDrops = drops;
+
+        if (!batch.empty()) {
+            writeAll(fd, batch);
+            batch.clear();
+        }
+        if (!found) {
+            std::this_thread::sleep_for(IDLE_INTERVAL);
+        }
+    }
+}
+
+}
+
+bool parseLevel(std::string_view name, Level& level) {
+    if (name == "info") level = Level::Info;
+    else if (name == "warn") level = Level::Warn;
+    else if (name == "error") level = Level::Error;
+    else if (name == "off") level = Level::Off;
+    else return false;
+    return true;
+}
+
+void start(const Options& options) {
+    if (options.level == Level::Off) {
+        return;
+    }
+    sampleRate.store(std::max(options.sample, 1u), std::memory_order_relaxed);
+    std::thread(runWriter, options.fd).detach();
+    threshold.store(options.level, std::memory_order_relaxed);
+}
+
+bool wanted(int status) {
+    const Level level = levelFor(status);
+    if (!enabled(level)) {
+        return false;
+    }
+    // Only routine requests are sampled, every failure is kept
+    const unsigned sample = sampleRate.load(std::memory_order_relaxed);
+    return level != Level::Info || sample == 1 || localRing().sampleCounter++ % sample == 0;
+}
+
+void describe(Entry& entry, std::string_view method, std::string_view path) {
+    entry.methodLength = copyTruncated(entry.method, Entry::METHOD_SIZE, method);
+    entry.textLength = copyTruncated(entry.text, Entry::TEXT_SIZE, path);
+}
+
+void submit(Entry& entry) {
+    entry.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    Ring& ring = localRing();
+    const uint64_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) == RING_CAPACITY) {
+        ring.dropped.store(ring.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+    ring.entries[head % RING_CAPACITY] = entry;
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+void message(Level level, std::string_view text) {
+    if (!enabled(level)) {
+        return;
+    }
+    Entry entry;
+    entry.level = level;
+    entry.textLength = copyTruncated(entry.text, Entry::TEXT_SIZE, text);
+    submit(entry);
+}
+
+}
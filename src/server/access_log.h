@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Structured access and event log, kept off the request path. Every thread
+// copies fixed-size entries into a ring of its own; one background thread
+// drains the rings into batched write() calls. A ring that is full because
+// the disk cannot keep up drops the entry instead of blocking the thread.
+namespace accesslog {
+
+// Access entries are Info below 400, Warn for 4xx and Error for 5xx
+enum class Level : uint8_t {
+    Info,
+    Warn,
+    Error,
+    Off
+};
+
+bool parseLevel(std::string_view name, Level& level);
+
+// One ring slot: a completed request, or a message when status is 0
+struct Entry {
+    static constexpr size_t METHOD_SIZE = 8;
+    static constexpr size_t TEXT_SIZE = 200; // longer paths and messages are cut
+
+    int64_t time = 0;      // wall clock at submission, ns since the epoch
+    uint64_t duration = 0; // request parsed until its last byte was out, ns
+    uint64_t bytes = 0;
+    uint16_t status = 0;
+    Level level = Level::Info;
+    uint8_t methodLength = 0;
+    uint8_t textLength = 0;
+    char method[METHOD_SIZE];
+    char text[TEXT_SIZE]; // request path or message
+};
+
+struct Options {
+    int fd = 1;           // not closed by the log
+    Level level = Level::Info;
+    unsigned sample = 1;  // keep one in this many Info access entries
+};
+
+// Starts the writer thread; nothing is logged before this
+void start(const Options& options);
+
+inline std::atomic<Level> threshold{Level::Off};
+
+inline bool enabled(Level level) {
+    return level >= threshold.load(std::memory_order_relaxed);
+}
+
+inline Level levelFor(int status) {
+    return status >= 500 ? Level::Error : status >= 400 ? Level::Warn : Level::Info;
+}
+
+// Whether a request answered with status should be logged, after level and sampling
+bool wanted(int status);
+
+// Fills in method and path of a request entry
+void describe(Entry& entry, std::string_view method, std::string_view path);
+
+// Copies the entry into the calling thread's ring, or counts it as dropped
+void submit(Entry& entry);
+
+void message(Level level, std::string_view text);
+
+}
@@ -0,0 +1,172 @@
+#include "compression.h"
+#include <charconv>
+#include <zlib.h>
+
+#ifdef THERMAL_HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+namespace {
+
+char toLower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (toLower(a[i]) != toLower(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string_view trim(std::string_view value) {
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) value.remove_prefix(1);
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) value.remove_suffix(1);
+    return value;
+}
+
+// Quality of one Accept-Encoding item ("br;q=0.8"), 1 when absent
+double parseQuality(std::string_view parameters) {
+    while (!parameters.empty()) {
+        size_t semicolon = parameters.find(';');
+        std::string_view parameter = trim(parameters.substr(0, semicolon));
+        if (parameter.size() > 2 && toLower(parameter[0]) == 'q' && parameter[1] == '=') {
+            double quality = 0;
+            auto result = std::from_chars(parameter.data() + 2, parameter.data() + parameter.size(), quality);
+            return result.ec == std::errc() ? quality : 0;
+        }
+        if (semicolon == std::string_view::npos) break;
+        parameters.remove_prefix(semicolon + 1);
+    }
+    return 1;
+}
+
+bool gzipCompress(std::string_view input, CompressionLevel level, std::string& output) {
+    z_stream stream{};
+    // windowBits 15 + 16 selects the gzip wrapper instead of raw zlib
+    if (deflateInit2(&stream, level == CompressionLevel::Best ? 9 : 6, Z_DEFLATED, 15 + 16,
+                     level == CompressionLevel::Best ? 9 : 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+
+    output.resize(deflateBound(&stream, input.size()));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    stream.avail_in = input.size();
+    stream.next_out = reinterpret_cast<Bytef*>(output.data());
+    stream.avail_out = output.size();
+
+    // deflateBound() leaves room for the whole stream, so one call finishes it
+    int result = deflate(&stream, Z_FINISH);
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result == Z_STREAM_END;
+}
+
+#ifdef THERMAL_HAVE_BROTLI
+bool brotliCompress(std::string_view input, CompressionLevel level, std::string& output) {
+    size_t length = BrotliEncoderMaxCompressedSize(input.size());
+    output.resize(length);
+    // Quality 11 is several times slower than 5 for a few percent more, so
+    // the request path uses 5 and leaves 11 to ahead-of-time compression
+    int quality = level == CompressionLevel::Best ? BROTLI_MAX_QUALITY : 5;
+    if (!BrotliEncoderCompress(quality, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, input.size(),
+                               reinterpret_cast<const uint8_t*>(input.data()), &length,
+                               reinterpret_cast<uint8_t*>(output.data()))) {
+        return false;
+    }
+    output.resize(length);
+    return true;
+}
+#endif
+
+}
+
+AcceptedEncodings negotiateEncodings(std::string_view acceptEncoding) {
+    double brotli = -1, gzip = -1, wildcard = -1;
+    while (!acceptEncoding.empty()) {
+        size_t comma = acceptEncoding.find(',');
+        std::string_view item = acceptEncoding.substr(0, comma);
+        size_t semicolon = item.find(';');
+        std::string_view coding = trim(item.substr(0, semicolon));
+        double quality = semicolon == std::string_view::npos ? 1 : parseQuality(item.substr(semicolon + 1));
+
+        if (equalsIgnoreCase(coding, "br")) {
+            brotli = quality;
+        } else if (equalsIgnoreCase(coding, "gzip") || equalsIgnoreCase(coding, "x-gzip")) {
+            gzip = quality;
+        } else if (coding == "*") {
+            wildcard = quality;
+        }
+        if (comma == std::string_view::npos) break;
+        acceptEncoding.remove_prefix(comma + 1);
+    }
+
+    // "*" covers codings that are not listed by name; q=0 means "not acceptable"
+    if (brotli < 0) brotli = wildcard;
+    if (gzip < 0) gzip = wildcard;
+
+    AcceptedEncodings accepted;
+    if (brotli > 0 && brotli >= gzip) {
+        accepted.encodings[accepted.count++] = ContentEncoding::Brotli;
+    }
+    if (gzip > 0) {
+        accepted.encodings[accepted.count++] = ContentEncoding::Gzip;
+    }
+    if (brotli > 0 && brotli < gzip) {
+        accepted.encodings[accepted.count++] = ContentEncoding::Brotli;
+    }
+    return accepted;
+}
+
+bool isCompressible(std::string_view contentType) {
+    contentType = contentType.substr(0, contentType.find(';'));
+    return contentType.starts_with("text/") ||
+        contentType.ends_with("+xml") ||
+        contentType.ends_with("+json") ||
+        contentType == "application/javascript" ||
+        contentType == "application/json" ||
+        contentType == "application/xml" ||
+        contentType == "application/wasm";
+}
+
+const char* encodingName(ContentEncoding encoding) {
+    switch (encoding) {
+    case ContentEncoding::Gzip: return "gzip";
+    case ContentEncoding::Brotli: return "br";
+    default: return "identity";
+    }
+}
+
+const char* encodingSuffix(ContentEncoding encoding) {
+    switch (encoding) {
+    case ContentEncoding::Gzip: return ".gz";
+    case ContentEncoding::Brotli: return ".br";
+    default: return "";
+    }
+}
+
+bool canCompress(ContentEncoding encoding) {
+#ifdef THERMAL_HAVE_BROTLI
+    return encoding != ContentEncoding::Identity;
+#else
+    return encoding == ContentEncoding::Gzip;
+#endif
+}
+
+bool compress(ContentEncoding encoding, std::string_view input, CompressionLevel level, std::string& output) {
+    switch (encoding) {
+    case ContentEncoding::Gzip:
+        return gzipCompress(input, level, output);
+#ifdef THERMAL_HAVE_BROTLI
+    case ContentEncoding::Brotli:
+        return brotliCompress(input, level, output);
+#endif
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+// Content codings the server can send. The values double as file cache
+// variant slots, so every coding of a file is cached next to its identity.
+enum class ContentEncoding {
+    Identity = 0,
+    Gzip = 1,
+    Brotli = 2
+};
+
+// Acceptable codings from an Accept-Encoding header, best first
+struct AcceptedEncodings {
+    ContentEncoding encodings[2];
+    size_t count = 0;
+};
+
+AcceptedEncodings negotiateEncodings(std::string_view acceptEncoding);
+
+// Text-like types worth compressing; images and video are already compressed
+bool isCompressible(std::string_view contentType);
+
+// Header value ("gzip", "br") and precompressed sibling suffix (".gz", ".br")
+const char* encodingName(ContentEncoding encoding);
+const char* encodingSuffix(ContentEncoding encoding);
+
+// Whether this build can produce the coding itself (brotli is optional)
+bool canCompress(ContentEncoding encoding);
+
+enum class CompressionLevel {
+    Fast, // on the request path, the first time a variant is needed
+    Best  // ahead of time: startup precompression and watcher recompression
+};
+
+bool compress(ContentEncoding encoding, std::string_view input, CompressionLevel level, std::string& output);
@@ -0,0 +1,58 @@
+#include "connection_limiter.h"
+
+ConnectionLimiter::ConnectionLimiter(unsigned maxConnections, unsigned maxPerAddress)
+    : maxConnections(maxConnections), maxPerAddress(maxPerAddress) {}
+
+ConnectionLimiter::Shard& ConnectionLimiter::shardOf(uint32_t address) {
+    // Addresses of one subnet differ in their last octet, which network
+    // byte order puts in the top byte
+    return shards[(address ^ (address >> 24)) % SHARDS];
+}
+
+bool ConnectionLimiter::tryAcquire(uint32_t address) {
+    if (!enabled()) {
+        return true;
+    }
+
+    // Claim a global slot first, and give it back if the address is over its cap
+    if (maxConnections > 0) {
+        unsigned current = open.load(std::memory_order_relaxed);
+        do {
+            if (current >= maxConnections) {
+                rejectedCount.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        } while (!open.compare_exchange_weak(current, current + 1, std::memory_order_relaxed));
+    } else {
+        open.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (maxPerAddress > 0) {
+        Shard& shard = shardOf(address);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        unsigned& count = shard.counts[address];
+        if (count >= maxPerAddress) {
+            open.fetch_sub(1, std::memory_order_relaxed);
+            rejectedCount.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        ++count;
+    }
+    return true;
+}
+
+void ConnectionLimiter::release(uint32_t address) {
+    if (!enabled()) {
+        return;
+    }
+    open.fetch_sub(1, std::memory_order_relaxed);
+
+    if (maxPerAddress > 0) {
+        Shard& shard = shardOf(address);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.counts.find(address);
+        if (it != shard.counts.end() && --it->second == 0) {
+            shard.counts.erase(it); // only addresses with connections open take memory
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+// Caps on open connections, over all clients and per client IPv4 address,
+// so a single client opening sockets without end cannot take every
+// descriptor, thread or loop slot. Counts per address are split over
+// shards by address, so loops accepting at once rarely share a lock.
+class ConnectionLimiter {
+public:
+    // 0 leaves a cap off; with both off nothing is counted
+    ConnectionLimiter(unsigned maxConnections, unsigned maxPerAddress);
+
+    ConnectionLimiter(const ConnectionLimiter&) = delete;
+    ConnectionLimiter& operator=(const ConnectionLimiter&) = delete;
+
+    bool enabled() const { return maxConnections > 0 || maxPerAddress > 0; }
+    // Counts a connection from address (network byte order) in, or returns
+    // false and counts nothing if either cap is reached
+    bool tryAcquire(uint32_t address);
+    // For every connection tryAcquire() let in, once it closes
+    void release(uint32_t address);
+    uint64_t rejected() const { return rejectedCount.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr size_t SHARDS = 16;
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::unordered_map<uint32_t, unsigned> counts; // addresses with connections open
+    };
+
+    unsigned maxConnections;
+    unsigned maxPerAddress;
+    std::atomic<unsigned> open{0};
+    std::atomic<uint64_t> rejectedCount{0};
+    std::array<Shard, SHARDS> shards;
+
+    Shard& shardOf(uint32_t address);
+};
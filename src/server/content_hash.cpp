@@ -0,0 +1,138 @@
+#include "content_hash.h"
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+constexpr uint64_t PRIME0 = 0xa0761d6478bd642full;
+constexpr uint64_t PRIME1 = 0xe7037ed1a0b428dbull;
+constexpr uint64_t PRIME2 = 0x8ebc6af09c88c6e3ull;
+constexpr uint64_t PRIME3 = 0x589965cc75374cc3ull;
+constexpr uint64_t PRIME4 = 0x1d8e4e27c47d124full;
+
+// Folds the full 128-bit product, so no input bit is lost to the truncation
+inline uint64_t mix(uint64_t a, uint64_t b) {
+    const __uint128_t product = static_cast<__uint128_t>(a) * b;
+    return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+}
+
+inline uint64_t read64(const unsigned char* p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint64_t read32(const unsigned char* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// Up to one block
+uint64_t hashBlock(const unsigned char* p, size_t length, uint64_t seed) {
+    seed ^= mix(seed ^ PRIME0, PRIME1);
+    uint64_t a;
+    uint64_t b;
+    if (length <= 16) {
+        if (length >= 4) {
+            // Two overlapping reads cover 4 to 16 bytes
+            const size_t shift = (length >> 3) << 2;
+            a = (read32(p) << 32) | read32(p + shift);
+            b = (read32(p + length - 4) << 32) | read32(p + length - 4 - shift);
+        } else if (length > 0) {
+            a = (static_cast<uint64_t>(p[0]) << 16) | (static_cast<uint64_t>(p[length >> 1]) << 8) | p[length - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t remaining = length;
+        if (remaining > 64) {
+            // Four lanes with no dependency between them keep the multipliers busy
+            uint64_t lane1 = seed;
+            uint64_t lane2 = seed;
+            uint64_t lane3 = seed;
+            do {
+                seed = mix(read64(p) ^ PRIME1, read64(p + 8) ^ seed);
+                lane1 = mix(read64(p + 16) ^ PRIME2, read64(p + 24) ^ lane1);
+                lane2 = mix(read64(p + 32) ^ PRIME3, read64(p + 40) ^ lane2);
+                lane3 = mix(read64(p + 48) ^ PRIME4, read64(p + 56) ^ lane3);
+                p += 64;
+                remaining -= 64;
+            } while (remaining > 64);
+            seed ^= lane1 ^ lane2 ^ lane3;
+        }
+        while (remaining > 16) {
+            seed = mix(read64(p) ^ PRIME1, read64(p + 8) ^ seed);
+            p += 16;
+            remaining -= 16;
+        }
+        // The last 16 bytes, overlapping what came before
+        a = read64(p + remaining - 16);
+        b = read64(p + remaining - 8);
+    }
+    a ^= PRIME1;
+    b ^= seed;
+    const __uint128_t product = static_cast<__uint128_t>(a) * b;
+    return mix(static_cast<uint64_t>(product) ^ PRIME0 ^ length, static_cast<uint64_t>(product >> 64) ^ PRIME1);
+}
+
+// Chains block hashes; every block is seeded with everything before it
+struct BlockChain {
+    uint64_t state = PRIME4;
+    uint64_t length = 0;
+
+    void add(const unsigned char* p, size_t size) {
+        state = hashBlock(p, size, state);
+        length += size;
+    }
+
+    uint64_t finish() const { return mix(state ^ length, PRIME2); }
+};
+
+}
+
+uint64_t hashBytes(std::string_view bytes) {
+    BlockChain chain;
+    const auto* p = reinterpret_cast<const unsigned char*>(bytes.data());
+    size_t remaining = bytes.size();
+    do {
+        const size_t size = remaining < BLOCK_SIZE ? remaining : BLOCK_SIZE;
+        chain.add(p, size);
+        p += size;
+        remaining -= size;
+    } while (remaining > 0);
+    return chain.finish();
+}
+
+bool hashFile(int fd, uint64_t& hash) {
+    BlockChain chain;
+    auto buffer = std::make_unique<unsigned char[]>(BLOCK_SIZE);
+    off_t offset = 0;
+    bool empty = true;
+    while (true) {
+        // Fill whole blocks, so the chain matches hashBytes() on the same bytes
+        size_t filled = 0;
+        while (filled < BLOCK_SIZE) {
+            ssize_t result = pread(fd, buffer.get() + filled, BLOCK_SIZE - filled, offset);
+            if (result < 0 && errno == EINTR) continue;
+            if (result < 0) return false;
+            if (result == 0) break;
+            filled += result;
+            offset += result;
+        }
+        if (filled > 0 || empty) {
+            chain.add(buffer.get(), filled);
+            empty = false;
+        }
+        if (filled < BLOCK_SIZE) {
+            break;
+        }
+    }
+    hash = chain.finish();
+    return true;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// 64-bit hash of a file's bytes, for telling a rewrite with the same bytes
+// from a real change and as a strong validator. Stripes of 64 bytes go
+// through four independent 64x64->128 bit multiply lanes, wyhash style, so
+// it runs at memory speed without intrinsics. Input is folded in 64 KB
+// blocks, which lets a file be hashed as it is read; hashBytes() and
+// hashFile() agree on the same bytes. Not cryptographic.
+uint64_t hashBytes(std::string_view bytes);
+
+// Hashes what fd holds from offset 0; false on a read error
+bool hashFile(int fd, uint64_t& hash);
@@ -0,0 +1,110 @@
+#include "cpu_topology.h"
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sched.h>
+
+namespace fs = std::filesystem;
+
+std::vector<int> parseCpuList(std::string_view list) {
+    std::vector<int> cpus;
+    while (!list.empty()) {
+        const size_t comma = list.find(',');
+        std::string_view range = list.substr(0, comma);
+        list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+
+        int first = 0;
+        int last = 0;
+        const char* end = range.data() + range.size();
+        auto [firstEnd, firstError] = std::from_chars(range.data(), end, first);
+        if (firstError != std::errc()) {
+            continue; // trailing newline or junk
+        }
+        last = first;
+        if (firstEnd != end && *firstEnd == '-' &&
+            std::from_chars(firstEnd + 1, end, last).ec != std::errc()) {
+            continue;
+        }
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+std::vector<CpuPlacement> workerPlacements(bool numaAware) {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+        std::cerr << "sched_getaffinity failed: " << strerror(errno) << std::endl;
+        return {};
+    }
+
+    // Node of every CPU from sysfs; kernels without NUMA have no node directories
+    std::map<int, std::vector<int>> nodes;
+    std::error_code error;
+    for (fs::directory_iterator it("/sys/devices/system/node", error), end; !error && it != end; it.increment(error)) {
+        const std::string name = it->path().filename().string();
+        int node = 0;
+        if (!name.starts_with("node") ||
+            std::from_chars(name.data() + 4, name.data() + name.size(), node).ec != std::errc()) {
+            continue;
+        }
+        std::ifstream file(it->path() / "cpulist");
+        std::string list;
+        std::getline(file, list);
+        for (int cpu : parseCpuList(list)) {
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+                nodes[node].push_back(cpu);
+            }
+        }
+    }
+
+    std::vector<CpuPlacement> placements;
+    if (!numaAware || nodes.size() < 2) {
+        std::map<int, int> nodeOf;
+        for (const auto& [node, cpus] : nodes) {
+            for (int cpu : cpus) {
+                nodeOf[cpu] = node;
+            }
+        }
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                auto it = nodeOf.find(cpu);
+                placements.push_back({cpu, it != nodeOf.end() ? it->second : 0});
+            }
+        }
+        return placements;
+    }
+
+    // Round-robin over the nodes: n0 cpu, n1 cpu, n0 cpu, ...
+    for (size_t round = 0; placements.size() < static_cast<size_t>(CPU_COUNT(&allowed)); ++round) {
+        bool added = false;
+        for (const auto& [node, cpus] : nodes) {
+            if (round < cpus.size()) {
+                placements.push_back({cpus[round], node});
+                added = true;
+            }
+        }
+        if (!added) {
+            break; // allowed CPUs that no node lists
+        }
+    }
+    return placements;
+}
+
+bool pinCurrentThread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        std::cerr << "Pinning to CPU " << cpu << " failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+// Where one worker loop runs
+struct CpuPlacement {
+    int cpu;
+    int node; // NUMA node of cpu, 0 where the kernel reports none
+};
+
+// CPUs this process may run on (sched_getaffinity, so taskset and cgroup
+// limits are respected), in the order worker loops should take them. With
+// numaAware they alternate between nodes, so any worker count spreads evenly
+// over the memory controllers instead of filling node 0 first.
+std::vector<CpuPlacement> workerPlacements(bool numaAware);
+
+// Restricts the calling thread to a single CPU
+bool pinCurrentThread(int cpu);
+
+// Parses a sysfs CPU list such as "0-3,8,10-11"
+std::vector<int> parseCpuList(std::string_view list);
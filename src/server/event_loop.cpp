@@ -0,0 +1,384 @@
+#include "event_loop.h"
+#include "metrics.h"
+#include "server.h"
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int MAX_EVENTS = 256;
+constexpr size_t MAX_PIPELINED_RESPONSES = 16;
+
+bool wouldBlock() {
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+}
+
+ResumeQueue::ResumeQueue() : eventFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+    if (eventFd < 0) {
+        std::cerr << "Error creating eventfd: " << strerror(errno) << std::endl;
+    }
+}
+
+ResumeQueue::~ResumeQueue() {
+    if (eventFd >= 0) {
+        close(eventFd);
+    }
+}
+
+void ResumeQueue::push(int clientSocket, uint64_t connectionId) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.emplace_back(clientSocket, connectionId);
+    }
+    const uint64_t one = 1;
+    [[maybe_unused]] ssize_t result = write(eventFd, &one, sizeof(one));
+}
+
+std::vector<std::pair<int, uint64_t>> ResumeQueue::take() {
+    uint64_t count;
+    [[maybe_unused]] ssize_t result = read(eventFd, &count, sizeof(count));
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::exchange(entries, {});
+}
+
+EventLoop::EventLoop(Server& server, int listenSocket, WorkerStats& stats)
+    : server(server), listenSocket(listenSocket), epollFd(epoll_create1(EPOLL_CLOEXEC)), stats(stats),
+      timeouts(server.phaseTimeouts()) {
+    if (epollFd < 0) {
+        std::cerr << "Error creating epoll instance: " << strerror(errno) << std::endl;
+        return;
+    }
+
+    // EPOLLEXCLUSIVE wakes a single loop per incoming connection instead of
+    // every worker sharing the listening socket; a SO_REUSEPORT listener has
+    // just this one
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLEXCLUSIVE;
+    event.data.fd = listenSocket;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, listenSocket, &event) < 0) {
+        std::cerr << "Error registering listening socket: " << strerror(errno) << std::endl;
+        close(epollFd);
+        epollFd = -1;
+        return;
+    }
+
+    event.events = EPOLLIN;
+    event.data.fd = resumeQueue.fd();
+    if (resumeQueue.fd() < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, resumeQueue.fd(), &event) < 0) {
+        std::cerr << "Error registering resume queue: " << strerror(errno) << std::endl;
+        close(epollFd);
+        epollFd = -1;
+    }
+}
+
+EventLoop::~EventLoop() {
+    for (auto& [clientSocket, connection] : connections) {
+        close(clientSocket);
+    }
+    if (epollFd >= 0) {
+        close(epollFd);
+    }
+}
+
+void EventLoop::run() {
+    epoll_event events[MAX_EVENTS];
+
+    while (true) {
+        int count = epoll_wait(epollFd, events, MAX_EVENTS, timers.timeoutMs(Clock::now()));
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "epoll_wait failed: " << strerror(errno) << std::endl;
+            return;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            const int fd = events[i].data.fd;
+            if (fd == listenSocket) {
+                acceptConnections();
+                continue;
+            }
+            if (fd == resumeQueue.fd()) {
+                resumeParked();
+                continue;
+            }
+
+            auto it = connections.find(fd);
+            if (it == connections.end()) {
+                continue; // closed earlier in this batch
+            }
+            Connection& connection = it->second;
+
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                closeConnection(fd);
+                continue;
+            }
+            if ((events[i].events & EPOLLIN) && !readInput(fd, connection)) {
+                continue;
+            }
+            if (serviceConnection(fd, connection)) {
+                armTimer(fd, connection);
+            }
+        }
+
+        expireTimers();
+    }
+}
+
+void EventLoop::acceptConnections() {
+    while (true) {
+        const uint64_t startedAt = metrics::now();
+        sockaddr_in peer{};
+        socklen_t peerLength = sizeof(peer);
+        int clientSocket = accept4(listenSocket, reinterpret_cast<sockaddr*>(&peer), &peerLength,
+                                   SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clientSocket < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (!wouldBlock()) {
+                std::cerr << "Accept failed: " << strerror(errno) << std::endl;
+            }
+            return;
+        }
+        if (!server.admitConnection(clientSocket, peer.sin_addr.s_addr)) {
+            close(clientSocket);
+            continue;
+        }
+
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.fd = clientSocket;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, clientSocket, &event) < 0) {
+            std::cerr << "Error registering client socket: " << strerror(errno) << std::endl;
+            close(clientSocket);
+            server.releaseConnection(peer.sin_addr.s_addr);
+            continue;
+        }
+        Connection& connection = connections.try_emplace(clientSocket, &responseQueues).first->second;
+        connection.id = ++nextConnectionId;
+        connection.address = peer.sin_addr.s_addr;
+        connection.times.requestStarted = connection.times.lastWrite = Clock::now();
+        armTimer(clientSocket, connection);
+        stats.add(stats.accepted);
+        metrics::countConnectionOpened();
+        metrics::record(metrics::Stage::Accept, startedAt);
+    }
+}
+
+bool EventLoop::readInput(int clientSocket, Connection& connection) {
+    char buffer[16384];
+    connection.readPaused = false;
+
+    // Edge-triggered: drain the socket until the kernel reports EAGAIN, unless
+    // the client has pipelined more than we are willing to buffer
+    while (true) {
+        if (connection.input.size() >= HttpParser::MAX_REQUEST_SIZE) {
+            connection.readPaused = true;
+            return true;
+        }
+
+        ssize_t bytesReceived = recv(clientSocket, buffer, sizeof(buffer), 0);
+        if (bytesReceived > 0) {
+            // Bytes trickling into a request do not move its deadline; only
+            // the first one after an idle spell starts the header clock
+            if (connection.input.empty() && connection.requestsServed > 0) {
+                connection.times.requestStarted = Clock::now();
+            }
+            connection.input.append(buffer, bytesReceived);
+            continue;
+        }
+        if (bytesReceived == 0) {
+            connection.peerClosed = true;
+            return true;
+        }
+        if (errno == EINTR) continue;
+        if (wouldBlock()) return true;
+
+        closeConnection(clientSocket);
+        return false;
+    }
+}
+
+bool EventLoop::serviceConnection(int clientSocket, Connection& connection) {
+    while (true) {
+        // Answer every complete request already buffered, in order
+        RequestArena::Scope arenaScope(connection.arena);
+        while (!connection.closing && !connection.parked && connection.pending.size() < MAX_PIPELINED_RESPONSES) {
+            Response response;
+            size_t consumed = server.handleRequest(connection.input, connection.parser,
+                                                   connection.requestsServed, response, !connection.resumed);
+            if (consumed == 0) {
+                break;
+            }
+            // The request stays buffered while the pool works for it, and is
+            // parsed again when the connection is resumed
+            if (response.blockingWork &&
+                server.offload(response, [this, clientSocket, id = connection.id]() {
+                    resumeQueue.push(clientSocket, id);
+                })) {
+                connection.parked = true;
+                break;
+            }
+            connection.resumed = false;
+            connection.input.erase(0, consumed);
+            ++connection.requestsServed;
+            stats.add(stats.requests);
+            connection.closing = !response.keepAlive && !response.sse;
+            const Clock::time_point now = Clock::now();
+            connection.times.requestStarted = now; // of whatever follows in the buffer
+            connection.times.bodyStarted = {};
+            if (connection.pending.empty()) {
+                connection.times.lastWrite = now; // the send clock starts with the first response
+            }
+            connection.pending.push_back(std::move(response));
+            if (connection.pending.back().sse) {
+                break; // the socket leaves the loop once it gets there
+            }
+        }
+        if (connection.parser.headComplete() && connection.times.bodyStarted == Clock::time_point()) {
+            connection.times.bodyStarted = Clock::now();
+        }
+        const bool backlogged = !connection.closing && connection.pending.size() >= MAX_PIPELINED_RESPONSES;
+
+        if (connection.pending.empty() && !connection.closing && !connection.parked && connection.peerClosed) {
+            connection.closing = true; // no complete request will ever arrive
+        }
+
+        // Write responses until the socket fills up
+        while (!connection.pending.empty()) {
+            Response& response = connection.pending.front();
+            if (response.sse) {
+                detachForSSE(clientSocket, response.lastEventId);
+                return false;
+            }
+
+            const uint64_t sentBefore = response.bytesSent;
+            WriteStatus status = writeResponse(clientSocket, response);
+            if (response.bytesSent != sentBefore) {
+                connection.times.lastWrite = Clock::now();
+            }
+            if (status == WriteStatus::WouldBlock) {
+                return true; // EPOLLOUT fires again once the socket drains
+            }
+            if (status == WriteStatus::Error) {
+                closeConnection(clientSocket);
+                return false;
+            }
+            connection.pending.pop_front();
+        }
+        // Every response is out, so nothing built in the arena is alive
+        connection.arena.reset();
+
+        if (connection.closing) {
+            closeConnection(clientSocket);
+            return false;
+        }
+        if (connection.parked) {
+            return true; // resumeParked() carries on
+        }
+        if (connection.peerClosed && !backlogged) {
+            // Every complete request is answered and no more can arrive;
+            // edge-triggered epoll will not report the end of stream again
+            closeConnection(clientSocket);
+            return false;
+        }
+
+        // Everything is flushed; pick up requests that were held back
+        if (connection.readPaused) {
+            if (!readInput(clientSocket, connection)) {
+                return false;
+            }
+        } else if (!backlogged) {
+            return true;
+        }
+    }
+}
+
+void EventLoop::resumeParked() {
+    for (auto [clientSocket, id] : resumeQueue.take()) {
+        auto it = connections.find(clientSocket);
+        if (it == connections.end() || it->second.id != id || !it->second.parked) {
+            continue; // closed while the pool was busy
+        }
+        it->second.parked = false;
+        it->second.resumed = true;
+        if (serviceConnection(clientSocket, it->second)) {
+            armTimer(clientSocket, it->second);
+        }
+    }
+}
+
+Deadline EventLoop::deadlineOf(const Connection& connection) const {
+    return connection.times.deadline(timeouts, !connection.pending.empty(),
+                                     connection.input.empty() && connection.requestsServed > 0,
+                                     connection.parser.headComplete());
+}
+
+void EventLoop::armTimer(int clientSocket, Connection& connection) {
+    if (connection.parked) {
+        return; // waits on the pool, not the client
+    }
+    const Deadline deadline = deadlineOf(connection);
+    if (deadline.at == Clock::time_point::max()) {
+        return;
+    }
+    // An entry already firing sooner is enough: it re-arms for the rest
+    const uint64_t tick = timers.tickAt(deadline.at);
+    if (connection.times.timerTick == 0 || tick < connection.times.timerTick) {
+        connection.times.timerTick = timers.schedule(tick, clientSocket, connection.id);
+    }
+}
+
+void EventLoop::expireTimers() {
+    const Clock::time_point now = Clock::now();
+    expiredTimers.clear();
+    timers.advance(now, expiredTimers);
+    for (const TimerWheel::Timer& timer : expiredTimers) {
+        auto it = connections.find(timer.socket);
+        if (it == connections.end() || it->second.id != timer.connectionId ||
+            it->second.times.timerTick != timer.tick) {
+            continue; // closed, or superseded by an entry firing sooner
+        }
+        Connection& connection = it->second;
+        connection.times.timerTick = 0;
+        if (connection.parked) {
+            continue; // armed again once resumed
+        }
+
+        const Deadline deadline = deadlineOf(connection);
+        if (deadline.at <= now) {
+            metrics::countTimeout(deadline.phase);
+            closeConnection(timer.socket);
+        } else {
+            armTimer(timer.socket, connection); // the deadline moved on since this was scheduled
+        }
+    }
+}
+
+void EventLoop::detachForSSE(int clientSocket, uint64_t lastEventId) {
+    // SSE subscribers move to the hub's own epoll loop, which broadcasts to
+    // every stream without holding up this one
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, clientSocket, nullptr);
+    auto it = connections.find(clientSocket);
+    const uint32_t address = it->second.address;
+    connections.erase(it);
+    stats.add(stats.closed);
+    metrics::countConnectionClosed();
+    server.handleSSE(clientSocket, lastEventId, address);
+}
+
+void EventLoop::closeConnection(int clientSocket) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, clientSocket, nullptr);
+    auto it = connections.find(clientSocket);
+    server.releaseConnection(it->second.address);
+    connections.erase(it);
+    close(clientSocket);
+    stats.add(stats.closed);
+    metrics::countConnectionClosed();
+}
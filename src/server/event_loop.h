@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "http_parser.h"
+#include "request_arena.h"
+#include "response.h"
+#include "timer_wheel.h"
+
+class Server;
+
+// Counters of one worker loop. Only the owning loop writes them, and each
+// sits on its own cache line, so counting never bounces lines between cores.
+struct alignas(64) WorkerStats {
+    std::atomic<uint64_t> accepted{0};
+    std::atomic<uint64_t> closed{0};
+    std::atomic<uint64_t> requests{0};
+    int cpu = -1; // pinned CPU, -1 if the loop floats
+
+    void add(std::atomic<uint64_t>& counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+};
+
+// Connections a worker loop parked while the pool did their blocking work,
+// handed back from pool threads. The eventfd wakes the loop; every entry
+// names the socket and the connection id, so a socket that was closed and
+// reused in the meantime is not mistaken for the parked one.
+class ResumeQueue {
+public:
+    ResumeQueue();
+    ~ResumeQueue();
+
+    ResumeQueue(const ResumeQueue&) = delete;
+    ResumeQueue& operator=(const ResumeQueue&) = delete;
+
+    int fd() const { return eventFd; }
+    void push(int clientSocket, uint64_t connectionId);
+    std::vector<std::pair<int, uint64_t>> take();
+
+private:
+    int eventFd;
+    std::mutex mutex;
+    std::vector<std::pair<int, uint64_t>> entries;
+};
+
+// One edge-triggered epoll reactor. Every worker loop registers the shared
+// non-blocking listening socket and accepts, reads and writes its own
+// connections without ever blocking on a single client. A timer wheel holds
+// the deadline of each connection's current phase, and epoll_wait sleeps
+// until the next one.
+class EventLoop {
+public:
+    EventLoop(Server& server, int listenSocket, WorkerStats& stats);
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    bool valid() const { return epollFd >= 0; }
+    void run();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Connection {
+        uint64_t id = 0;
+        RequestArena arena;           // what pending responses are built in; outlives them
+        std::string input;
+        HttpParser parser;
+        std::pmr::deque<Response> pending; // pipelined responses, answered in order
+        unsigned requestsServed = 0;
+        bool closing = false;         // close once pending responses are written
+        bool peerClosed = false;
+        bool readPaused = false;      // input buffer full, socket not drained
+        bool parked = false;          // the pool is doing blocking work for the next request
+        bool resumed = false;         // that work is done, answer the request inline
+        uint32_t address = 0;         // client IPv4 address, counted by the connection caps
+        ConnectionTimes times;
+
+        explicit Connection(std::pmr::memory_resource* responses) : pending(responses) {}
+    };
+
+    Server& server;
+    int listenSocket;
+    int epollFd;
+    WorkerStats& stats;
+    std::pmr::unsynchronized_pool_resource responseQueues; // pending queues recycle their nodes here
+    std::unordered_map<int, Connection> connections;
+    uint64_t nextConnectionId = 0;
+    ResumeQueue resumeQueue;
+    PhaseTimeouts timeouts;
+    TimerWheel timers;
+    std::vector<TimerWheel::Timer> expiredTimers; // reused by every expireTimers()
+
+    void acceptConnections();
+    bool readInput(int clientSocket, Connection& connection);
+    // False once the connection is closed or handed off
+    bool serviceConnection(int clientSocket, Connection& connection);
+    void resumeParked();
+    Deadline deadlineOf(const Connection& connection) const;
+    // Makes sure the wheel fires no later than the connection's current deadline
+    void armTimer(int clientSocket, Connection& connection);
+    void expireTimers();
+    void detachForSSE(int clientSocket, uint64_t lastEventId);
+    void closeConnection(int clientSocket);
+};
@@ -0,0 +1,135 @@
+#include "file_cache.h"
+#include <algorithm>
+#include <functional>
+
+namespace {
+
+// Rough per-entry bookkeeping cost: list node, index node, control block
+constexpr size_t ENTRY_OVERHEAD = 128;
+
+}
+
+FileCache::FileCache(size_t capacityBytes, size_t maxEntryBytes, size_t shardCount)
+    : shardCapacity(capacityBytes / std::max<size_t>(shardCount, 1)),
+      maxEntryBytes(std::min(maxEntryBytes, capacityBytes / std::max<size_t>(shardCount, 1))) {
+    shardCount = std::max<size_t>(shardCount, 1);
+    shards.reserve(shardCount);
+    for (size_t i = 0; i < shardCount; ++i) {
+        shards.push_back(std::make_unique<Shard>());
+    }
+}
+
+std::shared_ptr<const CachedFile> FileCache::find(std::string_view key, uint64_t* generation, size_t variant) {
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    if (generation != nullptr) {
+        *generation = shard.generation;
+    }
+
+    auto it = shard.index.find(key);
+    if (it == shard.index.end() || !it->second->variants[variant]) {
+        shard.misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    // Move to the front of the LRU list without reallocating the node
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    shard.hits.fetch_add(1, std::memory_order_relaxed);
+    return it->second->variants[variant];
+}
+
+std::shared_ptr<const CachedFile> FileCache::peek(std::string_view key, size_t variant) const {
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    return it == shard.index.end() ? nullptr : it->second->variants[variant];
+}
+
+void FileCache::insert(const std::string& key, std::shared_ptr<const CachedFile> file, uint64_t generation,
+                       size_t variant) {
+    const size_t size = file->content.size();
+    if (size > maxEntryBytes || size + key.size() + ENTRY_OVERHEAD > shardCapacity) {
+        return;
+    }
+
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.generation != generation) {
+        return; // invalidated while the caller was reading the file
+    }
+
+    auto existing = shard.index.find(key);
+    if (existing == shard.index.end()) {
+        shard.lru.push_front(Entry{key, {}, key.size() + ENTRY_OVERHEAD});
+        existing = shard.index.emplace(shard.lru.front().key, shard.lru.begin()).first;
+        shard.bytes += shard.lru.front().charge;
+    } else {
+        shard.lru.splice(shard.lru.begin(), shard.lru, existing->second);
+    }
+
+    Entry& entry = shard.lru.front();
+    auto& slot = entry.variants[variant];
+    const size_t previous = slot ? slot->content.size() : 0;
+    if (entry.charge - previous + size > shardCapacity) {
+        return; // the file's other variants already use the whole shard
+    }
+    entry.charge = entry.charge - previous + size;
+    shard.bytes = shard.bytes - previous + size;
+    slot = std::move(file);
+
+    // Evict from the cold end until the shard is back within its budget;
+    // the entry just written sits at the front and is never the victim
+    while (shard.bytes > shardCapacity && shard.lru.size() > 1) {
+        erase(shard, std::prev(shard.lru.end()));
+        shard.evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void FileCache::invalidate(std::string_view key) {
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    ++shard.generation;
+
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        erase(shard, it->second);
+        shard.invalidations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void FileCache::clear() {
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        ++shard->generation;
+        shard->invalidations.fetch_add(shard->lru.size(), std::memory_order_relaxed);
+        shard->index.clear();
+        shard->lru.clear();
+        shard->bytes = 0;
+    }
+}
+
+FileCache::Stats FileCache::stats() const {
+    Stats total;
+    for (const auto& shard : shards) {
+        total.hits += shard->hits.load(std::memory_order_relaxed);
+        total.misses += shard->misses.load(std::memory_order_relaxed);
+        total.evictions += shard->evictions.load(std::memory_order_relaxed);
+        total.invalidations += shard->invalidations.load(std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        total.entries += shard->lru.size();
+        total.bytes += shard->bytes;
+    }
+    return total;
+}
+
+FileCache::Shard& FileCache::shardFor(std::string_view key) const {
+    return *shards[std::hash<std::string_view>{}(key) % shards.size()];
+}
+
+void FileCache::erase(Shard& shard, std::list<Entry>::iterator it) {
+    shard.bytes -= it->charge;
+    shard.index.erase(it->key);
+    shard.lru.erase(it);
+}
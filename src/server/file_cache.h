@@ -0,0 +1,94 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+#include <time.h>
+
+#include "mime_types.h"
+
+// An immutable snapshot of a file's bytes. Entries are handed out as
+// shared_ptr<const CachedFile>, so an eviction or invalidation never pulls
+// the buffer out from under a connection that is still sending it.
+struct CachedFile {
+    std::string content;
+    const MimeType* mimeType = nullptr;
+    off_t size = 0;
+    timespec modified{};
+    ino_t inode = 0;
+    uint64_t contentHash = 0; // of the identity bytes; the strong validator of every variant
+    std::string etag;       // strong validator, quoted
+    std::string validators; // prebuilt ETag, Last-Modified and Cache-Control lines
+    std::string head;       // prebuilt 200 head, up to the Connection header
+    size_t scriptOffset = 0; // hot reload pages: where the script goes into content
+};
+
+// Byte-budgeted file cache. Keys are spread over independently locked shards,
+// each an O(1) LRU list, so concurrent lookups rarely contend on one mutex.
+// A key holds up to MAX_VARIANTS representations of the same file (identity,
+// compressed codings); they share one LRU slot and are invalidated together.
+class FileCache {
+public:
+    static constexpr size_t MAX_VARIANTS = 4;
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t invalidations = 0;
+        size_t entries = 0;
+        size_t bytes = 0;
+    };
+
+    FileCache(size_t capacityBytes, size_t maxEntryBytes, size_t shardCount = 16);
+
+    // *generation receives a token for a later insert() under the same key
+    std::shared_ptr<const CachedFile> find(std::string_view key, uint64_t* generation = nullptr,
+                                           size_t variant = 0);
+    // Like find(), but neither counted nor moved up the LRU list
+    std::shared_ptr<const CachedFile> peek(std::string_view key, size_t variant = 0) const;
+    // Ignored if the key was invalidated since the find() that produced generation,
+    // so a read racing with a file change never caches the old bytes
+    void insert(const std::string& key, std::shared_ptr<const CachedFile> file, uint64_t generation,
+                size_t variant = 0);
+    void invalidate(std::string_view key);
+    void clear();
+
+    bool enabled() const { return shardCapacity > 0; }
+    size_t maxEntrySize() const { return maxEntryBytes; }
+    Stats stats() const;
+
+private:
+    struct Entry {
+        std::string key;
+        std::array<std::shared_ptr<const CachedFile>, MAX_VARIANTS> variants;
+        size_t charge; // bytes counted against the budget, all variants included
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<Entry> lru; // most recently used first
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index; // keys view into lru
+        size_t bytes = 0;
+        uint64_t generation = 0; // bumped by every invalidation
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+        std::atomic<uint64_t> evictions{0};
+        std::atomic<uint64_t> invalidations{0};
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    size_t shardCapacity;
+    size_t maxEntryBytes;
+
+    Shard& shardFor(std::string_view key) const;
+    static void erase(Shard& shard, std::list<Entry>::iterator it);
+};
@@ -0,0 +1,283 @@
+#include "http_parser.h"
+#include <cstring>
+
+namespace {
+
+// RFC 9110 tchar: the characters allowed in methods and header names
+constexpr std::array<bool, 256> makeTokenTable() {
+    std::array<bool, 256> table{};
+    for (int c = '0'; c <= '9'; ++c) table[c] = true;
+    for (int c = 'a'; c <= 'z'; ++c) table[c] = true;
+    for (int c = 'A'; c <= 'Z'; ++c) table[c] = true;
+    for (char c : std::string_view("!#$%&'*+-.^_`|~")) table[static_cast<unsigned char>(c)] = true;
+    return table;
+}
+
+constexpr std::array<bool, 256> TOKEN_CHARS = makeTokenTable();
+
+bool isToken(std::string_view text) {
+    if (text.empty()) {
+        return false;
+    }
+    for (char c : text) {
+        if (!TOKEN_CHARS[static_cast<unsigned char>(c)]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+char toLower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (toLower(a[i]) != toLower(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string_view trimWhitespace(std::string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) text.remove_prefix(1);
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t')) text.remove_suffix(1);
+    return text;
+}
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+}
+
+std::string_view HttpRequest::header(std::string_view name) const {
+    for (size_t i = 0; i < headerCount; ++i) {
+        if (equalsIgnoreCase(headers[i].name, name)) {
+            return headers[i].value;
+        }
+    }
+    return {};
+}
+
+HttpParser::Status HttpParser::parse(std::span<char> input, HttpRequest& request) {
+    std::string_view text(input.data(), input.size());
+
+    if (headLength == 0 && !findHeadEnd(text)) {
+        return text.size() >= MAX_REQUEST_SIZE ? fail(431) : Status::Incomplete;
+    }
+    if (headLength > MAX_REQUEST_SIZE) {
+        return fail(431);
+    }
+
+    if (!parseHead(text.substr(startOffset, headLength - startOffset), request)) {
+        return Status::Error;
+    }
+    if (request.contentLength > MAX_REQUEST_SIZE - headLength) {
+        return fail(413);
+    }
+    totalLength = headLength + request.contentLength;
+    if (text.size() < totalLength) {
+        return Status::Incomplete;
+    }
+
+    // Decode only once the request is complete: a head re-parsed while its
+    // body is still arriving must never be decoded twice
+    char* path = input.data() + (request.path.data() - text.data());
+    size_t decodedLength = percentDecode(path, request.path.size());
+    if (decodedLength == std::string_view::npos) {
+        return fail(400);
+    }
+    request.path = std::string_view(path, decodedLength);
+    return Status::Complete;
+}
+
+void HttpParser::reset() {
+    startOffset = 0;
+    scanOffset = 0;
+    headLength = 0;
+    totalLength = 0;
+    error = 0;
+}
+
+bool HttpParser::findHeadEnd(std::string_view input) {
+    // Tolerate empty lines before the request line (RFC 9112 section 2.2),
+    // which some clients send after a request body
+    if (scanOffset == startOffset) {
+        while (startOffset < input.size() && (input[startOffset] == '\r' || input[startOffset] == '\n')) {
+            ++startOffset;
+        }
+        scanOffset = startOffset;
+    }
+
+    // The head ends at the first empty line, CRLF or bare LF
+    while (scanOffset < input.size()) {
+        const void* found = memchr(input.data() + scanOffset, '\n', input.size() - scanOffset);
+        if (found == nullptr) {
+            scanOffset = input.size();
+            return false;
+        }
+
+        size_t newline = static_cast<const char*>(found) - input.data();
+        size_t next = newline + 1;
+        if (next < input.size() && input[next] == '\r') {
+            ++next;
+        }
+        if (next >= input.size()) {
+            scanOffset = newline; // look at this line end again once more arrives
+            return false;
+        }
+        if (input[next] == '\n') {
+            headLength = next + 1;
+            return true;
+        }
+        scanOffset = newline + 1;
+    }
+    return false;
+}
+
+bool HttpParser::parseHead(std::string_view head, HttpRequest& request) {
+    request.headerCount = 0;
+    request.contentLength = 0;
+    bool sawContentLength = false;
+
+    size_t position = 0;
+    auto nextLine = [&head, &position]() {
+        size_t newline = head.find('\n', position);
+        size_t end = newline;
+        if (end > position && head[end - 1] == '\r') {
+            --end;
+        }
+        std::string_view line = head.substr(position, end - position);
+        position = newline + 1;
+        return line;
+    };
+
+    // Request line: method SP request-target SP HTTP-version
+    std::string_view line = nextLine();
+    size_t firstSpace = line.find(' ');
+    size_t secondSpace = line.find(' ', firstSpace + 1);
+    if (firstSpace == std::string_view::npos || secondSpace == std::string_view::npos) {
+        fail(400);
+        return false;
+    }
+    request.method = line.substr(0, firstSpace);
+    std::string_view target = line.substr(firstSpace + 1, secondSpace - firstSpace - 1);
+    request.version = line.substr(secondSpace + 1);
+
+    if (!isToken(request.method) || target.empty() ||
+        (request.version != "HTTP/1.1" && request.version != "HTTP/1.0")) {
+        fail(400);
+        return false;
+    }
+    for (char c : target) {
+        if (static_cast<unsigned char>(c) <= ' ' || c == 0x7f) {
+            fail(400);
+            return false;
+        }
+    }
+
+    // Absolute-form targets (proxies) carry the scheme and authority first
+    if (target.starts_with("http://") || target.starts_with("https://")) {
+        size_t authority = target.find("//") + 2;
+        size_t slash = target.find('/', authority);
+        target = slash == std::string_view::npos ? target.substr(target.size()) : target.substr(slash);
+    } else if (target.front() != '/' && target != "*") {
+        fail(400);
+        return false;
+    }
+
+    size_t question = target.find('?');
+    request.path = target.substr(0, question);
+    request.query = question == std::string_view::npos ? target.substr(target.size()) : target.substr(question + 1);
+
+    // Header fields until the empty line
+    while (position < head.size()) {
+        line = nextLine();
+        if (line.empty()) {
+            break;
+        }
+        if (line.front() == ' ' || line.front() == '\t') {
+            fail(400); // obsolete line folding
+            return false;
+        }
+
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos || !isToken(line.substr(0, colon))) {
+            fail(400);
+            return false;
+        }
+        if (request.headerCount == HttpRequest::MAX_HEADERS) {
+            fail(431);
+            return false;
+        }
+
+        HttpHeader& header = request.headers[request.headerCount++];
+        header.name = line.substr(0, colon);
+        header.value = trimWhitespace(line.substr(colon + 1));
+
+        if (equalsIgnoreCase(header.name, "Content-Length")) {
+            size_t length = 0;
+            if (header.value.empty()) {
+                fail(400);
+                return false;
+            }
+            for (char c : header.value) {
+                if (c < '0' || c > '9' || length > MAX_REQUEST_SIZE) {
+                    fail(c < '0' || c > '9' ? 400 : 413);
+                    return false;
+                }
+                length = length * 10 + (c - '0');
+            }
+            if (sawContentLength && length != request.contentLength) {
+                fail(400);
+                return false;
+            }
+            request.contentLength = length;
+            sawContentLength = true;
+        } else if (equalsIgnoreCase(header.name, "Transfer-Encoding")) {
+            fail(501); // chunked request bodies are not supported
+            return false;
+        }
+    }
+
+    return true;
+}
+
+HttpParser::Status HttpParser::fail(int status) {
+    error = status;
+    return Status::Error;
+}
+
+size_t percentDecode(char* data, size_t length) {
+    char* escape = static_cast<char*>(memchr(data, '%', length));
+    if (escape == nullptr) {
+        return length; // nothing to decode, the common case
+    }
+
+    size_t out = escape - data;
+    for (size_t in = out; in < length; ++in) {
+        char c = data[in];
+        if (c == '%') {
+            if (in + 2 >= length) {
+                return std::string_view::npos;
+            }
+            int high = hexValue(data[in + 1]);
+            int low = hexValue(data[in + 2]);
+            if (high < 0 || low < 0 || (high == 0 && low == 0)) {
+                return std::string_view::npos;
+            }
+            c = static_cast<char>(high * 16 + low);
+            in += 2;
+        }
+        data[out++] = c;
+    }
+    return out;
+}
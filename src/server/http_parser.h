@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <span>
+#include <string_view>
+
+struct HttpHeader {
+    std::string_view name;
+    std::string_view value;
+};
+
+// One parsed request. Every view points into the connection's input buffer
+// and stays valid until those bytes are consumed.
+struct HttpRequest {
+    static constexpr size_t MAX_HEADERS = 64;
+
+    std::string_view method;
+    std::string_view path;    // path of the request-target, percent-decoded in place
+    std::string_view query;   // raw query string, without the '?'
+    std::string_view version; // "HTTP/1.0" or "HTTP/1.1"
+    std::array<HttpHeader, MAX_HEADERS> headers;
+    size_t headerCount = 0;
+    size_t contentLength = 0;
+
+    // Case-insensitive header lookup, empty view if the header is absent
+    std::string_view header(std::string_view name) const;
+};
+
+// Resumable HTTP/1.x request parser working directly on a connection's input
+// buffer. Feed it the whole buffer after every read: it remembers how far it
+// already scanned, never allocates and never copies.
+class HttpParser {
+public:
+    // Largest request (head plus body) a connection may buffer
+    static constexpr size_t MAX_REQUEST_SIZE = 64 * 1024;
+
+    enum class Status { Complete, Incomplete, Error };
+
+    Status parse(std::span<char> input, HttpRequest& request);
+
+    // Whether the head of the request being parsed is in, and only its body missing
+    bool headComplete() const { return headLength > 0; }
+    // Bytes taken by the completed request, including leading blank lines
+    size_t requestLength() const { return totalLength; }
+    // HTTP status to answer with after Status::Error (400, 413, 431 or 501)
+    int errorStatus() const { return error; }
+    // Prepare for the next request once the caller consumed requestLength()
+    void reset();
+
+private:
+    size_t startOffset = 0; // blank lines tolerated before the request line
+    size_t scanOffset = 0;  // where the search for the end of the head resumes
+    size_t headLength = 0;  // offset just past the blank line, 0 until seen
+    size_t totalLength = 0;
+    int error = 0;
+
+    bool findHeadEnd(std::string_view input);
+    bool parseHead(std::string_view head, HttpRequest& request);
+    Status fail(int status);
+};
+
+// Decodes %XX escapes in place and returns the decoded length, or
+// std::string_view::npos for a malformed escape or an encoded NUL
+size_t percentDecode(char* data, size_t length);
@@ -0,0 +1,132 @@
+#include "inotify_watcher.h"
+#include <iostream>
+#include <filesystem>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr uint32_t WATCH_MASK =
+    IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+
+}
+
+InotifyWatcher::InotifyWatcher() : inotifyFd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) {
+    if (inotifyFd < 0) {
+        std::cerr << "inotify unavailable: " << strerror(errno) << std::endl;
+    }
+}
+
+InotifyWatcher::~InotifyWatcher() {
+    if (inotifyFd >= 0) {
+        close(inotifyFd);
+    }
+}
+
+bool InotifyWatcher::watchTree(const std::string& directory) {
+    if (!addWatch(directory)) {
+        return false;
+    }
+
+    std::error_code error;
+    fs::recursive_directory_iterator it(directory, fs::directory_options::skip_permission_denied, error);
+    for (; !error && it != fs::recursive_directory_iterator(); it.increment(error)) {
+        if (it->is_directory(error) && !it->is_symlink(error) && !addWatch(it->path().string())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool InotifyWatcher::addWatch(const std::string& directory) {
+    int wd = inotify_add_watch(inotifyFd, directory.c_str(), WATCH_MASK);
+    if (wd < 0) {
+        if (errno == ENOENT) {
+            return true; // removed again before we got to it
+        }
+        std::cerr << "Error watching " << directory << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    directories[wd] = directory;
+    return true;
+}
+
+void InotifyWatcher::unwatchTree(const std::string& directory) {
+    // A directory moved elsewhere keeps its watches, which would now report
+    // events under the old path
+    const std::string prefix = directory + "/";
+    for (auto it = directories.begin(); it != directories.end();) {
+        if (it->second == directory || it->second.starts_with(prefix)) {
+            inotify_rm_watch(inotifyFd, it->first);
+            it = directories.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool InotifyWatcher::waitForEvents(std::vector<Event>& events) {
+    events.clear();
+
+    pollfd pollFd{inotifyFd, POLLIN, 0};
+    while (poll(&pollFd, 1, -1) < 0) {
+        if (errno != EINTR) {
+            std::cerr << "Error waiting for inotify events: " << strerror(errno) << std::endl;
+            return false;
+        }
+    }
+
+    // Drain everything that is queued so a burst is handled as one batch
+    alignas(inotify_event) char buffer[64 * 1024];
+    while (true) {
+        ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+        if (length < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) break;
+            std::cerr << "Error reading inotify events: " << strerror(errno) << std::endl;
+            return false;
+        }
+
+        for (char* position = buffer; position < buffer + length;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(position);
+            position += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                events.push_back({Event::Kind::Overflow, {}});
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                directories.erase(event->wd); // directory deleted or unmounted
+                continue;
+            }
+
+            auto directory = directories.find(event->wd);
+            if (directory == directories.end() || event->len == 0) {
+                continue;
+            }
+            std::string path = directory->second + "/" + event->name;
+
+            if (event->mask & IN_ISDIR) {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    // Watch it before reporting, so nothing created inside
+                    // between now and the caller's scan goes unnoticed
+                    watchTree(path);
+                    events.push_back({Event::Kind::DirectoryAdded, std::move(path)});
+                } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    unwatchTree(path);
+                    events.push_back({Event::Kind::DirectoryRemoved, std::move(path)});
+                }
+            } else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                events.push_back({Event::Kind::Modified, std::move(path)});
+            } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                events.push_back({Event::Kind::Deleted, std::move(path)});
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Linux inotify backend for watch mode. Registers a watch on every directory
+// of a tree and translates kernel events into file-level changes, so the
+// watcher sleeps in the kernel instead of rescanning the tree on a timer.
+class InotifyWatcher {
+public:
+    struct Event {
+        enum class Kind {
+            Modified,         // file written and closed, or moved into the tree
+            Deleted,          // file removed or moved out of the tree
+            DirectoryAdded,   // already watched; its contents must be scanned
+            DirectoryRemoved, // every known file below it is gone
+            Overflow          // kernel queue overflowed, events were lost
+        };
+        Kind kind;
+        std::string path;
+    };
+
+    InotifyWatcher();
+    ~InotifyWatcher();
+
+    InotifyWatcher(const InotifyWatcher&) = delete;
+    InotifyWatcher& operator=(const InotifyWatcher&) = delete;
+
+    bool valid() const { return inotifyFd >= 0; }
+
+    // Watches directory and every directory below it. Fails when the kernel
+    // runs out of watches (fs.inotify.max_user_watches).
+    bool watchTree(const std::string& directory);
+
+    // Blocks until events arrive, then returns everything that is queued
+    bool waitForEvents(std::vector<Event>& events);
+
+private:
+    int inotifyFd;
+    std::unordered_map<int, std::string> directories; // watch descriptor -> path
+
+    bool addWatch(const std::string& directory);
+    void unwatchTree(const std::string& directory);
+};
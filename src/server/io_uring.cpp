@@ -0,0 +1,176 @@
+#include "io_uring.h"
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+
+int setup(unsigned entries, io_uring_params& params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+}
+
+int enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+int registerResource(int fd, unsigned opcode, const void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+template <typename T>
+T* at(void* base, uint32_t offset) {
+    return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+
+}
+
+IoUring::IoUring(unsigned entries) {
+    // Room for bursts of multishot accepts on top of one completion per entry.
+    // COOP_TASKRUN skips the interrupt when completions are only reaped on
+    // the next enter, which is all this ring ever does; older kernels get
+    // the plain setup.
+    const unsigned flagSets[] = {
+        IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN,
+        IORING_SETUP_CQSIZE,
+    };
+    io_uring_params params{};
+    for (unsigned flags : flagSets) {
+        params = io_uring_params{};
+        params.flags = flags;
+        params.cq_entries = entries * 4;
+        ringFd = setup(entries, params);
+        if (ringFd >= 0 || errno != EINVAL) {
+            break;
+        }
+    }
+    if (ringFd < 0) {
+        std::cerr << "io_uring unavailable: " << strerror(errno) << std::endl;
+        return;
+    }
+    enterFd = ringFd;
+
+    // Both rings share one mapping on every kernel that has the opcodes we use
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP)) {
+        std::cerr << "io_uring too old: missing single mmap or no-drop support" << std::endl;
+        close(ringFd);
+        ringFd = -1;
+        return;
+    }
+
+    sqRingSize = std::max<size_t>(params.sq_off.array + params.sq_entries * sizeof(uint32_t),
+                                  params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+                  IORING_OFF_SQ_RING);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE,
+                                           MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES));
+    if (sqRing == MAP_FAILED || sqes == MAP_FAILED) {
+        std::cerr << "Mapping io_uring failed: " << strerror(errno) << std::endl;
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        sqRing = nullptr;
+        sqes = nullptr;
+        close(ringFd);
+        ringFd = -1;
+        return;
+    }
+    cqRing = sqRing;
+
+    sqHead = at<uint32_t>(sqRing, params.sq_off.head);
+    sqTail = at<uint32_t>(sqRing, params.sq_off.tail);
+    sqMask = *at<uint32_t>(sqRing, params.sq_off.ring_mask);
+    sqEntries = params.sq_entries;
+    localTail = *sqTail;
+    cqHead = at<uint32_t>(cqRing, params.cq_off.head);
+    cqTail = at<uint32_t>(cqRing, params.cq_off.tail);
+    cqMask = *at<uint32_t>(cqRing, params.cq_off.ring_mask);
+    cqes = at<io_uring_cqe>(cqRing, params.cq_off.cqes);
+
+    // Entries are always used in ring order, so the indirection array is
+    // the identity and never changes
+    uint32_t* array = at<uint32_t>(sqRing, params.sq_off.array);
+    for (uint32_t i = 0; i < sqEntries; ++i) {
+        array[i] = i;
+    }
+}
+
+IoUring::~IoUring() {
+    if (sqes) {
+        munmap(sqes, sqesSize);
+    }
+    if (sqRing) {
+        munmap(sqRing, sqRingSize);
+    }
+    if (ringFd >= 0) {
+        close(ringFd);
+    }
+}
+
+bool IoUring::supports(std::initializer_list<uint8_t> opcodes) const {
+    constexpr unsigned PROBE_OPS = 256;
+    std::vector<char> storage(sizeof(io_uring_probe) + PROBE_OPS * sizeof(io_uring_probe_op));
+    auto* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+    if (registerResource(ringFd, IORING_REGISTER_PROBE, probe, PROBE_OPS) < 0) {
+        return false; // no probing before 5.6, which also lacks what we need
+    }
+    for (uint8_t opcode : opcodes) {
+        if (opcode > probe->last_op || !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+io_uring_sqe* IoUring::nextSqe() {
+    if (localTail - std::atomic_ref<uint32_t>(*sqHead).load(std::memory_order_acquire) >= sqEntries) {
+        submit();
+    }
+    io_uring_sqe* sqe = &sqes[localTail & sqMask];
+    ++localTail;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int IoUring::submit(unsigned waitFor) {
+    // Counted from the kernel's head, so entries a previous call could not
+    // submit go out with these
+    std::atomic_ref<uint32_t>(*sqTail).store(localTail, std::memory_order_release);
+    const uint32_t toSubmit = localTail - std::atomic_ref<uint32_t>(*sqHead).load(std::memory_order_acquire);
+    if (toSubmit == 0 && waitFor == 0) {
+        return 0;
+    }
+
+    const unsigned flags = enterFlags | (waitFor > 0 ? IORING_ENTER_GETEVENTS : 0);
+    while (true) {
+        int result = enter(enterFd, toSubmit, waitFor, flags);
+        if (result >= 0 || errno != EINTR) {
+            return result;
+        }
+    }
+}
+
+int IoUring::registerBuffers(const iovec* buffers, unsigned count) {
+    return registerResource(ringFd, IORING_REGISTER_BUFFERS, buffers, count);
+}
+
+int IoUring::registerFiles(const int* fds, unsigned count) {
+    return registerResource(ringFd, IORING_REGISTER_FILES, fds, count);
+}
+
+bool IoUring::registerRingFd() {
+    io_uring_rsrc_update update{};
+    update.offset = -1U; // any free slot
+    update.data = static_cast<uint64_t>(ringFd);
+    if (registerResource(ringFd, IORING_REGISTER_RING_FDS, &update, 1) != 1) {
+        return false; // before 5.18, keep entering through the plain descriptor
+    }
+    enterFd = static_cast<int>(update.offset);
+    enterFlags |= IORING_ENTER_REGISTERED_RING;
+    return true;
+}
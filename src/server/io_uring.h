@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <linux/io_uring.h>
+
+struct iovec;
+
+// Minimal io_uring on the raw system calls, without liburing: the mapped
+// submission and completion rings and the registration calls the server
+// uses. An instance belongs to the one thread that submits to it.
+class IoUring {
+public:
+    explicit IoUring(unsigned entries);
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    bool valid() const { return ringFd >= 0; }
+
+    // Whether the running kernel implements every one of these opcodes
+    bool supports(std::initializer_list<uint8_t> opcodes) const;
+
+    // A zeroed submission entry, queued for the next submit(); submits the
+    // queue first when it is full
+    io_uring_sqe* nextSqe();
+
+    // Submits everything queued and waits for at least waitFor completions,
+    // all in one system call
+    int submit(unsigned waitFor = 0);
+
+    // Calls handler(const io_uring_cqe&) for every completion that is ready
+    template <typename Handler>
+    unsigned drainCompletions(Handler&& handler) {
+        uint32_t head = *cqHead;
+        const uint32_t tail = std::atomic_ref<uint32_t>(*cqTail).load(std::memory_order_acquire);
+        unsigned count = 0;
+        for (; head != tail; ++head, ++count) {
+            handler(cqes[head & cqMask]);
+        }
+        std::atomic_ref<uint32_t>(*cqHead).store(head, std::memory_order_release);
+        return count;
+    }
+
+    int registerBuffers(const iovec* buffers, unsigned count);
+    int registerFiles(const int* fds, unsigned count);
+    // Lets io_uring_enter skip the file descriptor lookup on every call
+    bool registerRingFd();
+
+private:
+    int ringFd = -1;
+    int enterFd = -1;      // ringFd, or its registered index
+    unsigned enterFlags = 0;
+
+    void* sqRing = nullptr;
+    size_t sqRingSize = 0;
+    void* cqRing = nullptr;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+
+    uint32_t* sqHead = nullptr;
+    uint32_t* sqTail = nullptr;
+    uint32_t sqMask = 0;
+    uint32_t sqEntries = 0;
+    uint32_t localTail = 0; // entries handed out, published to *sqTail on submit
+    uint32_t* cqHead = nullptr;
+    uint32_t* cqTail = nullptr;
+    uint32_t cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+};
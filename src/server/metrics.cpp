@@ -0,0 +1,195 @@
+#include "metrics.h"
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace metrics {
+
+namespace {
+
+// Blocks are never freed: a scrape may read one while its thread exits, and
+// the next thread to start takes it over with its counts intact
+struct Registry {
+    std::mutex mutex;
+    std::deque<ThreadMetrics> blocks;
+    std::vector<ThreadMetrics*> freeBlocks;
+};
+
+Registry& registry() {
+    // Leaked, so threads that exit during static destruction can still hand back their block
+    static Registry* instance = new Registry;
+    return *instance;
+}
+
+// Hands the calling thread's block back when the thread exits
+struct Release {
+    ~Release() {
+        if (currentThread != nullptr) {
+            Registry& blocks = registry();
+            std::lock_guard<std::mutex> lock(blocks.mutex);
+            blocks.freeBlocks.push_back(currentThread);
+            currentThread = nullptr;
+        }
+    }
+};
+
+thread_local Release release;
+
+constexpr std::pair<double, const char*> QUANTILES[] = {{0.5, "0.5"}, {0.9, "0.9"}, {0.99, "0.99"}, {0.999, "0.999"}};
+
+void appendHeader(std::string& out, std::string_view name, std::string_view type, std::string_view help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void appendSeconds(std::string& out, uint64_t nanoseconds) {
+    char buffer[32];
+    int length = snprintf(buffer, sizeof(buffer), "%.9g", nanoseconds / 1e9);
+    out.append(buffer, length);
+}
+
+}
+
+ThreadMetrics& registerThread() {
+    Registry& blocks = registry();
+    {
+        std::lock_guard<std::mutex> lock(blocks.mutex);
+        if (!blocks.freeBlocks.empty()) {
+            currentThread = blocks.freeBlocks.back();
+            blocks.freeBlocks.pop_back();
+        } else {
+            currentThread = &blocks.blocks.emplace_back();
+        }
+    }
+    [[maybe_unused]] Release* armed = &release; // constructs it, so its destructor runs at thread exit
+    return *currentThread;
+}
+
+uint64_t HistogramSnapshot::quantile(double fraction) const {
+    if (count == 0) {
+        return 0;
+    }
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(fraction * count)));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < counts.size(); ++bucket) {
+        seen += counts[bucket];
+        if (seen >= rank) {
+            return LatencyHistogram::upperBound(bucket);
+        }
+    }
+    return LatencyHistogram::upperBound(counts.size() - 1);
+}
+
+Snapshot snapshot() {
+    Snapshot total;
+    Registry& blocks = registry();
+    std::lock_guard<std::mutex> lock(blocks.mutex);
+    for (const ThreadMetrics& block : blocks.blocks) {
+        total.bytesOut += block.bytesOut.load(std::memory_order_relaxed);
+        total.connectionsOpened += block.connectionsOpened.load(std::memory_order_relaxed);
+        total.connectionsClosed += block.connectionsClosed.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < total.timeouts.size(); ++i) {
+            total.timeouts[i] += block.timeouts[i].load(std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < total.statuses.size(); ++i) {
+            total.statuses[i] += block.statuses[i].load(std::memory_order_relaxed);
+        }
+        for (size_t stage = 0; stage < total.stages.size(); ++stage) {
+            const LatencyHistogram& histogram = block.stages[stage];
+            HistogramSnapshot& merged = total.stages[stage];
+            for (size_t bucket = 0; bucket < LatencyHistogram::BUCKETS; ++bucket) {
+                const uint64_t count = histogram.counts[bucket].load(std::memory_order_relaxed);
+                merged.counts[bucket] += count;
+                merged.count += count;
+            }
+            merged.sum += histogram.sum.load(std::memory_order_relaxed);
+        }
+    }
+    return total;
+}
+
+void appendMetric(std::string& out, std::string_view name, std::string_view type, std::string_view help,
+                  uint64_t value) {
+    appendHeader(out, name, type, help);
+    out += name;
+    out += ' ';
+    out += std::to_string(value);
+    out += '\n';
+}
+
+void appendSnapshot(std::string& out, const Snapshot& snapshot) {
+    appendMetric(out, "thermal_bytes_out_total", "counter", "Response bytes written to client sockets",
+                 snapshot.bytesOut);
+    appendMetric(out, "thermal_connections_opened_total", "counter", "HTTP connections accepted",
+                 snapshot.connectionsOpened);
+    // A connection may close on another thread than the one that opened it,
+    // so a scrape can briefly see the close first
+    appendMetric(out, "thermal_connections_active", "gauge", "HTTP connections currently open",
+                 snapshot.connectionsOpened - std::min(snapshot.connectionsClosed, snapshot.connectionsOpened));
+
+    appendHeader(out, "thermal_connection_timeouts_total", "counter",
+                 "Connections closed because a phase took too long");
+    for (size_t i = 0; i < snapshot.timeouts.size(); ++i) {
+        out += "thermal_connection_timeouts_total{phase=\"" + std::string(TIMEOUT_NAMES[i]) + "\"} " +
+            std::to_string(snapshot.timeouts[i]) + "\n";
+    }
+
+    appendHeader(out, "thermal_responses_total", "counter", "Responses by status code");
+    for (size_t i = 0; i < snapshot.statuses.size(); ++i) {
+        if (snapshot.statuses[i] > 0) {
+            out += "thermal_responses_total{code=\"" + std::to_string(ThreadMetrics::MIN_STATUS + i) + "\"} " +
+                std::to_string(snapshot.statuses[i]) + "\n";
+        }
+    }
+
+    // Prometheus buckets are cumulative; one per power of two keeps a
+    // scrape small, and the exact sub-buckets feed the quantiles below.
+    // Every boundary goes out on every scrape, empty or not, since rate()
+    // and histogram_quantile() need the same layout from one scrape to the next.
+    appendHeader(out, "thermal_stage_duration_seconds", "histogram", "Latency of each request-path stage");
+    for (size_t stage = 0; stage < snapshot.stages.size(); ++stage) {
+        const HistogramSnapshot& histogram = snapshot.stages[stage];
+        const std::string label = "stage=\"" + std::string(STAGE_NAMES[stage]) + "\"";
+        uint64_t cumulative = 0;
+        for (size_t bucket = 0; bucket < LatencyHistogram::BUCKETS; ++bucket) {
+            cumulative += histogram.counts[bucket];
+            if ((bucket + 1) % LatencyHistogram::SUB_BUCKETS == 0) {
+                out += "thermal_stage_duration_seconds_bucket{" + label + ",le=\"";
+                appendSeconds(out, LatencyHistogram::upperBound(bucket));
+                out += "\"} " + std::to_string(cumulative) + "\n";
+            }
+        }
+        out += "thermal_stage_duration_seconds_bucket{" + label + ",le=\"+Inf\"} " +
+            std::to_string(histogram.count) + "\n";
+        out += "thermal_stage_duration_seconds_sum{" + label + "} ";
+        appendSeconds(out, histogram.sum);
+        out += "\nthermal_stage_duration_seconds_count{" + label + "} " + std::to_string(histogram.count) + "\n";
+    }
+
+    appendHeader(out, "thermal_stage_quantile_seconds", "gauge",
+                 "Latency quantiles of each request-path stage, to within 1/16");
+    for (size_t stage = 0; stage < snapshot.stages.size(); ++stage) {
+        const HistogramSnapshot& histogram = snapshot.stages[stage];
+        if (histogram.count == 0) {
+            continue;
+        }
+        for (auto [fraction, quantile] : QUANTILES) {
+            out += "thermal_stage_quantile_seconds{stage=\"" + std::string(STAGE_NAMES[stage]) +
+                "\",quantile=\"" + quantile + "\"} ";
+            appendSeconds(out, histogram.quantile(fraction));
+            out += '\n';
+        }
+    }
+}
+
+}
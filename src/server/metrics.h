@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Request-path telemetry. Every thread records into a block of its own with
+// plain relaxed stores, so recording is a handful of instructions and never
+// contends; a scrape sums the blocks of all threads, live and exited.
+namespace metrics {
+
+// Single writer per counter: a load and a store, no locked read-modify-write
+inline void add(std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+// Stages whose latency is recorded
+enum class Stage : uint8_t {
+    Accept,      // taking a connection until it is being served
+    Parse,       // request line and headers of one complete request
+    CacheLookup, // file cache probes for one request
+    DiskRead,    // reading a whole file into memory
+    Send,        // first write of a response until its last byte is out
+    Scan,        // one watch-mode walk and diff of the tree
+    Count
+};
+
+constexpr std::array<std::string_view, static_cast<size_t>(Stage::Count)> STAGE_NAMES = {
+    "accept", "parse", "cache_lookup", "disk_read", "send", "scan"
+};
+
+// Phases of a connection that are cut off when they take too long
+enum class Timeout : uint8_t {
+    Idle,   // keep-alive wait for the next request
+    Header, // request line and headers
+    Body,   // request body after its head
+    Send,   // response writes that make no progress
+    Count
+};
+
+constexpr std::array<std::string_view, static_cast<size_t>(Timeout::Count)> TIMEOUT_NAMES = {
+    "idle", "header", "body", "send"
+};
+
+// Log-linear latency histogram in nanoseconds, HDR style: values below 16
+// get a bucket each, above that every power of two is split into 16
+// sub-buckets, so any value is known to within 1/16. Written by one thread.
+class LatencyHistogram {
+public:
+    static constexpr unsigned SUB_BUCKET_BITS = 4;
+    static constexpr uint64_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr unsigned MAX_MAGNITUDE = 40; // 2^40 ns, about 18 minutes; longer values are clamped
+    static constexpr size_t BUCKETS = SUB_BUCKETS + (MAX_MAGNITUDE - SUB_BUCKET_BITS) * SUB_BUCKETS;
+
+    static size_t bucketOf(uint64_t nanoseconds) {
+        if (nanoseconds < SUB_BUCKETS) {
+            return nanoseconds;
+        }
+        nanoseconds = std::min(nanoseconds, (uint64_t(1) << MAX_MAGNITUDE) - 1);
+        const unsigned shift = std::bit_width(nanoseconds) - 1 - SUB_BUCKET_BITS;
+        return SUB_BUCKETS + shift * SUB_BUCKETS + ((nanoseconds >> shift) - SUB_BUCKETS);
+    }
+
+    // Largest value that lands in bucket
+    static uint64_t upperBound(size_t bucket) {
+        if (bucket < SUB_BUCKETS) {
+            return bucket;
+        }
+        const size_t shift = (bucket - SUB_BUCKETS) / SUB_BUCKETS;
+        const uint64_t sub = (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+        return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+    }
+
+    void record(uint64_t nanoseconds) {
+        add(counts[bucketOf(nanoseconds)], 1);
+        add(sum, nanoseconds);
+    }
+
+    std::array<std::atomic<uint64_t>, BUCKETS> counts{};
+    std::atomic<uint64_t> sum{0};
+};
+
+// Everything one thread records
+struct alignas(64) ThreadMetrics {
+    static constexpr int MIN_STATUS = 100;
+    static constexpr int MAX_STATUS = 599;
+
+    std::atomic<uint64_t> bytesOut{0};
+    std::atomic<uint64_t> connectionsOpened{0};
+    std::atomic<uint64_t> connectionsClosed{0};
+    std::array<std::atomic<uint64_t>, static_cast<size_t>(Timeout::Count)> timeouts{};
+    std::array<std::atomic<uint64_t>, MAX_STATUS - MIN_STATUS + 1> statuses{};
+    std::array<LatencyHistogram, static_cast<size_t>(Stage::Count)> stages;
+};
+
+inline thread_local ThreadMetrics* currentThread = nullptr;
+
+// Slow path of local(): takes a free block or allocates one
+ThreadMetrics& registerThread();
+
+// The calling thread's block, handed out on first use and passed on to a
+// later thread once this one exits
+inline ThreadMetrics& local() {
+    ThreadMetrics* block = currentThread;
+    return block ? *block : registerThread();
+}
+
+inline uint64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline void record(Stage stage, uint64_t startedAt) {
+    const uint64_t end = now();
+    local().stages[static_cast<size_t>(stage)].record(end > startedAt ? end - startedAt : 0);
+}
+
+inline void countBytesOut(uint64_t bytes) {
+    add(local().bytesOut, bytes);
+}
+
+inline void countConnectionOpened() {
+    add(local().connectionsOpened, 1);
+}
+
+inline void countConnectionClosed() {
+    add(local().connectionsClosed, 1);
+}
+
+inline void countTimeout(Timeout phase) {
+    add(local().timeouts[static_cast<size_t>(phase)], 1);
+}
+
+inline void countStatus(int status) {
+    if (status >= ThreadMetrics::MIN_STATUS && status <= ThreadMetrics::MAX_STATUS) {
+        add(local().statuses[status - ThreadMetrics::MIN_STATUS], 1);
+    }
+}
+
+// The blocks of every thread summed up
+struct HistogramSnapshot {
+    std::array<uint64_t, LatencyHistogram::BUCKETS> counts{};
+    uint64_t count = 0;
+    uint64_t sum = 0;
+
+    // Upper bound of the bucket holding the given fraction of values
+    uint64_t quantile(double fraction) const;
+};
+
+struct Snapshot {
+    uint64_t bytesOut = 0;
+    uint64_t connectionsOpened = 0;
+    uint64_t connectionsClosed = 0;
+    std::array<uint64_t, static_cast<size_t>(Timeout::Count)> timeouts{};
+    std::array<uint64_t, ThreadMetrics::MAX_STATUS - ThreadMetrics::MIN_STATUS + 1> statuses{};
+    std::array<HistogramSnapshot, static_cast<size_t>(Stage::Count)> stages{};
+};
+
+Snapshot snapshot();
+
+// Prometheus text exposition format
+void appendMetric(std::string& out, std::string_view name, std::string_view type, std::string_view help,
+                  uint64_t value);
+void appendSnapshot(std::string& out, const Snapshot& snapshot);
+
+}
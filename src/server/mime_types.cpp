@@ -0,0 +1,250 @@
+#include "mime_types.h"
+#include <array>
+#include <charconv>
+#include <cstdint>
+
+namespace {
+
+constexpr MimeType MIME_TYPES[] = {
+    // Documents and text
+    {"html", "text/html; charset=utf-8"},
+    {"htm", "text/html; charset=utf-8"},
+    {"xhtml", "application/xhtml+xml"},
+    {"css", "text/css; charset=utf-8"},
+    {"js", "text/javascript; charset=utf-8"},
+    {"mjs", "text/javascript; charset=utf-8"},
+    {"cjs", "text/javascript; charset=utf-8"},
+    {"json", "application/json"},
+    {"jsonld", "application/ld+json"},
+    {"map", "application/json"},
+    {"webmanifest", "application/manifest+json"},
+    {"xml", "application/xml"},
+    {"rss", "application/rss+xml"},
+    {"atom", "application/atom+xml"},
+    {"txt", "text/plain; charset=utf-8"},
+    {"md", "text/markdown; charset=utf-8"},
+    {"csv", "text/csv; charset=utf-8"},
+    {"vtt", "text/vtt; charset=utf-8"},
+    {"ics", "text/calendar; charset=utf-8"},
+    {"yaml", "application/yaml"},
+    {"yml", "application/yaml"},
+    {"toml", "application/toml"},
+    {"wasm", "application/wasm"},
+    {"pdf", "application/pdf"},
+    {"epub", "application/epub+zip"},
+    // Images
+    {"png", "image/png"},
+    {"apng", "image/apng"},
+    {"jpg", "image/jpeg"},
+    {"jpeg", "image/jpeg"},
+    {"jpe", "image/jpeg"},
+    {"gif", "image/gif"},
+    {"webp", "image/webp"},
+    {"avif", "image/avif"},
+    {"jxl", "image/jxl"},
+    {"heic", "image/heic"},
+    {"svg", "image/svg+xml"},
+    {"ico", "image/x-icon"},
+    {"cur", "image/x-icon"},
+    {"bmp", "image/bmp"},
+    {"tif", "image/tiff"},
+    {"tiff", "image/tiff"},
+    // Fonts
+    {"woff", "font/woff"},
+    {"woff2", "font/woff2"},
+    {"ttf", "font/ttf"},
+    {"otf", "font/otf"},
+    {"eot", "application/vnd.ms-fontobject"},
+    // Audio
+    {"mp3", "audio/mpeg"},
+    {"m4a", "audio/mp4"},
+    {"aac", "audio/aac"},
+    {"oga", "audio/ogg"},
+    {"ogg", "audio/ogg"},
+    {"opus", "audio/ogg"},
+    {"wav", "audio/wav"},
+    {"flac", "audio/flac"},
+    {"weba", "audio/webm"},
+    {"mid", "audio/midi"},
+    {"midi", "audio/midi"},
+    // Video and streaming
+    {"mp4", "video/mp4"},
+    {"m4v", "video/mp4"},
+    {"webm", "video/webm"},
+    {"ogv", "video/ogg"},
+    {"mov", "video/quicktime"},
+    {"mkv", "video/x-matroska"},
+    {"avi", "video/x-msvideo"},
+    {"mpeg", "video/mpeg"},
+    {"mpg", "video/mpeg"},
+    {"ts", "video/mp2t"},
+    {"m3u8", "application/vnd.apple.mpegurl"},
+    {"mpd", "application/dash+xml"},
+    // 3D models
+    {"gltf", "model/gltf+json"},
+    {"glb", "model/gltf-binary"},
+    // Archives
+    {"zip", "application/zip"},
+    {"gz", "application/gzip"},
+    {"tar", "application/x-tar"},
+    {"7z", "application/x-7z-compressed"},
+    {"rar", "application/vnd.rar"},
+    // Unknown extensions; not part of the hash table
+    {"", "application/octet-stream"},
+};
+
+constexpr size_t TYPE_COUNT = std::size(MIME_TYPES) - 1;
+constexpr const MimeType& UNKNOWN_TYPE = MIME_TYPES[TYPE_COUNT];
+
+// Long enough for every extension above; anything longer cannot match
+constexpr size_t MAX_EXTENSION_LENGTH = 16;
+
+// 1024 slots for ~80 keys keeps a collision-free seed a few dozen tries away
+constexpr size_t SLOT_COUNT = 1024;
+constexpr uint8_t EMPTY_SLOT = 0xff;
+static_assert(TYPE_COUNT < EMPTY_SLOT);
+
+constexpr char toLower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+// FNV-1a over the lowercased extension, with a final mix so the low bits
+// used for the slot depend on every character
+constexpr uint32_t extensionHash(std::string_view extension, uint32_t seed) {
+    uint32_t hash = 2166136261u ^ seed;
+    for (char c : extension) {
+        hash ^= static_cast<uint8_t>(toLower(c));
+        hash *= 16777619u;
+    }
+    hash ^= hash >> 15;
+    hash *= 0x2c1b3c6du;
+    hash ^= hash >> 12;
+    return hash;
+}
+
+struct PerfectHash {
+    uint32_t seed = 0;
+    std::array<uint8_t, SLOT_COUNT> slots{};
+};
+
+// Tries seeds until every extension lands in a slot of its own
+consteval PerfectHash buildPerfectHash() {
+    for (uint32_t seed = 0;; ++seed) {
+        PerfectHash table;
+        table.seed = seed;
+        table.slots.fill(EMPTY_SLOT);
+        bool collision = false;
+        for (size_t i = 0; i < TYPE_COUNT && !collision; ++i) {
+            uint8_t& slot = table.slots[extensionHash(MIME_TYPES[i].extension, seed) % SLOT_COUNT];
+            collision = slot != EMPTY_SLOT;
+            slot = static_cast<uint8_t>(i);
+        }
+        if (!collision) {
+            return table;
+        }
+    }
+}
+
+consteval bool extensionsAreValid() {
+    for (size_t i = 0; i < TYPE_COUNT; ++i) {
+        const std::string_view extension = MIME_TYPES[i].extension;
+        if (extension.empty() || extension.size() > MAX_EXTENSION_LENGTH) {
+            return false;
+        }
+        for (char c : extension) {
+            if (toLower(c) != c) {
+                return false;
+            }
+        }
+        for (size_t j = 0; j < i; ++j) {
+            if (MIME_TYPES[j].extension == extension) {
+                return false; // a duplicate would never find a free slot
+            }
+        }
+    }
+    return true;
+}
+static_assert(extensionsAreValid(), "MIME extensions must be unique, lowercase and short");
+
+constexpr PerfectHash PERFECT_HASH = buildPerfectHash();
+
+constexpr std::string_view OK_HEAD_START = "HTTP/1.1 200 OK\r\nContent-Type: ";
+constexpr std::string_view OK_HEAD_END = "\r\nContent-Length: ";
+
+struct HeadPrefix {
+    char text[96] = {};
+    size_t length = 0;
+};
+
+consteval std::array<HeadPrefix, std::size(MIME_TYPES)> buildHeadPrefixes() {
+    std::array<HeadPrefix, std::size(MIME_TYPES)> prefixes{};
+    for (size_t i = 0; i < std::size(MIME_TYPES); ++i) {
+        HeadPrefix& prefix = prefixes[i];
+        for (std::string_view part : {OK_HEAD_START, MIME_TYPES[i].contentType, OK_HEAD_END}) {
+            for (char c : part) {
+                prefix.text[prefix.length++] = c; // overflowing is a compile error
+            }
+        }
+    }
+    return prefixes;
+}
+
+constexpr auto HEAD_PREFIXES = buildHeadPrefixes();
+
+bool equalsLowercase(std::string_view text, std::string_view lowercase) {
+    if (text.size() != lowercase.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (toLower(text[i]) != lowercase[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+const MimeType& mimeTypeFor(std::string_view path) {
+    // Scan back from the end for the dot; a slash first means no extension
+    size_t dot = path.size();
+    while (dot > 0 && path.size() - dot <= MAX_EXTENSION_LENGTH) {
+        const char c = path[--dot];
+        if (c == '/') {
+            return UNKNOWN_TYPE;
+        }
+        if (c == '.') {
+            break;
+        }
+    }
+    if (dot == path.size() || path[dot] != '.' || dot + 1 == path.size()) {
+        return UNKNOWN_TYPE;
+    }
+    const std::string_view extension = path.substr(dot + 1);
+
+    const uint8_t slot = PERFECT_HASH.slots[extensionHash(extension, PERFECT_HASH.seed) % SLOT_COUNT];
+    if (slot == EMPTY_SLOT || !equalsLowercase(extension, MIME_TYPES[slot].extension)) {
+        return UNKNOWN_TYPE;
+    }
+    return MIME_TYPES[slot];
+}
+
+std::string_view okHeadPrefix(const MimeType& type) {
+    const HeadPrefix& prefix = HEAD_PREFIXES[&type - MIME_TYPES];
+    return std::string_view(prefix.text, prefix.length);
+}
+
+std::string okHead(const MimeType& type, size_t contentLength) {
+    const std::string_view prefix = okHeadPrefix(type);
+    char digits[24];
+    char* digitsEnd = std::to_chars(digits, digits + sizeof(digits), contentLength).ptr;
+
+    // One allocation with room for the validators and connection headers
+    // appended after it
+    std::string head;
+    head.reserve(prefix.size() + 256);
+    head.append(prefix);
+    head.append(digits, digitsEnd - digits);
+    head.append("\r\n");
+    return head;
+}
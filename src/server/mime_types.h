@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+struct MimeType {
+    std::string_view extension; // lowercase, without the dot
+    std::string_view contentType;
+};
+
+// Content type for a path's extension, matched case-insensitively through a
+// perfect hash computed at compile time; application/octet-stream if unknown
+const MimeType& mimeTypeFor(std::string_view path);
+
+// "HTTP/1.1 200 OK\r\nContent-Type: <type>\r\nContent-Length: ", also
+// assembled at compile time. type must be a reference from mimeTypeFor().
+std::string_view okHeadPrefix(const MimeType& type);
+
+// Status line, Content-Type and Content-Length of a 200, leaving the head
+// open for further headers
+std::string okHead(const MimeType& type, size_t contentLength);
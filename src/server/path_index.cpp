@@ -0,0 +1,89 @@
+#include "path_index.h"
+#include <algorithm>
+#include <mutex>
+
+bool normalizePath(std::string_view path, std::pmr::string& relative) {
+    relative.clear();
+    while (!path.empty()) {
+        const size_t slash = path.find('/');
+        const std::string_view segment = path.substr(0, slash);
+        path.remove_prefix(slash == std::string_view::npos ? path.size() : slash + 1);
+
+        if (segment.empty() || segment == ".") {
+            continue;
+        }
+        if (segment.find('\0') != std::string_view::npos) {
+            return false;
+        }
+        if (segment == "..") {
+            if (relative.empty()) {
+                return false; // above the root
+            }
+            const size_t parent = relative.find_last_of('/');
+            relative.resize(parent == std::string::npos ? 0 : parent);
+            continue;
+        }
+        if (!relative.empty()) {
+            relative += '/';
+        }
+        relative += segment;
+    }
+    return true;
+}
+
+PathIndex::PathIndex(size_t shardCount) {
+    shardCount = std::max<size_t>(shardCount, 1);
+    shards.reserve(shardCount);
+    for (size_t i = 0; i < shardCount; ++i) {
+        shards.push_back(std::make_unique<Shard>());
+    }
+}
+
+PathIndex::Lookup PathIndex::find(std::string_view path, IndexedFile* file) const {
+    if (!live()) {
+        return Lookup::Unknown;
+    }
+    const Shard& shard = shardFor(path);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.files.find(path);
+    if (it == shard.files.end()) {
+        return Lookup::Missing;
+    }
+    if (file != nullptr) {
+        *file = it->second;
+    }
+    return Lookup::Found;
+}
+
+void PathIndex::update(std::string_view path, const IndexedFile& file) {
+    Shard& shard = shardFor(path);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.files.find(path);
+    if (it == shard.files.end()) {
+        shard.files.emplace(std::string(path), file);
+    } else {
+        it->second = file;
+    }
+}
+
+void PathIndex::remove(std::string_view path) {
+    Shard& shard = shardFor(path);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.files.find(path);
+    if (it != shard.files.end()) {
+        shard.files.erase(it);
+    }
+}
+
+size_t PathIndex::size() const {
+    size_t total = 0;
+    for (const auto& shard : shards) {
+        std::shared_lock<std::shared_mutex> lock(shard->mutex);
+        total += shard->files.size();
+    }
+    return total;
+}
+
+PathIndex::Shard& PathIndex::shardFor(std::string_view path) const {
+    return *shards[Hash()(path) % shards.size()];
+}
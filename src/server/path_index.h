@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+#include <time.h>
+
+#include "mime_types.h"
+
+// Turns a decoded request path into a path relative to the served root:
+// empty and "." segments are dropped and ".." takes back the one before it.
+// False if the path would climb out of the root or contains a NUL.
+bool normalizePath(std::string_view path, std::pmr::string& relative);
+
+// What a request needs to know about a file before opening it
+struct IndexedFile {
+    ino_t inode = 0;
+    off_t size = 0;
+    timespec modified{};
+    const MimeType* mimeType = nullptr;
+};
+
+// Every regular file below the served root, by normalized relative path.
+// Built from the watcher's initial scan and kept current by its events, so
+// a lookup never touches the disk. Until the watcher goes live the index
+// cannot tell a missing file from one it has not seen yet, and says so.
+class PathIndex {
+public:
+    enum class Lookup {
+        Found,
+        Missing, // no such file, answered from memory
+        Unknown  // the index is not live yet, ask the file system
+    };
+
+    explicit PathIndex(size_t shardCount = 16);
+
+    Lookup find(std::string_view path, IndexedFile* file = nullptr) const;
+    void update(std::string_view path, const IndexedFile& file);
+    void remove(std::string_view path);
+
+    // Once set, a path that is not in the index does not exist
+    void setLive() { isLive.store(true, std::memory_order_release); }
+    bool live() const { return isLive.load(std::memory_order_acquire); }
+    size_t size() const;
+
+private:
+    struct Hash {
+        using is_transparent = void;
+        size_t operator()(std::string_view key) const { return std::hash<std::string_view>()(key); }
+    };
+
+    // Readers are every worker thread, the writer is the watcher alone
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, IndexedFile, Hash, std::equal_to<>> files;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<bool> isLive{false};
+
+    Shard& shardFor(std::string_view path) const;
+};
@@ -0,0 +1,57 @@
+#include "request_arena.h"
+#include <new>
+
+namespace {
+
+thread_local std::pmr::memory_resource* currentArena = nullptr;
+
+}
+
+RequestArena::~RequestArena() {
+    reset();
+}
+
+void RequestArena::reset() {
+    for (const Block& block : oversized) {
+        ::operator delete(block.memory, block.size, std::align_val_t(block.alignment));
+    }
+    oversized.clear();
+    if (chunks.size() > MAX_RETAINED_CHUNKS) {
+        chunks.resize(MAX_RETAINED_CHUNKS);
+    }
+    chunkIndex = 0;
+    used = 0;
+}
+
+void* RequestArena::do_allocate(size_t bytes, size_t alignment) {
+    if (bytes > CHUNK_SIZE || alignment > alignof(std::max_align_t)) {
+        void* memory = ::operator new(bytes, std::align_val_t(alignment));
+        oversized.push_back({memory, bytes, alignment});
+        return memory;
+    }
+
+    // Chunks come from new[], aligned for any fundamental type
+    size_t offset = (used + alignment - 1) & ~(alignment - 1);
+    if (chunkIndex < chunks.size() && offset + bytes > CHUNK_SIZE) {
+        ++chunkIndex;
+        offset = 0;
+    }
+    if (chunkIndex == chunks.size()) {
+        chunks.push_back(std::make_unique_for_overwrite<std::byte[]>(CHUNK_SIZE));
+        offset = 0;
+    }
+    used = offset + bytes;
+    return chunks[chunkIndex].get() + offset;
+}
+
+RequestArena::Scope::Scope(RequestArena& arena) : previous(currentArena) {
+    currentArena = &arena;
+}
+
+RequestArena::Scope::~Scope() {
+    currentArena = previous;
+}
+
+std::pmr::memory_resource* RequestArena::current() {
+    return currentArena ? currentArena : std::pmr::new_delete_resource();
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+// Bump allocator for what a connection builds while answering its requests:
+// the normalized path, the cache key and the response head. Deallocation is
+// a no-op and reset() frees everything at once. Chunks are kept across
+// resets, so after a connection's first request a cache hit takes nothing
+// from the heap.
+//
+// The I/O loops install a connection's arena with a Scope while they handle
+// its requests, and reset it once every response it holds is written.
+class RequestArena : public std::pmr::memory_resource {
+public:
+    static constexpr size_t CHUNK_SIZE = 4096;
+    // Chunks kept by reset(); a pipelined burst may take more for a while
+    static constexpr size_t MAX_RETAINED_CHUNKS = 4;
+
+    RequestArena() = default;
+    ~RequestArena() override;
+
+    RequestArena(const RequestArena&) = delete;
+    RequestArena& operator=(const RequestArena&) = delete;
+
+    // Nothing allocated from the arena may be alive
+    void reset();
+
+    // Makes arena the resource current() returns on this thread
+    class Scope {
+    public:
+        explicit Scope(RequestArena& arena);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        std::pmr::memory_resource* previous;
+    };
+
+    // The arena of the connection being served on this thread, or the heap
+    static std::pmr::memory_resource* current();
+
+private:
+    struct Block {
+        void* memory;
+        size_t size;
+        size_t alignment;
+    };
+
+    std::vector<std::unique_ptr<std::byte[]>> chunks;
+    size_t chunkIndex = 0; // chunk being bumped through
+    size_t used = 0;       // bytes of it handed out
+    std::vector<Block> oversized; // larger than a chunk or over-aligned, freed by reset()
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+};
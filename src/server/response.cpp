@@ -0,0 +1,185 @@
+#include "response.h"
+#include "metrics.h"
+#include <algorithm>
+#include <cerrno>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+UniqueFd& UniqueFd::operator=(UniqueFd&& other) noexcept {
+    if (this != &other) {
+        reset(std::exchange(other.fd, -1));
+    }
+    return *this;
+}
+
+void UniqueFd::reset(int newFd) {
+    if (fd >= 0) {
+        close(fd);
+    }
+    fd = newFd;
+}
+
+size_t Response::bodyLength() const {
+    size_t length = body.size() + fileLength;
+    for (size_t i = 0; i < bodySegmentCount; ++i) {
+        length += bodySegments[i].size();
+    }
+    for (size_t i = nextPart; i < parts.size(); ++i) {
+        length += parts[i].headers.size() + parts[i].data.size() + parts[i].fileLength;
+    }
+    return length;
+}
+
+void Response::dropBody() {
+    body.clear();
+    bodySegmentCount = 0;
+    bodyOwner.reset();
+    file.reset();
+    fileLength = 0;
+    parts.clear();
+    nextPart = 0;
+}
+
+void Response::finishLog() {
+    if (!logPending) {
+        return;
+    }
+    logPending = false;
+    const uint64_t now = metrics::now();
+    log.bytes = bytesSent;
+    log.duration = now > receivedAt ? now - receivedAt : 0;
+    accesslog::submit(log);
+}
+
+size_t Response::unsentBuffers(iovec* buffers) const {
+    size_t count = 0;
+    size_t skip = sent;
+    auto add = [&](std::string_view buffer) {
+        if (skip >= buffer.size()) {
+            skip -= buffer.size();
+            return;
+        }
+        buffers[count++] = {const_cast<char*>(buffer.data()) + skip, buffer.size() - skip};
+        skip = 0;
+    };
+    add(head);
+    add(body);
+    for (size_t i = 0; i < bodySegmentCount; ++i) {
+        add(bodySegments[i]);
+    }
+    return count;
+}
+
+bool Response::startNextPart() {
+    if (nextPart == parts.size()) {
+        return false;
+    }
+
+    // The next part takes the place of the body that was just sent; the
+    // head stays counted as sent
+    Part& part = parts[nextPart++];
+    body = std::move(part.headers);
+    bodySegmentCount = 0;
+    if (!part.data.empty()) {
+        addBodySegment(part.data);
+    }
+    fileOffset = part.fileOffset;
+    fileLength = part.fileLength;
+    sent = head.size();
+    return true;
+}
+
+static bool wouldBlock() {
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+// Sends whatever of head, body and file range is still unsent
+static WriteStatus writeBody(int socket, Response& response) {
+    // Head and in-memory body in one gathered write. MSG_MORE holds back a
+    // partial segment while a file body or another part is about to follow.
+    const bool more = response.fileLength > 0 || response.nextPart < response.parts.size();
+    while (true) {
+        iovec parts[Response::MAX_BUFFERS];
+        const size_t partCount = response.unsentBuffers(parts);
+        if (partCount == 0) {
+            break;
+        }
+
+        msghdr message{};
+        message.msg_iov = parts;
+        message.msg_iovlen = partCount;
+        ssize_t result = sendmsg(socket, &message, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+        if (result < 0) {
+            if (errno == EINTR) continue;
+            return wouldBlock() ? WriteStatus::WouldBlock : WriteStatus::Error;
+        }
+        response.sent += result;
+        response.bytesSent += result;
+        metrics::countBytesOut(result);
+    }
+
+    // File body straight from the page cache
+    while (response.fileLength > 0 && !response.bufferedFile) {
+        ssize_t result = sendfile(socket, response.file.get(), &response.fileOffset, response.fileLength);
+        if (result < 0) {
+            if (errno == EINTR) continue;
+            if (wouldBlock()) return WriteStatus::WouldBlock;
+            if (errno == EINVAL || errno == ENOSYS) {
+                response.bufferedFile = true; // file system cannot splice, copy instead
+                break;
+            }
+            return WriteStatus::Error;
+        }
+        if (result == 0) {
+            return WriteStatus::Error; // file shrank underneath us
+        }
+        response.fileLength -= result;
+        response.bytesSent += result;
+        metrics::countBytesOut(result);
+    }
+
+    // Buffered fallback, copied through a small buffer
+    char fileBuffer[16384];
+    while (response.fileLength > 0) {
+        const size_t chunk = std::min(sizeof(fileBuffer), response.fileLength);
+        ssize_t bytesRead = pread(response.file.get(), fileBuffer, chunk, response.fileOffset);
+        if (bytesRead < 0 && errno == EINTR) continue;
+        if (bytesRead <= 0) {
+            return WriteStatus::Error; // file shrank underneath us
+        }
+
+        ssize_t result = send(socket, fileBuffer, bytesRead, MSG_NOSIGNAL);
+        if (result < 0) {
+            if (errno == EINTR) continue;
+            return wouldBlock() ? WriteStatus::WouldBlock : WriteStatus::Error;
+        }
+        response.fileOffset += result;
+        response.fileLength -= result;
+        response.bytesSent += result;
+        metrics::countBytesOut(result);
+    }
+
+    return WriteStatus::Complete;
+}
+
+WriteStatus writeResponse(int socket, Response& response) {
+    if (response.startedAt == 0) {
+        response.startedAt = metrics::now();
+    }
+    while (true) {
+        WriteStatus status = writeBody(socket, response);
+        if (status == WriteStatus::Error) {
+            response.finishLog();
+        }
+        if (status != WriteStatus::Complete) {
+            return status;
+        }
+        if (!response.startNextPart()) {
+            metrics::record(metrics::Stage::Send, response.startedAt);
+            response.finishLog();
+            return status;
+        }
+    }
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+
+#include "access_log.h"
+#include "request_arena.h"
+
+struct iovec;
+
+// Owning file descriptor, closed when it goes out of scope
+class UniqueFd {
+public:
+    UniqueFd() = default;
+    explicit UniqueFd(int fd) : fd(fd) {}
+    UniqueFd(UniqueFd&& other) noexcept : fd(std::exchange(other.fd, -1)) {}
+    UniqueFd& operator=(UniqueFd&& other) noexcept;
+    ~UniqueFd() { reset(); }
+
+    UniqueFd(const UniqueFd&) = delete;
+    UniqueFd& operator=(const UniqueFd&) = delete;
+
+    int get() const { return fd; }
+    explicit operator bool() const { return fd >= 0; }
+    void reset(int newFd = -1);
+
+private:
+    int fd = -1;
+};
+
+// A response ready to go out on a socket: the serialized status line and
+// headers, followed by the body. The body is sent in order from an owned
+// string, views into shared immutable buffers, then a byte range of a file.
+struct Response {
+    static constexpr size_t MAX_BODY_SEGMENTS = 3;
+
+    // One multipart/byteranges part: its delimiter and headers, then its
+    // bytes from a shared buffer or from the response's file
+    struct Part {
+        std::string headers;
+        std::string_view data;
+        off_t fileOffset = 0;
+        size_t fileLength = 0;
+    };
+
+    std::pmr::string head{RequestArena::current()}; // in the connection's arena while one is in scope
+    std::string body;
+    // Body bytes borrowed from shared buffers such as the file cache; bodyOwner
+    // keeps them alive so many connections can send them without copying
+    std::array<std::string_view, MAX_BODY_SEGMENTS> bodySegments{};
+    size_t bodySegmentCount = 0;
+    std::shared_ptr<const void> bodyOwner;
+    UniqueFd file;
+    off_t fileOffset = 0;
+    size_t fileLength = 0;
+    bool bufferedFile = false; // copy the file through userspace instead of sendfile(2)
+    std::vector<Part> parts; // sent in order once the body above is out
+    size_t nextPart = 0;
+    bool sse = false;       // socket is handed to the SSE client list after this
+    uint64_t lastEventId = 0; // Last-Event-ID the SSE stream resumes from
+    // Set instead of a reply when answering needs blocking work, such as a
+    // file read on a cache miss; once it has run, the request is handled again
+    std::function<void()> blockingWork;
+    bool keepAlive = false; // connection stays open for the next request
+    size_t sent = 0;        // bytes of head and in-memory body already written
+    uint64_t startedAt = 0; // metrics::now() at the first write, 0 before it
+    uint64_t receivedAt = 0; // metrics::now() when its request was parsed
+    uint64_t bytesSent = 0; // everything written so far, head and body
+    bool logPending = false; // log goes out once the response is done
+    accesslog::Entry log;
+
+    static constexpr size_t MAX_BUFFERS = 2 + MAX_BODY_SEGMENTS;
+
+    void addBodySegment(std::string_view segment) { bodySegments[bodySegmentCount++] = segment; }
+    // Whatever of head, body and segments is still unsent, as up to
+    // MAX_BUFFERS iovecs; returns how many were filled
+    size_t unsentBuffers(iovec* buffers) const;
+    // Once everything above and the file range are out, moves the next
+    // multipart part into their place; false when no part is left
+    bool startNextPart();
+    // Length of everything after the head
+    size_t bodyLength() const;
+    // HEAD requests keep the headers, including Content-Length, but no body
+    void dropBody();
+    // Submits the pending access log entry once the response is written or abandoned
+    void finishLog();
+};
+
+enum class WriteStatus {
+    Complete,
+    WouldBlock, // non-blocking socket is full, retry when writable
+    Error
+};
+
+// Writes as much of the response as the socket accepts and records the
+// progress in the response, so a later call resumes where this one stopped.
+// Head and in-memory body go out in one gathered write; a file body is sent
+// with sendfile(2), falling back to a buffered copy where that is unsupported.
+// Multipart parts are then written the same way, one after another.
+WriteStatus writeResponse(int socket, Response& response);
@@ -3,56 +3,856 @@
 #include <filesystem>
 #include <chrono>
 #include <thread>
-#include <fstream>
-#include <sstream>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <cstring>
+#include <ctime>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <climits>
+#include <memory>
+#include <random>
+#include <fcntl.h>
+#include <linux/filter.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include "access_log.h"
+#include "content_hash.h"
+#include "event_loop.h"
+#include "http_parser.h"
+#include "inotify_watcher.h"
+#include "metrics.h"
+#include "mime_types.h"
+#include "tree_scan.h"
+#include "uring_loop.h"
 
 namespace fs = std::filesystem;
 
+namespace {
+
+// Below this a compressed body saves less than the Content-Encoding header costs
+constexpr size_t MIN_COMPRESSIBLE_SIZE = 256;
+
+// Requests for more ranges than this get the whole body instead
+constexpr size_t MAX_RANGES = 16;
+
+// Reserved for the server's own telemetry, never looked up on disk
+constexpr std::string_view METRICS_PATH = "/__thermal/metrics";
+
+// Larger files are taken as changed without reading them to compare hashes
+constexpr off_t MAX_HASHED_SIZE = 64 * 1024 * 1024;
+
+// Threads a full tree scan fans out over; past this the disk, not the
+// walk, is what a scan waits on
+constexpr unsigned MAX_SCAN_THREADS = 8;
+
+unsigned scanThreads() {
+    return std::clamp(std::thread::hardware_concurrency(), 1u, MAX_SCAN_THREADS);
+}
+
+// Seconds between warnings while the work pool is turning requests away
+constexpr int64_t SHEDDING_REPORT_INTERVAL_S = 5;
+
+// Sent, without reading the request, to connections over a connection cap
+constexpr std::string_view OVER_CAPACITY_RESPONSE =
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Content-Type: text/plain\r\n"
+    "Content-Length: 20\r\n"
+    "Retry-After: 1\r\n"
+    "Connection: close\r\n"
+    "\r\n"
+    "Too many connections";
+
+// Waits for a connection thread's socket to become ready for events;
+// false once deadline passes first
+bool waitUntil(int socket, short events, std::chrono::steady_clock::time_point deadline) {
+    pollfd ready{socket, events, 0};
+    while (true) {
+        int timeout = -1;
+        if (deadline != std::chrono::steady_clock::time_point::max()) {
+            const auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            timeout = static_cast<int>(std::clamp<int64_t>(left.count(), 0, INT_MAX));
+        }
+        int result = poll(&ready, 1, timeout);
+        if (result == 0) {
+            return false;
+        }
+        if (result > 0 || errno != EINTR) {
+            return true; // errors and hangups surface in the read or write that follows
+        }
+    }
+}
+
+// Index into Server::fileCaches of the node the calling worker runs on
+thread_local size_t cacheDomain = 0;
+
+// Cache slot for watch mode HTML, after the ContentEncoding slots
+constexpr size_t HOT_RELOAD_VARIANT = FileCache::MAX_VARIANTS - 1;
+static_assert(HOT_RELOAD_VARIANT > static_cast<size_t>(ContentEncoding::Brotli));
+
+// Injected into every HTML page in watch mode
+constexpr std::string_view HOT_RELOAD_SCRIPT = R"(
+<script>
+(function() {
+    console.log('🔥 Hot reload enabled');
+    const eventSource = new EventSource('/sse');
+    const pathOf = url => decodeURI(new URL(url, location.href).pathname);
+    const bust = (url, version) => {
+        const busted = new URL(url, location.href);
+        busted.searchParams.set('thermal', version);
+        return busted.href;
+    };
+    eventSource.addEventListener('reload', function() {
+        console.log('🔄 Reloading page due to file change');
+        window.location.reload();
+    });
+    // Stylesheets and images swap in place, keeping scroll position and state
+    eventSource.addEventListener('update', function(event) {
+        const update = JSON.parse(event.data);
+        const paths = new Set(update.paths);
+        for (const link of document.querySelectorAll('link[rel~="stylesheet"][href]')) {
+            if (!paths.has(pathOf(link.href))) continue;
+            // The old sheet stays until the new one is in, so nothing flashes unstyled
+            const next = link.cloneNode();
+            next.href = bust(link.href, update.version);
+            next.onload = next.onerror = () => link.remove();
+            link.after(next);
+        }
+        for (const image of document.images) {
+            if (image.src && paths.has(pathOf(image.src))) {
+                image.src = bust(image.src, update.version);
+            }
+        }
+        console.log('🎨 Updated ' + update.paths.join(', '));
+    });
+    eventSource.onerror = function(event) {
+        console.log('❌ Hot reload connection lost');
+    };
+})();
+</script>
+)";
+
+// FNV-1a of the injected script, computed at compile time. It goes into
+// hot reload ETags, so a page a browser cached under an older script is
+// sent again instead of answered with a 304 that keeps the old script.
+constexpr uint32_t scriptHash(std::string_view script) {
+    uint32_t hash = 2166136261u;
+    for (char c : script) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+    }
+    return hash;
+}
+
+constexpr uint32_t HOT_RELOAD_SCRIPT_HASH = scriptHash(HOT_RELOAD_SCRIPT);
+
+char toLower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+        return toLower(x) == toLower(y);
+    });
+}
+
+std::string_view trim(std::string_view value) {
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) value.remove_prefix(1);
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) value.remove_suffix(1);
+    return value;
+}
+
+// Status line text for the errors the request parser reports
+std::string statusLine(int status) {
+    switch (status) {
+    case 413: return "413 Content Too Large";
+    case 431: return "431 Request Header Fields Too Large";
+    case 501: return "501 Not Implemented";
+    default: return "400 Bad Request";
+    }
+}
+
+// True if a comma-separated header value such as Connection lists the token
+bool containsToken(std::string_view value, std::string_view token) {
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        std::string_view item = value.substr(0, comma);
+        while (!item.empty() && item.front() == ' ') item.remove_prefix(1);
+        while (!item.empty() && item.back() == ' ') item.remove_suffix(1);
+        if (equalsIgnoreCase(item, token)) {
+            return true;
+        }
+        if (comma == std::string_view::npos) break;
+        value.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+
+// Status code of a serialized head, "HTTP/1.1 200 OK"
+int statusOf(std::string_view head) {
+    int status = 0;
+    if (head.size() >= 12) {
+        std::from_chars(head.data() + 9, head.data() + 12, status);
+    }
+    return status;
+}
+
+// Marks a finished response for the access log if its status passes the
+// level and sampling; its entry is written once the last byte is out
+bool markForLog(Response& response) {
+    const int status = statusOf(response.head);
+    if (!accesslog::wanted(status)) {
+        return false;
+    }
+    response.log.status = static_cast<uint16_t>(status);
+    response.log.level = accesslog::levelFor(status);
+    response.logPending = true;
+    return true;
+}
+
+// Small HTML error page; the head is left open for finishHead()
+Response errorResponse(const std::string& status) {
+    Response response;
+    response.body = "<html><body><h1>" + status + "</h1></body></html>";
+    response.head =
+        "HTTP/1.1 " + status + "\r\n"
+        "Content-Type: text/html\r\n"
+        "Content-Length: " + std::to_string(response.body.size()) + "\r\n";
+    return response;
+}
+
+// Reads exactly size bytes from the start of fd; false if the file came up short
+bool readWholeFile(int fd, size_t size, std::string& content) {
+    const uint64_t startedAt = metrics::now();
+    content.resize(size);
+    size_t bytesRead = 0;
+    while (bytesRead < size) {
+        ssize_t result = pread(fd, content.data() + bytesRead, size - bytesRead, bytesRead);
+        if (result < 0 && errno == EINTR) continue;
+        if (result <= 0) break;
+        bytesRead += result;
+    }
+    metrics::record(metrics::Stage::DiskRead, startedAt);
+    return bytesRead == size;
+}
+
+// Strong validator from inode, size and mtime. A strong ETag names exact
+// bytes, so every representation of a file gets its own suffix.
+std::string makeETag(ino_t inode, off_t size, const timespec& modified, std::string_view suffix = {}) {
+    char buffer[80];
+    int length = snprintf(buffer, sizeof(buffer), "\"%jx-%jx-%jx.%lx",
+                          static_cast<uintmax_t>(inode), static_cast<uintmax_t>(size),
+                          static_cast<uintmax_t>(modified.tv_sec), static_cast<long>(modified.tv_nsec));
+    std::string etag(buffer, length);
+    if (!suffix.empty()) {
+        etag += '-';
+        etag += suffix;
+    }
+    etag += '"';
+    return etag;
+}
+
+// Strong validator from the bytes themselves, which survives a touch or a
+// rewrite with the same content
+std::string makeContentETag(uint64_t contentHash, std::string_view suffix = {}) {
+    char buffer[32];
+    int length = snprintf(buffer, sizeof(buffer), "\"c%016jx", static_cast<uintmax_t>(contentHash));
+    std::string etag(buffer, length);
+    if (!suffix.empty()) {
+        etag += '-';
+        etag += suffix;
+    }
+    etag += '"';
+    return etag;
+}
+
+// IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+std::string httpDate(time_t time) {
+    tm parts;
+    gmtime_r(&time, &parts);
+    char buffer[32];
+    size_t length = strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &parts);
+    return std::string(buffer, length);
+}
+
+bool parseHttpDate(std::string_view value, time_t& time) {
+    char buffer[64];
+    if (value.size() >= sizeof(buffer)) {
+        return false;
+    }
+    value.copy(buffer, value.size());
+    buffer[value.size()] = '\0';
+    
+    tm parts{};
+    const char* end = strptime(buffer, "%a, %d %b %Y %H:%M:%S GMT", &parts);
+    if (end == nullptr || *end != '\0') {
+        return false;
+    }
+    time = timegm(&parts);
+    return true;
+}
+
+// If-None-Match uses the weak comparison: W/ prefixes are ignored
+bool etagMatches(std::string_view ifNoneMatch, std::string_view etag) {
+    while (!ifNoneMatch.empty()) {
+        size_t comma = ifNoneMatch.find(',');
+        std::string_view item = trim(ifNoneMatch.substr(0, comma));
+        if (item.starts_with("W/")) {
+            item.remove_prefix(2);
+        }
+        if (item == "*" || item == etag) {
+            return true;
+        }
+        if (comma == std::string_view::npos) break;
+        ifNoneMatch.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+bool isNotModified(const HttpRequest& request, std::string_view etag, time_t modified) {
+    if (request.method != "GET" && request.method != "HEAD") {
+        return false;
+    }
+    
+    // If-None-Match wins; If-Modified-Since only counts when it is absent
+    std::string_view ifNoneMatch = request.header("If-None-Match");
+    if (!ifNoneMatch.empty()) {
+        return etagMatches(ifNoneMatch, etag);
+    }
+    
+    std::string_view ifModifiedSince = request.header("If-Modified-Since");
+    time_t since;
+    return !ifModifiedSince.empty() && parseHttpDate(ifModifiedSince, since) &&
+        since <= ::time(nullptr) && modified <= since;
+}
+
+// Build tools put a content hash in the name ("app.3f9a2b1c.js",
+// "index-BxK3a9fQ.js"), so such a URL never changes meaning
+bool isFingerprinted(std::string_view path) {
+    std::string_view name = path.substr(path.find_last_of('/') + 1);
+    name = name.substr(0, name.find_last_of('.')); // the extension is never the hash
+    while (!name.empty()) {
+        size_t separator = name.find_first_of(".-");
+        std::string_view part = name.substr(0, separator);
+        
+        bool hex = true, upper = false, lower = false, digit = false, word = true;
+        for (char c : part) {
+            const bool isUpper = c >= 'A' && c <= 'Z';
+            const bool isLower = c >= 'a' && c <= 'z';
+            const bool isDigit = c >= '0' && c <= '9';
+            word &= isUpper || isLower || isDigit || c == '_';
+            hex &= isDigit || (c >= 'a' && c <= 'f');
+            upper |= isUpper;
+            lower |= isLower;
+            digit |= isDigit;
+        }
+        // Lowercase hex with letters and digits, or base64url-style mixed case
+        if (part.size() >= 8 && word && digit && lower && (hex || upper)) {
+            return true;
+        }
+        if (separator == std::string_view::npos) break;
+        name.remove_prefix(separator + 1);
+    }
+    return false;
+}
+
+std::string validatorHeaders(std::string_view etag, time_t modified, const char* cacheControl) {
+    std::string headers;
+    headers.reserve(128);
+    headers += "ETag: ";
+    headers += etag;
+    headers += "\r\nLast-Modified: ";
+    headers += httpDate(modified);
+    headers += "\r\nCache-Control: ";
+    headers += cacheControl;
+    headers += "\r\n";
+    return headers;
+}
+
+// Header-only answer for a client whose copy is current; the head is left
+// open for finishHead()
+Response notModifiedResponse(std::string_view validators, bool vary) {
+    Response response;
+    response.head = "HTTP/1.1 304 Not Modified\r\n";
+    response.head += validators;
+    if (vary) {
+        response.head += "Vary: Accept-Encoding\r\n";
+    }
+    return response;
+}
+
+// Opens the style.css.br or .gz that sits next to style.css, unless it is
+// older than the file and so was compressed from a previous version
+UniqueFd openPrecompressed(const std::string& fullPath, ContentEncoding encoding, const timespec& modified,
+                           struct stat& siblingStat) {
+    const std::string siblingPath = fullPath + encodingSuffix(encoding);
+    UniqueFd sibling(open(siblingPath.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!sibling || fstat(sibling.get(), &siblingStat) < 0 || !S_ISREG(siblingStat.st_mode)) {
+        return UniqueFd();
+    }
+    if (siblingStat.st_mtim.tv_sec < modified.tv_sec ||
+        (siblingStat.st_mtim.tv_sec == modified.tv_sec && siblingStat.st_mtim.tv_nsec < modified.tv_nsec)) {
+        return UniqueFd();
+    }
+    return sibling;
+}
+
+struct ByteRange {
+    uint64_t first;
+    uint64_t length;
+};
+
+enum class RangeStatus {
+    Ignored,      // absent, malformed or not worth it: send the whole body
+    Satisfiable,
+    Unsatisfiable // 416
+};
+
+bool parseNumber(std::string_view text, uint64_t& value) {
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return !text.empty() && result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+// "bytes=0-499, 1000-, -200" resolved against a body of size bytes
+RangeStatus parseRanges(std::string_view value, uint64_t size, std::vector<ByteRange>& ranges) {
+    ranges.clear();
+    size_t equals = value.find('=');
+    if (equals == std::string_view::npos || !equalsIgnoreCase(trim(value.substr(0, equals)), "bytes")) {
+        return RangeStatus::Ignored;
+    }
+    value.remove_prefix(equals + 1);
+    
+    size_t specs = 0;
+    while (true) {
+        size_t comma = value.find(',');
+        std::string_view spec = trim(value.substr(0, comma));
+        if (!spec.empty()) {
+            size_t dash = spec.find('-');
+            if (++specs > MAX_RANGES || dash == std::string_view::npos) {
+                return RangeStatus::Ignored;
+            }
+            std::string_view firstText = trim(spec.substr(0, dash));
+            std::string_view lastText = trim(spec.substr(dash + 1));
+            
+            uint64_t first, last = UINT64_MAX;
+            if (firstText.empty()) {
+                // Suffix range: the final n bytes
+                uint64_t suffix;
+                if (!parseNumber(lastText, suffix)) {
+                    return RangeStatus::Ignored;
+                }
+                if (suffix > 0 && size > 0) {
+                    ranges.push_back({size - std::min(suffix, size), std::min(suffix, size)});
+                }
+            } else {
+                if (!parseNumber(firstText, first) || (!lastText.empty() && !parseNumber(lastText, last)) ||
+                    last < first) {
+                    return RangeStatus::Ignored;
+                }
+                if (first < size) {
+                    ranges.push_back({first, std::min(last, size - 1) - first + 1});
+                }
+            }
+        }
+        if (comma == std::string_view::npos) break;
+        value.remove_prefix(comma + 1);
+    }
+    
+    if (specs == 0) {
+        return RangeStatus::Ignored;
+    }
+    if (ranges.empty()) {
+        return RangeStatus::Unsatisfiable;
+    }
+    
+    // Overlapping ranges are coalesced so no byte is sent twice; otherwise
+    // the parts keep the order the client asked for
+    std::vector<ByteRange> sorted = ranges;
+    std::sort(sorted.begin(), sorted.end(), [](const ByteRange& a, const ByteRange& b) {
+        return a.first < b.first;
+    });
+    bool overlapping = false;
+    for (size_t i = 1; i < sorted.size(); ++i) {
+        overlapping |= sorted[i].first < sorted[i - 1].first + sorted[i - 1].length;
+    }
+    if (overlapping) {
+        ranges.clear();
+        for (const ByteRange& range : sorted) {
+            if (!ranges.empty() && range.first <= ranges.back().first + ranges.back().length) {
+                uint64_t end = std::max(ranges.back().first + ranges.back().length, range.first + range.length);
+                ranges.back().length = end - ranges.back().first;
+            } else {
+                ranges.push_back(range);
+            }
+        }
+    }
+    return RangeStatus::Satisfiable;
+}
+
+// If-Range holds a strong ETag or the exact Last-Modified date; anything
+// else means the client's partial copy is stale and needs the whole body
+bool ifRangeMatches(std::string_view ifRange, std::string_view etag, time_t modified) {
+    if (ifRange.empty()) {
+        return true;
+    }
+    if (ifRange.front() == '"' || ifRange.starts_with("W/")) {
+        return ifRange == etag; // weak tags never match
+    }
+    time_t date;
+    return parseHttpDate(ifRange, date) && date == modified;
+}
+
+std::string contentRange(uint64_t first, uint64_t length, uint64_t size) {
+    return "bytes " + std::to_string(first) + "-" + std::to_string(first + length - 1) + "/" + std::to_string(size);
+}
+
+std::string multipartBoundary() {
+    thread_local std::mt19937_64 generator(std::random_device{}());
+    char buffer[32];
+    int length = snprintf(buffer, sizeof(buffer), "thermal-%016jx", static_cast<uintmax_t>(generator()));
+    return std::string(buffer, length);
+}
+
+// Cuts the ranges a GET asks for out of a whole identity body that is
+// already attached to response, as one cache buffer view or a file, without
+// copying. Returns false when the whole body should go out as a 200;
+// otherwise the 206/416 head is written up to where the validators follow.
+bool applyRange(const HttpRequest& request, std::string_view contentType, std::string_view etag, time_t modified,
+                Response& response) {
+    std::string_view range = request.header("Range");
+    if (range.empty() || request.method != "GET" || !ifRangeMatches(request.header("If-Range"), etag, modified)) {
+        return false;
+    }
+    
+    const uint64_t size = response.bodyLength();
+    std::vector<ByteRange> ranges;
+    switch (parseRanges(range, size, ranges)) {
+    case RangeStatus::Ignored:
+        return false;
+    case RangeStatus::Unsatisfiable:
+        response.dropBody();
+        response.head =
+            "HTTP/1.1 416 Range Not Satisfiable\r\n"
+            "Content-Range: bytes */" + std::to_string(size) + "\r\n"
+            "Content-Length: 0\r\n";
+        return true;
+    case RangeStatus::Satisfiable:
+        break;
+    }
+    
+    const bool inMemory = response.bodySegmentCount == 1;
+    const std::string_view whole = inMemory ? response.bodySegments[0] : std::string_view();
+    const off_t fileStart = response.fileOffset;
+    
+    if (ranges.size() == 1) {
+        // A single range is the plain zero-copy body, just shifted
+        const ByteRange& only = ranges.front();
+        if (inMemory) {
+            response.bodySegments[0] = whole.substr(only.first, only.length);
+        } else {
+            response.fileOffset = fileStart + only.first;
+            response.fileLength = only.length;
+        }
+        response.head =
+            "HTTP/1.1 206 Partial Content\r\n"
+            "Content-Type: " + std::string(contentType) + "\r\n"
+            "Content-Length: " + std::to_string(only.length) + "\r\n"
+            "Content-Range: " + contentRange(only.first, only.length, size) + "\r\n";
+        return true;
+    }
+    
+    const std::string boundary = multipartBoundary();
+    uint64_t contentLength = 0;
+    response.parts.reserve(ranges.size() + 1);
+    for (const ByteRange& part : ranges) {
+        Response::Part& added = response.parts.emplace_back();
+        added.headers = response.parts.size() == 1 ? "--" : "\r\n--";
+        added.headers += boundary;
+        added.headers += "\r\nContent-Type: ";
+        added.headers += contentType;
+        added.headers += "\r\nContent-Range: " + contentRange(part.first, part.length, size) + "\r\n\r\n";
+        if (inMemory) {
+            added.data = whole.substr(part.first, part.length);
+        } else {
+            added.fileOffset = fileStart + part.first;
+            added.fileLength = part.length;
+        }
+        contentLength += added.headers.size() + part.length;
+    }
+    response.parts.push_back({"\r\n--" + boundary + "--\r\n", {}, 0, 0});
+    contentLength += response.parts.back().headers.size();
+    
+    // The parts replace the whole body
+    response.bodySegmentCount = 0;
+    response.fileLength = 0;
+    response.head =
+        "HTTP/1.1 206 Partial Content\r\n"
+        "Content-Type: multipart/byteranges; boundary=" + boundary + "\r\n"
+        "Content-Length: " + std::to_string(contentLength) + "\r\n";
+    return true;
+}
+
+// 200 head for a whole representation, up to the Connection header
+std::string fullHead(const MimeType& type, size_t length, std::string_view validators, ContentEncoding encoding,
+                     bool vary) {
+    std::string head = okHead(type, length);
+    head += validators;
+    if (encoding == ContentEncoding::Identity) {
+        head += "Accept-Ranges: bytes\r\n";
+    } else {
+        head += "Content-Encoding: ";
+        head += encodingName(encoding);
+        head += "\r\n";
+    }
+    if (vary) {
+        head += "Vary: Accept-Encoding\r\n";
+    }
+    return head;
+}
+
+// Sends each new connection to the SO_REUSEPORT listener of the worker
+// pinned to the CPU that received it, so a connection's packets and its
+// event loop stay on one core. Listeners are indexed in the order they were
+// opened, which is worker order.
+bool attachCpuSteering(int listenSocket, const std::vector<int>& workerCpus) {
+    if (2 * workerCpus.size() + 3 > BPF_MAXINSNS) {
+        return false;
+    }
+    std::vector<sock_filter> program;
+    program.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU)));
+    for (size_t i = 0; i < workerCpus.size(); ++i) {
+        program.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, static_cast<uint32_t>(workerCpus[i]), 0, 1));
+        program.push_back(BPF_STMT(BPF_RET | BPF_K, static_cast<uint32_t>(i)));
+    }
+    // CPUs without a worker of their own spread over all of them
+    program.push_back(BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, static_cast<uint32_t>(workerCpus.size())));
+    program.push_back(BPF_STMT(BPF_RET | BPF_A, 0));
+    
+    sock_fprog filter{static_cast<unsigned short>(program.size()), program.data()};
+    if (setsockopt(listenSocket, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &filter, sizeof(filter)) < 0) {
+        std::cerr << "Connection steering unavailable: " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Adds the Connection header and the blank line that ends the head
+void finishHead(Response& response, bool keepAlive) {
+    response.keepAlive = keepAlive;
+    response.head += keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+}
+
+}
+
 // contructor, initializes startPath and watchMode
-Server::Server(const std::string& startPath, bool watchMode, int port) 
-    : startPath(startPath), watchMode(watchMode), port(port) {
+Server::Server(const std::string& startPath, bool watchMode, int port, const ServerOptions& options)
+    : startPath(startPath), watchMode(watchMode), port(port), options(options),
+      placements(options.pinWorkers ? workerPlacements(options.numaAware) : std::vector<CpuPlacement>()),
+      connectionLimiter(options.maxConnections, options.maxConnectionsPerIp),
+      sseHub(std::chrono::milliseconds(options.reloadDebounceMs),
+             [this](uint32_t address) { releaseConnection(address); }),
+      workPool(options.poolThreads ? options.poolThreads : std::max(1u, std::thread::hardware_concurrency()),
+               options.poolQueueLimit) {
     if (this->startPath.empty()) {
         this->startPath = "./";
     }
+    // Drop trailing slashes so startPath + "/" + file matches the paths the
+    // watcher reports, which the file cache is keyed by
+    while (this->startPath.size() > 1 && this->startPath.back() == '/') {
+        this->startPath.pop_back();
+    }
     std::cout << "Server initialized with start path: " << this->startPath << std::endl;
+    
+    // The log writer thread owns the descriptor for the life of the process
+    accesslog::Options logOptions;
+    logOptions.level = options.logLevel;
+    logOptions.sample = options.logSample;
+    if (!options.accessLogPath.empty() && options.logLevel != accesslog::Level::Off) {
+        logOptions.fd = open(options.accessLogPath.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (logOptions.fd < 0) {
+            std::cerr << "Cannot open access log " << options.accessLogPath << ": " << strerror(errno)
+                      << ", logging to stdout" << std::endl;
+            logOptions.fd = STDOUT_FILENO;
+        }
+    }
+    accesslog::start(logOptions);
     std::cout << "Port configured: " << this->port << std::endl;
+    
+    // Pinned workers spread over several NUMA nodes get a cache on their own
+    // node, so cached bytes never cross the interconnect; the budget is split
+    // between the nodes. Every other thread uses the first one.
+    std::vector<int> nodes;
+    if (options.numaAware && options.ioMode != IoMode::Thread && !placements.empty()) {
+        for (unsigned i = 0; i < workerCount(); ++i) {
+            const int node = placements[i % placements.size()].node;
+            auto it = std::find(nodes.begin(), nodes.end(), node);
+            workerCacheDomains.push_back(it - nodes.begin());
+            if (it == nodes.end()) {
+                nodes.push_back(node);
+            }
+        }
+    }
+    const size_t domainCount = std::max<size_t>(nodes.size(), 1);
+    for (size_t i = 0; i < domainCount; ++i) {
+        fileCaches.push_back(std::make_unique<FileCache>(options.cacheBytes / domainCount, options.maxCachedFileSize));
+    }
+    if (domainCount > 1) {
+        std::cout << "One file cache per NUMA node across " << domainCount << " nodes" << std::endl;
+    }
+    
+    if (watchMode && !sseHub.start()) {
+        std::cerr << "Hot reload notifications are unavailable" << std::endl;
+    }
 }
 
 // file change detection method
 void Server::startWatching() {
-    std::cout << "Watch mode is enabled" << std::endl;
+    std::cout << (watchMode ? "Watch mode is enabled" : "Indexing served files") << std::endl;
     
-    // Initial scan to populate fileTimestamps
+    // Initial scan to populate the file tree and the path index
     scanDirectory();
     
+    // Prefer kernel change notifications; poll the tree where they are unavailable
+    if (watchWithInotify()) {
+        return;
+    }
+    
+    std::cout << "Falling back to polling for file changes" << std::endl;
+    pathIndex.setLive();
     while (true) {
-        checkForChanges();
+        if (checkForChanges(startPath, scanThreads()) && watchMode) {
+            notifyClients();
+        }
+        recompressChangedFiles();
         std::this_thread::sleep_for(std::chrono::milliseconds(1500)); // Reduced from 1000ms to 1500ms
     }
 }
 
+bool Server::watchWithInotify() {
+    InotifyWatcher watcher;
+    if (!watcher.valid() || !watcher.watchTree(startPath)) {
+        return false;
+    }
+    std::cout << "Watching for changes with inotify" << std::endl;
+    
+    // Files may have changed between the initial scan and the watches going live
+    if (checkForChanges(startPath, scanThreads()) && watchMode) {
+        notifyClients();
+    }
+    pathIndex.setLive();
+    
+    std::vector<InotifyWatcher::Event> events;
+    while (watcher.waitForEvents(events)) {
+        bool changed = false;
+        for (const auto& event : events) {
+            switch (event.kind) {
+            case InotifyWatcher::Event::Kind::Modified:
+                changed |= recordFileChange(event.path);
+                break;
+            case InotifyWatcher::Event::Kind::Deleted:
+                changed |= recordFileDeletion(event.path);
+                break;
+            case InotifyWatcher::Event::Kind::DirectoryAdded:
+                // Anything created inside before the watch existed only shows up in a scan
+                // New directories are small, one thread lists them
+                changed |= checkForChanges(event.path, 1);
+                break;
+            case InotifyWatcher::Event::Kind::DirectoryRemoved:
+                changed |= recordDirectoryDeletion(event.path);
+                break;
+            case InotifyWatcher::Event::Kind::Overflow:
+                // Events were dropped; re-register watches and rescan to resync
+                std::cerr << "inotify queue overflowed, rescanning " << startPath << std::endl;
+                watcher.watchTree(startPath);
+                changed |= checkForChanges(startPath, scanThreads());
+                break;
+            }
+        }
+        
+        // One hot reload change set per batch of kernel events
+        if (changed && watchMode) {
+            notifyClients();
+        }
+        recompressChangedFiles();
+    }
+    
+    // The inotify descriptor failed mid-flight, the caller falls back to polling
+    return false;
+}
+
 // start server method
 void Server::startServer() {
     std::cout << "Server started at path: " << startPath << std::endl;
     
-    // Create socket
-    int listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (options.precompress) {
+        std::vector<std::string> paths;
+        std::error_code error;
+        fs::recursive_directory_iterator it(startPath, fs::directory_options::skip_permission_denied, error);
+        for (; !error && it != fs::recursive_directory_iterator(); it.increment(error)) {
+            if (it->is_regular_file(error) && !isIgnoredFile(it->path().filename().string())) {
+                paths.push_back(it->path().string());
+            }
+        }
+        
+        auto start = std::chrono::steady_clock::now();
+        precompressFiles(paths);
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        std::cout << "Precompressed " << paths.size() << " files in " << elapsed.count() << " ms" << std::endl;
+    }
+    
+    int listenSocket = createListenSocket();
     if (listenSocket < 0) {
-        std::cerr << "Error creating socket: " << strerror(errno) << std::endl;
         return;
     }
     
+    std::cout << "Server is running on http://localhost:" << port << std::endl;
+    std::cout << "Serving files from: " << startPath << std::endl; 
+    
+    // Try to open browser (Ubuntu-compatible)
+    std::string browserStart = "xdg-open http://localhost:" + std::to_string(port) + " 2>/dev/null &";  
+    system(browserStart.c_str());
+
+    if (options.ioMode != IoMode::Thread) {
+        runEventLoops(listenSocket);
+    } else {
+        runThreadPerConnection(listenSocket);
+    }
+    
+    close(listenSocket);
+}
+
+int Server::createListenSocket() {
+    // Create socket; the worker loops need it non-blocking so that a loop that
+    // loses the accept race gets EAGAIN instead of stalling
+    int socketType = SOCK_STREAM | SOCK_CLOEXEC;
+    if (options.ioMode != IoMode::Thread) {
+        socketType |= SOCK_NONBLOCK;
+    }
+    int listenSocket = socket(AF_INET, socketType, 0);
+    if (listenSocket < 0) {
+        std::cerr << "Error creating socket: " << strerror(errno) << std::endl;
+        return -1;
+    }
+    
     // Set socket options to reuse address
     int opt = 1;
     if (setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
         std::cerr << "Error setting socket options: " << strerror(errno) << std::endl;
         close(listenSocket);
-        return;
+        return -1;
+    }
+    
+    // Lets every worker loop bind a listener of its own to the same port
+    if (options.reusePort && options.ioMode != IoMode::Thread &&
+        setsockopt(listenSocket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        std::cerr << "Error enabling SO_REUSEPORT: " << strerror(errno) << std::endl;
+        close(listenSocket);
+        return -1;
     }
     
     // Setup address
@@ -66,318 +866,1025 @@ void Server::startServer() {
     if (bind(listenSocket, (struct sockaddr*)&service, sizeof(service)) < 0) {
         std::cerr << "Bind failed on port " << port << ": " << strerror(errno) << std::endl;
         close(listenSocket);
-        return;
+        return -1;
     }
     
     // Listen for connections
     if (listen(listenSocket, SOMAXCONN) < 0) {
         std::cerr << "Listen failed: " << strerror(errno) << std::endl;
         close(listenSocket);
-        return;
+        return -1;
     }
     
-    std::cout << "Server is running on http://localhost:" << port << std::endl;
-    std::cout << "Serving files from: " << startPath << std::endl; 
-    
-    // Try to open browser (Ubuntu-compatible)
-    std::string browserStart = "xdg-open http://localhost:" + std::to_string(port) + " 2>/dev/null &";  
-    system(browserStart.c_str());
+    return listenSocket;
+}
 
+void Server::runThreadPerConnection(int listenSocket) {
     // Accept connections
     while (true) {
-        int clientSocket = accept(listenSocket, NULL, NULL);
+        sockaddr_in peer{};
+        socklen_t peerLength = sizeof(peer);
+        int clientSocket = accept4(listenSocket, reinterpret_cast<sockaddr*>(&peer), &peerLength,
+                                   SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (clientSocket < 0) {
             std::cerr << "Accept failed: " << strerror(errno) << std::endl;
             continue;
         }
+        // Turned away before a thread is spent on it
+        const uint32_t address = peer.sin_addr.s_addr;
+        if (!admitConnection(clientSocket, address)) {
+            close(clientSocket);
+            continue;
+        }
         
         // Handle client in separate thread
-        std::thread([this, clientSocket]() {
-            handleClient(clientSocket);
+        std::thread([this, clientSocket, address, acceptedAt = metrics::now()]() {
+            metrics::record(metrics::Stage::Accept, acceptedAt);
+            handleClient(clientSocket, address);
         }).detach();
     }
-    
-    close(listenSocket);
 }
 
-void Server::checkForChanges() {
-    try {
-        // Check for modified or new files
-        for (const auto& entry : fs::recursive_directory_iterator(startPath)) {
-            if (entry.is_regular_file()) {
-                const std::string filePath = entry.path().string();
-                
-                // Quick optimization: Skip common temp files
-                const auto filename = entry.path().filename().string();
-                if (filename.starts_with(".") || 
-                    filename.ends_with(".tmp") || 
-                    filename.ends_with(".swp") ||
-                    filename.ends_with(".log")) {
-                    continue; // Skip temp/hidden files
-                }
-                
-                const auto lastWriteTime = entry.last_write_time();
-                
-                auto it = fileTimestamps.find(filePath);
-                if (it == fileTimestamps.end()) {
-                    // New file
-                    std::cout << "New file detected: " << filePath << std::endl;
-                    fileTimestamps[filePath] = lastWriteTime;
-                    if (watchMode) {
-                        notifyClients("reload");
-                    }
-                } else if (it->second != lastWriteTime) {
-                    // Modified file
-                    std::cout << "File modified: " << filePath << std::endl;
-                    it->second = lastWriteTime;
-                    if (watchMode) {
-                        notifyClients("reload");
-                    }
-                }
+void Server::runEventLoops(int listenSocket) {
+    // Every connection holds a descriptor, so lift the soft limit as far as
+    // the hard limit allows before taking on thousands of clients
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    
+    const unsigned count = workerCount();
+    
+    // With SO_REUSEPORT each loop accepts from a listener of its own and the
+    // kernel spreads connections over them, instead of every loop contending
+    // for one accept queue
+    std::vector<int> listenSockets{listenSocket};
+    while (options.reusePort && listenSockets.size() < count) {
+        int extraSocket = createListenSocket();
+        if (extraSocket < 0) {
+            for (size_t i = 1; i < listenSockets.size(); ++i) {
+                close(listenSockets[i]);
             }
+            return;
         }
-        
-        // Check for deleted files
-        auto it = fileTimestamps.begin();
-        while (it != fileTimestamps.end()) {
-            if (!fs::exists(it->first)) {
-                std::cout << "File deleted: " << it->first << std::endl;
-                if (watchMode) {
-                    notifyClients("reload");
-                }
-                it = fileTimestamps.erase(it);
-            } else {
-                ++it;
+        listenSockets.push_back(extraSocket);
+    }
+    
+    std::vector<int> workerCpus;
+    for (unsigned i = 0; i < count && !placements.empty(); ++i) {
+        workerCpus.push_back(placements[i % placements.size()].cpu);
+    }
+    const bool steered = options.reusePort && !workerCpus.empty() && attachCpuSteering(listenSocket, workerCpus);
+    
+    // io_uring needs a kernel with every operation the loop submits, and may
+    // be switched off by policy; epoll serves the same requests everywhere
+    const bool useUring = options.ioMode == IoMode::Uring && UringLoop::supported();
+    if (options.ioMode == IoMode::Uring && !useUring) {
+        std::cout << "io_uring is not available, falling back to epoll" << std::endl;
+    }
+    
+    std::vector<std::unique_ptr<EventLoop>> loops;
+    std::vector<std::unique_ptr<UringLoop>> uringLoops;
+    for (unsigned i = 0; i < count; ++i) {
+        workerStats.push_back(std::make_unique<WorkerStats>());
+        const int workerSocket = listenSockets[options.reusePort ? i : 0];
+        if (useUring) {
+            auto loop = std::make_unique<UringLoop>(*this, workerSocket, *workerStats.back());
+            if (!loop->valid()) {
+                return;
+            }
+            uringLoops.push_back(std::move(loop));
+        } else {
+            auto loop = std::make_unique<EventLoop>(*this, workerSocket, *workerStats.back());
+            if (!loop->valid()) {
+                return;
             }
+            loops.push_back(std::move(loop));
+        }
+    }
+    
+    std::cout << "Using " << (useUring ? "io_uring" : "epoll") << " I/O with " << count << " worker loops";
+    if (options.reusePort) {
+        std::cout << ", one SO_REUSEPORT listener each";
+    }
+    if (!workerCpus.empty()) {
+        std::cout << ", pinned to CPUs" << (steered ? " with connections steered by CPU" : "");
+    }
+    std::cout << std::endl;
+    
+    auto runLoop = [&](unsigned index) {
+        if (index < workerCpus.size() && pinCurrentThread(workerCpus[index])) {
+            workerStats[index]->cpu = workerCpus[index];
+        }
+        if (index < workerCacheDomains.size()) {
+            cacheDomain = workerCacheDomains[index];
         }
-    } catch (const std::exception& e) {
-        std::cerr << "Error checking for changes: " << e.what() << std::endl;
+        if (useUring) {
+            uringLoops[index]->run();
+        } else {
+            loops[index]->run();
+        }
+    };
+    
+    // The calling thread drives the first loop itself
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < count; ++i) {
+        workers.emplace_back(runLoop, i);
+    }
+    runLoop(0);
+    
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    for (size_t i = 1; i < listenSockets.size(); ++i) {
+        close(listenSockets[i]);
     }
 }
 
-void Server::scanDirectory() {
-    std::cout << "Scanning directory for initial file state..." << std::endl;
-    try {
-        for (const auto& entry : fs::recursive_directory_iterator(startPath)) {
-            if (entry.is_regular_file()) {
-                fileTimestamps[entry.path().string()] = entry.last_write_time();
-            }
+unsigned Server::workerCount() const {
+    if (options.workers > 0) {
+        return options.workers;
+    }
+    if (!placements.empty()) {
+        return static_cast<unsigned>(placements.size());
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+FileCache& Server::cache() {
+    return *fileCaches[cacheDomain];
+}
+
+FileCache::Stats Server::cacheStats() const {
+    FileCache::Stats total;
+    for (const auto& fileCache : fileCaches) {
+        const FileCache::Stats stats = fileCache->stats();
+        total.hits += stats.hits;
+        total.misses += stats.misses;
+        total.evictions += stats.evictions;
+        total.invalidations += stats.invalidations;
+        total.entries += stats.entries;
+        total.bytes += stats.bytes;
+    }
+    return total;
+}
+
+bool Server::checkForChanges(const std::string& directory, unsigned threads) {
+    const uint64_t startedAt = metrics::now();
+    const TreeChanges changes = fileTree.scan(directory, threads);
+    metrics::record(metrics::Stage::Scan, startedAt);
+    
+    // Changed files are few, so they are looked up again rather than found in the scan
+    bool changed = !changes.added.empty() || !changes.deleted.empty();
+    struct stat fileStat;
+    for (const std::string& filePath : changes.added) {
+        accesslog::message(accesslog::Level::Info, "New file detected: " + filePath);
+        if (stat(filePath.c_str(), &fileStat) == 0 && S_ISREG(fileStat.st_mode)) {
+            indexFile(filePath, fileStat);
+        }
+        invalidateFile(filePath);
+        notePageChange(filePath, false);
+    }
+    for (const std::string& filePath : changes.modified) {
+        if (stat(filePath.c_str(), &fileStat) == 0 && S_ISREG(fileStat.st_mode)) {
+            indexFile(filePath, fileStat);
         }
-        std::cout << "Found " << fileTimestamps.size() << " files to monitor" << std::endl;
-    } catch (const std::exception& e) {
-        std::cerr << "Error scanning directory: " << e.what() << std::endl;
+        if (!contentChanged(filePath)) {
+            accesslog::message(accesslog::Level::Info, "File touched, content unchanged: " + filePath);
+            continue;
+        }
+        accesslog::message(accesslog::Level::Info, "File modified: " + filePath);
+        invalidateFile(filePath);
+        notePageChange(filePath, false);
+        changed = true;
     }
+    for (const std::string& filePath : changes.deleted) {
+        accesslog::message(accesslog::Level::Info, "File deleted: " + filePath);
+        unindexFile(filePath);
+        evictFile(filePath);
+        notePageChange(filePath, true);
+    }
+    return changed;
 }
 
-void Server::notifyClients(const std::string& message) {
-    std::lock_guard<std::mutex> lock(sseClientsMutex);
-    std::string sseMessage = "data: " + message + "\n\n";
+bool Server::recordFileChange(const std::string& filePath) {
+    if (isIgnoredFile(fs::path(filePath).filename().string())) {
+        return false;
+    }
     
-    auto it = sseClients.begin();
-    while (it != sseClients.end()) {
-        ssize_t result = send(*it, sseMessage.c_str(), sseMessage.length(), 0);
-        if (result < 0) {
-            // Client disconnected, remove from list
-            close(*it);
-            it = sseClients.erase(it);
-        } else {
-            ++it;
+    struct stat fileStat;
+    if (stat(filePath.c_str(), &fileStat) < 0 || !S_ISREG(fileStat.st_mode)) {
+        return false; // already gone again, its deletion event follows
+    }
+    
+    const bool added = fileTree.update(filePath, {fileStat.st_ino, fileStat.st_size, fileStat.st_mtim});
+    indexFile(filePath, fileStat);
+    if (added) {
+        accesslog::message(accesslog::Level::Info, "New file detected: " + filePath);
+    } else if (contentChanged(filePath)) {
+        accesslog::message(accesslog::Level::Info, "File modified: " + filePath);
+    } else {
+        accesslog::message(accesslog::Level::Info, "File touched, content unchanged: " + filePath);
+        return false;
+    }
+    invalidateFile(filePath);
+    notePageChange(filePath, false);
+    return true;
+}
+
+bool Server::recordFileDeletion(const std::string& filePath) {
+    if (!fileTree.remove(filePath)) {
+        return false;
+    }
+    accesslog::message(accesslog::Level::Info, "File deleted: " + filePath);
+    unindexFile(filePath);
+    evictFile(filePath);
+    notePageChange(filePath, true);
+    return true;
+}
+
+bool Server::recordDirectoryDeletion(const std::string& directory) {
+    const std::vector<std::string> deleted = fileTree.removeDirectory(directory);
+    for (const std::string& filePath : deleted) {
+        accesslog::message(accesslog::Level::Info, "File deleted: " + filePath);
+        unindexFile(filePath);
+        evictFile(filePath);
+        notePageChange(filePath, true);
+    }
+    return !deleted.empty();
+}
+
+bool Server::contentChanged(const std::string& filePath) {
+    // Only reached once mtime, size or inode moved, so a file is read here
+    // at most once per change
+    UniqueFd file(open(filePath.c_str(), O_RDONLY | O_CLOEXEC));
+    struct stat fileStat;
+    uint64_t hash;
+    if (!file || fstat(file.get(), &fileStat) < 0 || fileStat.st_size > MAX_HASHED_SIZE ||
+        !hashFile(file.get(), hash)) {
+        return true;
+    }
+    
+    // Until the watcher has hashed a file, a cached copy can stand in for
+    // the old bytes, but only one whose inode, size or mtime differ from the
+    // file's now. A request after the write, or a refetch after eviction,
+    // caches the new bytes before the watcher gets here, and that copy would
+    // hide the change.
+    uint64_t previous = fileTree.contentHash(filePath);
+    for (size_t i = 0; i < fileCaches.size() && previous == 0; ++i) {
+        for (size_t variant : {size_t{0}, HOT_RELOAD_VARIANT}) {
+            auto cached = fileCaches[i]->peek(filePath, variant);
+            if (cached && (cached->inode != fileStat.st_ino || cached->size != fileStat.st_size ||
+                           cached->modified.tv_sec != fileStat.st_mtim.tv_sec ||
+                           cached->modified.tv_nsec != fileStat.st_mtim.tv_nsec)) {
+                previous = cached->contentHash;
+                break;
+            }
         }
     }
+    fileTree.setContentHash(filePath, hash);
+    return previous == 0 || previous != hash;
+}
+
+void Server::indexFile(const std::string& filePath, const struct stat& fileStat) {
+    // The index is keyed like request paths, relative to startPath
+    if (filePath.size() <= startPath.size() + 1) {
+        return;
+    }
+    const std::string_view relative = std::string_view(filePath).substr(startPath.size() + 1);
+    pathIndex.update(relative, {fileStat.st_ino, fileStat.st_size, fileStat.st_mtim, &mimeTypeFor(relative)});
+}
+
+void Server::unindexFile(const std::string& filePath) {
+    if (filePath.size() > startPath.size() + 1) {
+        pathIndex.remove(std::string_view(filePath).substr(startPath.size() + 1));
+    }
+}
+
+void Server::evictFile(const std::string& filePath) {
+    // Drops the identity bytes and every compressed variant in one go, from
+    // the cache of every node
+    for (auto& fileCache : fileCaches) {
+        fileCache->invalidate(filePath);
+    }
+}
+
+void Server::invalidateFile(const std::string& filePath) {
+    evictFile(filePath);
+    if (options.precompress) {
+        recompressQueue.push_back(filePath);
+    }
+}
+
+void Server::recompressChangedFiles() {
+    // Runs after the reload went out; a request that beats it compresses
+    // the new bytes at the fast level, which this then upgrades
+    if (!recompressQueue.empty()) {
+        precompressFiles(recompressQueue);
+        recompressQueue.clear();
+    }
+}
+
+void Server::scanDirectory() {
+    std::cout << "Scanning directory for initial file state..." << std::endl;
+    const uint64_t startedAt = metrics::now();
+    fileTree.build(startPath, scanThreads());
+    fileTree.forEach([this](const std::string& filePath, const FileState& state) {
+        const std::string_view relative = std::string_view(filePath).substr(startPath.size() + 1);
+        pathIndex.update(relative, {state.inode, state.size, state.modified, &mimeTypeFor(relative)});
+    });
+    metrics::record(metrics::Stage::Scan, startedAt);
+    std::cout << "Found " << fileTree.size() << " files to monitor" << std::endl;
+}
+
+void Server::notePageChange(const std::string& filePath, bool deleted) {
+    if (!watchMode || filePath.size() <= startPath.size() + 1) {
+        return;
+    }
+    // Stylesheets and images can be swapped into a page in place; anything
+    // else may change what the page is, so it reloads
+    const std::string_view relative = std::string_view(filePath).substr(startPath.size() + 1);
+    const std::string_view contentType = mimeTypeFor(relative).contentType;
+    const bool hotSwappable = !deleted && (contentType.starts_with("text/css") || contentType.starts_with("image/"));
+    pageChanges.push_back({"/" + std::string(relative), hotSwappable});
+}
+
+void Server::notifyClients() {
+    // Debounced and written by the hub's own thread, so the watcher never
+    // waits on a browser
+    for (const SseHub::Change& change : pageChanges) {
+        sseHub.publish(change);
+    }
+    pageChanges.clear();
 }
 
-void Server::handleClient(int clientSocket) {
+void Server::handleClient(int clientSocket, uint32_t address) {
+    metrics::countConnectionOpened();
+    
+    // The socket is non-blocking: every wait is a poll() bounded by the
+    // deadline of the phase the connection is in, so a client trickling its
+    // request or not reading its response cannot hold the thread
+    std::string input;
+    HttpParser parser;
+    unsigned requestsServed = 0;
     char buffer[4096];
-    ssize_t bytesReceived = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
+    RequestArena arena;
+    RequestArena::Scope arenaScope(arena);
+    const PhaseTimeouts timeouts = phaseTimeouts();
+    ConnectionTimes times;
+    times.requestStarted = times.lastWrite = ConnectionTimes::Clock::now();
     
-    if (bytesReceived > 0) {
-        buffer[bytesReceived] = '\0';
-        std::string request(buffer);
-        
-        // Parse HTTP request
-        std::istringstream iss(request);
-        std::string method, path, version;
-        iss >> method >> path >> version;
-        
-        std::cout << "Request: " << method << " " << path << std::endl;
-        
-        // Handle SSE endpoint for hot reload
-        if (path == "/sse") {
-            handleSSE(clientSocket);
-            return; // Don't close socket, keep for SSE
+    while (true) {
+        const Deadline deadline = times.deadline(timeouts, false, input.empty() && requestsServed > 0,
+                                                 parser.headComplete());
+        if (!waitUntil(clientSocket, POLLIN, deadline.at)) {
+            metrics::countTimeout(deadline.phase);
+            break;
         }
+        ssize_t bytesReceived = recv(clientSocket, buffer, sizeof(buffer), 0);
+        if (bytesReceived < 0 && (errno == EAGAIN || errno == EINTR)) {
+            continue;
+        }
+        if (bytesReceived <= 0) {
+            break; // peer closed or error
+        }
+        if (input.empty() && requestsServed > 0) {
+            times.requestStarted = ConnectionTimes::Clock::now(); // the next request after an idle spell
+        }
+        input.append(buffer, bytesReceived);
         
-        // Remove leading slash and decode path
-        if (path == "/") {
-            path = "/index.html";
+        // Answer every complete request in the buffer, in order (pipelining)
+        bool keepAlive = true;
+        size_t consumed;
+        Response response;
+        while (keepAlive && (consumed = handleRequest(input, parser, requestsServed, response)) > 0) {
+            input.erase(0, consumed);
+            ++requestsServed;
+            times.bodyStarted = {};
+            
+            if (response.sse) {
+                metrics::countConnectionClosed();
+                handleSSE(clientSocket, response.lastEventId, address);
+                return; // Don't close socket, keep for SSE
+            }
+            
+            // A partial write leaves its progress in the response, and the
+            // next call resumes there once the socket drains
+            times.lastWrite = ConnectionTimes::Clock::now();
+            WriteStatus status;
+            uint64_t sentBefore = response.bytesSent;
+            while ((status = writeResponse(clientSocket, response)) == WriteStatus::WouldBlock) {
+                if (response.bytesSent != sentBefore) {
+                    times.lastWrite = ConnectionTimes::Clock::now();
+                    sentBefore = response.bytesSent;
+                }
+                if (!waitUntil(clientSocket, POLLOUT, times.deadline(timeouts, true, false, false).at)) {
+                    metrics::countTimeout(metrics::Timeout::Send);
+                    response.finishLog(); // cut off part way
+                    break;
+                }
+            }
+            keepAlive = status == WriteStatus::Complete && response.keepAlive;
+            response = Response();
+            arena.reset(); // the fresh response holds nothing from it
+            times.requestStarted = times.lastWrite = ConnectionTimes::Clock::now();
+        }
+        if (parser.headComplete() && times.bodyStarted == ConnectionTimes::Clock::time_point()) {
+            times.bodyStarted = ConnectionTimes::Clock::now();
         }
-        path = path.substr(1); // Remove leading slash
         
-        // Serve file
-        serveFile(clientSocket, path);
+        if (!keepAlive) {
+            break;
+        }
     }
     
     close(clientSocket);
+    releaseConnection(address);
+    metrics::countConnectionClosed();
 }
 
-void Server::handleSSE(int clientSocket) {
-    // Send SSE headers
-    std::string headers = 
-        "HTTP/1.1 200 OK\r\n"
-        "Content-Type: text/event-stream\r\n"
-        "Cache-Control: no-cache\r\n"
-        "Connection: keep-alive\r\n"
-        "Access-Control-Allow-Origin: *\r\n"
-        "\r\n";
-    send(clientSocket, headers.c_str(), headers.length(), 0);
+size_t Server::handleRequest(std::span<char> input, HttpParser& parser, unsigned requestsServed,
+                             Response& response, bool mayDefer) {
+    HttpRequest request;
+    const uint64_t parseStartedAt = metrics::now();
+    switch (parser.parse(input, request)) {
+    case HttpParser::Status::Incomplete:
+        return 0;
+    case HttpParser::Status::Error:
+        // Framing is lost after a malformed request, so the connection ends here
+        response = errorResponse(statusLine(parser.errorStatus()));
+        finishHead(response, false);
+        metrics::countStatus(statusOf(response.head));
+        response.receivedAt = parseStartedAt;
+        if (markForLog(response)) {
+            accesslog::describe(response.log, {}, {});
+        }
+        parser.reset();
+        return input.size();
+    case HttpParser::Status::Complete:
+        metrics::record(metrics::Stage::Parse, parseStartedAt);
+        break;
+    }
+    size_t requestLength = parser.requestLength();
+    parser.reset();
     
-    // Add client to SSE list
-    {
-        std::lock_guard<std::mutex> lock(sseClientsMutex);
-        sseClients.push_back(clientSocket);
+    // HTTP/1.1 is persistent unless the client opts out, HTTP/1.0 only on request
+    std::string_view connection = request.header("Connection");
+    bool keepAlive = request.version == "HTTP/1.1" ? !containsToken(connection, "close")
+                                                  : containsToken(connection, "keep-alive");
+    keepAlive = keepAlive && options.keepAliveTimeout > 0 &&
+        requestsServed + 1 < options.maxRequestsPerConnection;
+    
+    // Handle SSE endpoint for hot reload
+    if (request.path == "/sse") {
+        response.sse = true;
+        // EventSource sends the id of the last event it saw when it reconnects
+        std::string_view lastEventId = request.header("Last-Event-ID");
+        std::from_chars(lastEventId.data(), lastEventId.data() + lastEventId.size(), response.lastEventId);
+        return requestLength;
     }
     
-    std::cout << "SSE client connected for hot reload" << std::endl;
+    std::pmr::string path(RequestArena::current());
+    if (request.path == METRICS_PATH) {
+        response = metricsResponse();
+    } else if (!normalizePath(request.path, path)) {
+        // ".." past the root, never looked up
+        response = errorResponse("400 Bad Request");
+    } else {
+        if (path.empty()) {
+            path = "index.html";
+        }
+        
+        // Serve file
+        response = serveFile(path, request, mayDefer);
+        if (response.blockingWork) {
+            // Kept for the 503 offload() answers when the pool is full
+            if (accesslog::enabled(accesslog::Level::Error)) {
+                response.receivedAt = parseStartedAt;
+                accesslog::describe(response.log, request.method, request.path);
+            }
+            return requestLength; // answered once the work is done
+        }
+    }
     
-    // Keep connection alive (it will be closed when client disconnects or on error)
+    // HEAD gets the same headers without a body
+    if (request.method == "HEAD") {
+        response.dropBody();
+    }
+    
+    if (keepAlive) {
+        unsigned remaining = options.maxRequestsPerConnection - requestsServed - 1;
+        char keepAliveHeader[64];
+        const int length = snprintf(keepAliveHeader, sizeof(keepAliveHeader), "Keep-Alive: timeout=%d, max=%u\r\n",
+                                    options.keepAliveTimeout, remaining);
+        response.head.append(keepAliveHeader, length);
+    }
+    finishHead(response, keepAlive);
+    metrics::countStatus(statusOf(response.head));
+    response.receivedAt = parseStartedAt;
+    if (markForLog(response)) {
+        accesslog::describe(response.log, request.method, request.path);
+    }
+    return requestLength;
 }
 
-void Server::serveFile(int clientSocket, const std::string& requestedPath) {
-    std::string fullPath = startPath + "/" + requestedPath;
+Response Server::metricsResponse() {
+    Response response;
+    metrics::appendSnapshot(response.body, metrics::snapshot());
     
-    // Check if file exists and is within served directory
-    if (!fs::exists(fullPath) || !fs::is_regular_file(fullPath)) {
-        // File not found - serve 404
-        std::string response = 
-        "HTTP/1.1 404 Not Found\r\n"
-        "Content-Type: text/html\r\n"
-        "Content-Length: 44\r\n"
-        "\r\n"
-        "<html><body><h1>404 Not Found</h1></body></html>";
-        send(clientSocket, response.c_str(), response.length(), 0);
-        return;
+    // Gauges owned by other components, read as they stand
+    const SseHub::Stats sse = sseHub.stats();
+    metrics::appendMetric(response.body, "thermal_sse_subscribers", "gauge", "Hot reload streams connected",
+                          sse.clients);
+    metrics::appendMetric(response.body, "thermal_sse_broadcasts_total", "counter", "Hot reload events sent",
+                          sse.broadcasts);
+    metrics::appendMetric(response.body, "thermal_sse_replays_total", "counter",
+                          "Reconnected streams sent only the events they missed", sse.replays);
+    const FileCache::Stats cache = cacheStats();
+    metrics::appendMetric(response.body, "thermal_cache_hits_total", "counter", "File cache hits", cache.hits);
+    metrics::appendMetric(response.body, "thermal_cache_misses_total", "counter", "File cache misses",
+                          cache.misses);
+    metrics::appendMetric(response.body, "thermal_cache_bytes", "gauge", "Bytes held by the file cache",
+                          cache.bytes);
+    metrics::appendMetric(response.body, "thermal_path_index_files", "gauge", "Files known to the path index",
+                          pathIndex.size());
+    const WorkPool::Stats pool = workPool.stats();
+    metrics::appendMetric(response.body, "thermal_pool_queued", "gauge", "Blocking tasks waiting for the pool",
+                          pool.queued + pool.local);
+    metrics::appendMetric(response.body, "thermal_pool_rejected_total", "counter",
+                          "Blocking tasks turned away with 503", pool.rejected);
+    metrics::appendMetric(response.body, "thermal_connections_rejected_total", "counter",
+                          "Connections turned away with 503 over a connection cap", connectionLimiter.rejected());
+    
+    response.head =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+        "Content-Length: " + std::to_string(response.body.size()) + "\r\n"
+        "Cache-Control: no-store\r\n";
+    return response;
+}
+
+bool Server::admitConnection(int clientSocket, uint32_t address) {
+    if (connectionLimiter.tryAcquire(address)) {
+        return true;
+    }
+    // One attempt that never blocks; a client that cannot take it is closed all the same
+    [[maybe_unused]] ssize_t result = send(clientSocket, OVER_CAPACITY_RESPONSE.data(), OVER_CAPACITY_RESPONSE.size(),
+                                           MSG_DONTWAIT | MSG_NOSIGNAL);
+    metrics::countStatus(503);
+    return false;
+}
+
+PhaseTimeouts Server::phaseTimeouts() const {
+    PhaseTimeouts timeouts;
+    timeouts.idle = std::chrono::seconds(options.keepAliveTimeout);
+    timeouts.header = std::chrono::seconds(options.headerTimeout);
+    timeouts.body = std::chrono::seconds(options.bodyTimeout);
+    timeouts.send = std::chrono::seconds(options.sendTimeout);
+    return timeouts;
+}
+
+void Server::handleSSE(int clientSocket, uint64_t lastEventId, uint32_t address) {
+    // The hub sends the stream head and owns the socket from here on
+    sseHub.subscribe(clientSocket, lastEventId, address);
+}
+
+bool Server::offload(Response& response, std::function<void()> onDone) {
+    // The work fills the cache of the node the submitting loop runs on
+    auto work = [this, domain = cacheDomain, blockingWork = std::move(response.blockingWork),
+                 onDone = std::move(onDone)]() {
+        cacheDomain = domain;
+        blockingWork();
+        cacheDomain = 0;
+        onDone();
+    };
+    if (workPool.trySubmit(std::move(work))) {
+        return true;
     }
     
-    // Read file content
-    std::ifstream file(fullPath, std::ios::binary);
-    if (!file.is_open()) {
-        // Error reading file
-        std::string response = 
-        "HTTP/1.1 500 Internal Server Error\r\n"
-        "Content-Type: text/html\r\n"
-        "Content-Length: 58\r\n"
-        "\r\n"
-        "<html><body><h1>500 Internal Server Error</h1></body></html>";
-        send(clientSocket, response.c_str(), response.length(), 0);
-        return;
+    // Queueing without bound would only trade latency for memory; tell the
+    // client to come back instead, and warn at most every few seconds
+    const int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t last = lastSheddingReport.load(std::memory_order_relaxed);
+    if (now - last >= SHEDDING_REPORT_INTERVAL_S &&
+        lastSheddingReport.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+        const WorkPool::Stats stats = workPool.stats();
+        std::cerr << "Work pool saturated (" << stats.queued << " queued, " << stats.local
+                  << " in worker deques, " << stats.stolen << " stolen), answering 503" << std::endl;
+    }
+    const accesslog::Entry log = response.log;
+    const uint64_t receivedAt = response.receivedAt;
+    response = errorResponse("503 Service Unavailable");
+    response.head += "Retry-After: 1\r\n";
+    finishHead(response, false);
+    metrics::countStatus(503);
+    response.log = log;
+    response.receivedAt = receivedAt;
+    markForLog(response);
+    return false;
+}
+
+Response Server::serveFile(std::string_view requestedPath, const HttpRequest& request, bool mayDefer) {
+    // Once the watcher keeps the index current a missing file costs no system
+    // call. Ignored names such as dotfiles are not indexed, so they are
+    // still looked for on disk.
+    IndexedFile indexed;
+    const PathIndex::Lookup lookup = pathIndex.find(requestedPath, &indexed);
+    if (lookup == PathIndex::Lookup::Missing &&
+        !isIgnoredFile(requestedPath.substr(requestedPath.find_last_of('/') + 1))) {
+        return errorResponse("404 Not Found");
     }
     
-    // Get file size
-    file.seekg(0, std::ios::end);
-    size_t fileSize = file.tellg();
-    file.seekg(0, std::ios::beg);
+    // The cache is keyed by full path; built in the connection's arena, a hit allocates nothing
+    std::pmr::string cacheKey(RequestArena::current());
+    cacheKey.reserve(startPath.size() + 1 + requestedPath.size());
+    cacheKey.append(startPath).append(1, '/').append(requestedPath);
+    Response response;
     
     // Determine content type
-    std::string contentType = getContentType(requestedPath);
+    const MimeType& mimeType = lookup == PathIndex::Lookup::Found ? *indexed.mimeType : mimeTypeFor(requestedPath);
+    const std::string_view contentType = mimeType.contentType;
+    const bool injectHotReload = watchMode && contentType.starts_with("text/html");
     
-    // For HTML files, inject hot reload script if in watch mode
-    if (watchMode && (contentType == "text/html")) {
-        serveHTMLWithHotReload(clientSocket, fullPath);
-        return;
+    // Text responses depend on Accept-Encoding, even when sent uncompressed.
+    // Range requests always get the identity bytes, the only ones ranges
+    // are served from.
+    const bool vary = !injectHotReload && isCompressible(contentType);
+    AcceptedEncodings accepted;
+    if (vary && request.header("Range").empty()) {
+        accepted = negotiateEncodings(request.header("Accept-Encoding"));
+    }
+    
+    // Cached bytes are trusted while the watcher invalidates them on change;
+    // without it a single stat() confirms the file is still the same
+    const bool watched = pathIndex.live();
+    uint64_t cacheGeneration = 0;
+    std::shared_ptr<const CachedFile> identity;
+    const uint64_t lookupStartedAt = metrics::now();
+    if (cache().enabled() && injectHotReload) {
+        // The watcher drops the page when the file changes
+        auto page = cache().find(cacheKey, &cacheGeneration, HOT_RELOAD_VARIANT);
+        metrics::record(metrics::Stage::CacheLookup, lookupStartedAt);
+        if (page) {
+            return hotReloadResponse(std::move(page), request);
+        }
+    } else if (cache().enabled()) {
+        for (size_t i = 0; i < accepted.count; ++i) {
+            const ContentEncoding encoding = accepted.encodings[i];
+            if (auto cached = cache().find(cacheKey, &cacheGeneration, static_cast<size_t>(encoding))) {
+                if (watched || isUnchanged(cacheKey.c_str(), *cached)) {
+                    metrics::record(metrics::Stage::CacheLookup, lookupStartedAt);
+                    return cachedResponse(std::move(cached), encoding, request);
+                }
+                cache().invalidate(cacheKey);
+                break;
+            }
+        }
+    
+        identity = cache().find(cacheKey, &cacheGeneration);
+        if (identity && !watched && !isUnchanged(cacheKey.c_str(), *identity)) {
+            cache().invalidate(cacheKey);
+            identity = cache().find(cacheKey, &cacheGeneration);
+        }
+        metrics::record(metrics::Stage::CacheLookup, lookupStartedAt);
+    }
+    
+    // Past the cached answers the path goes into cache entries and blocking work
+    const std::string fullPath(cacheKey);
+    
+    UniqueFd file;
+    struct stat fileStat{};
+    if (!identity) {
+        // Open file; writeResponse sends the body straight from the descriptor.
+        // The path is normalized, so it cannot leave the served directory.
+        file.reset(open(fullPath.c_str(), O_RDONLY | O_CLOEXEC));
+        if (!file) {
+            return errorResponse(errno == ENOENT || errno == ENOTDIR ? "404 Not Found"
+                                                                     : "500 Internal Server Error");
+        }
+        if (fstat(file.get(), &fileStat) < 0) {
+            // Error reading file
+            return errorResponse("500 Internal Server Error");
+        }
+        if (!S_ISREG(fileStat.st_mode)) {
+            return errorResponse("404 Not Found");
+        }
+    
+        // For HTML files, inject hot reload script if in watch mode
+        if (injectHotReload) {
+            if (mayDefer && cache().enabled()) {
+                response.blockingWork = [this, fullPath, fd = std::make_shared<UniqueFd>(std::move(file)), fileStat,
+                                         &mimeType, cacheGeneration]() {
+                    loadHotReloadPage(fullPath, fd->get(), fileStat, mimeType, cacheGeneration);
+                };
+                return response;
+            }
+            auto page = loadHotReloadPage(fullPath, file.get(), fileStat, mimeType, cacheGeneration);
+            if (!page) {
+                return errorResponse("500 Internal Server Error");
+            }
+            return hotReloadResponse(std::move(page), request);
+        }
+    }
+    
+    // A .br/.gz sibling on disk beats compressing the file ourselves
+    const timespec& modified = identity ? identity->modified : fileStat.st_mtim;
+    for (size_t i = 0; i < accepted.count; ++i) {
+        if (precompressedResponse(fullPath, accepted.encodings[i], mimeType, modified, request, response)) {
+            return response;
+        }
+    }
+    
+    // Small files are read once and then served from memory. Reading one
+    // blocks, so a worker loop has the pool do it and then asks again.
+    const bool cacheable = cache().enabled() && static_cast<size_t>(fileStat.st_size) <= cache().maxEntrySize();
+    if (!identity && cacheable && mayDefer) {
+        response.blockingWork = [this, fullPath, fd = std::make_shared<UniqueFd>(std::move(file)), fileStat,
+                                 &mimeType, cacheGeneration, accepted]() {
+            auto loaded = loadFile(fullPath, fd->get(), fileStat, mimeType, cacheGeneration);
+            if (loaded && loaded->content.size() >= MIN_COMPRESSIBLE_SIZE) {
+                for (size_t i = 0; i < accepted.count; ++i) {
+                    if (canCompress(accepted.encodings[i])) {
+                        compressVariant(fullPath, *loaded, accepted.encodings[i], CompressionLevel::Fast,
+                                        cacheGeneration);
+                        break;
+                    }
+                }
+            }
+        };
+        return response;
+    }
+    if (!identity && cacheable) {
+        identity = loadFile(fullPath, file.get(), fileStat, mimeType, cacheGeneration);
     }
     
-    // Send HTTP headers
-    std::string headers = 
-    "HTTP/1.1 200 OK\r\n"
-    "Content-Type: " + contentType + "\r\n"
-    "Content-Length: " + std::to_string(fileSize) + "\r\n"
-    "\r\n";
-    send(clientSocket, headers.c_str(), headers.length(), 0);
+    if (identity) {
+        // Compress once with the best coding we can produce; the variant is
+        // cached next to the identity bytes and dropped along with them
+        if (identity->content.size() >= MIN_COMPRESSIBLE_SIZE) {
+            for (size_t i = 0; i < accepted.count; ++i) {
+                const ContentEncoding encoding = accepted.encodings[i];
+                if (!canCompress(encoding)) continue;
+                if (mayDefer) {
+                    response.blockingWork = [this, fullPath, identity, encoding, cacheGeneration]() {
+                        compressVariant(fullPath, *identity, encoding, CompressionLevel::Fast, cacheGeneration);
+                    };
+                    return response;
+                }
+                if (auto compressed = compressVariant(fullPath, *identity, encoding, CompressionLevel::Fast,
+                                                      cacheGeneration)) {
+                    return cachedResponse(std::move(compressed), encoding, request);
+                }
+                break;
+            }
+        }
+        return cachedResponse(std::move(identity), ContentEncoding::Identity, request);
+    }
     
-    // Send file content
-    char fileBuffer[4096];
-    while (file.read(fileBuffer, sizeof(fileBuffer)) || file.gcount() > 0) {
-        send(clientSocket, fileBuffer, file.gcount(), 0);
+    const std::string etag = makeETag(fileStat.st_ino, fileStat.st_size, fileStat.st_mtim);
+    const std::string validators = validatorHeaders(etag, fileStat.st_mtim.tv_sec, cacheControl(fullPath));
+    if (isNotModified(request, etag, fileStat.st_mtim.tv_sec)) {
+        return notModifiedResponse(validators, vary);
     }
     
-    file.close();
+    size_t fileSize = fileStat.st_size;
+    response.file = std::move(file);
+    response.fileLength = fileSize;
+    response.bufferedFile = !options.sendfile;
+    
+    // HTTP headers
+    if (!applyRange(request, contentType, etag, fileStat.st_mtim.tv_sec, response)) {
+        response.head = fullHead(mimeType, fileSize, validators, ContentEncoding::Identity, vary);
+        return response;
+    }
+    response.head += validators;
+    response.head += "Accept-Ranges: bytes\r\n";
+    if (vary) {
+        response.head += "Vary: Accept-Encoding\r\n";
+    }
+    return response;
 }
 
-void Server::serveHTMLWithHotReload(int clientSocket, const std::string& fullPath) {
-    std::ifstream file(fullPath);
-    if (!file.is_open()) {
-        std::string response = 
-            "HTTP/1.1 500 Internal Server Error\r\n"
-            "Content-Type: text/html\r\n"
-            "Content-Length: 58\r\n"
-            "\r\n"
-            "<html><body><h1>500 Internal Server Error</h1></body></html>";
-        send(clientSocket, response.c_str(), response.length(), 0);
+Response Server::cachedResponse(std::shared_ptr<const CachedFile> cached, ContentEncoding encoding,
+                                const HttpRequest& request) {
+    // Compressible types are negotiated, so their cached heads carry Vary
+    const bool vary = isCompressible(cached->mimeType->contentType);
+    if (isNotModified(request, cached->etag, cached->modified.tv_sec)) {
+        return notModifiedResponse(cached->validators, vary);
+    }
+    
+    // The body is sent straight from the shared cache buffer
+    Response response;
+    response.addBodySegment(cached->content);
+    
+    // Ranges are only served from the identity bytes
+    if (encoding == ContentEncoding::Identity &&
+        applyRange(request, cached->mimeType->contentType, cached->etag, cached->modified.tv_sec, response)) {
+        response.head += cached->validators;
+        response.head += "Accept-Ranges: bytes\r\n";
+        if (vary) {
+            response.head += "Vary: Accept-Encoding\r\n";
+        }
+    } else {
+        // Everything up to the Connection header was built when the file was cached
+        response.head = cached->head;
+    }
+    response.bodyOwner = std::move(cached);
+    return response;
+}
+
+bool Server::precompressedResponse(const std::string& fullPath, ContentEncoding encoding,
+                                   const MimeType& mimeType, const timespec& modified,
+                                   const HttpRequest& request, Response& response) {
+    struct stat siblingStat;
+    UniqueFd sibling = openPrecompressed(fullPath, encoding, modified, siblingStat);
+    if (!sibling) {
+        return false;
+    }
+    
+    // The sibling is its own representation, validated by its own metadata
+    const std::string etag = makeETag(siblingStat.st_ino, siblingStat.st_size, siblingStat.st_mtim,
+                                      encodingName(encoding));
+    const std::string validators = validatorHeaders(etag, siblingStat.st_mtim.tv_sec, cacheControl(fullPath));
+    if (isNotModified(request, etag, siblingStat.st_mtim.tv_sec)) {
+        response = notModifiedResponse(validators, true);
+        return true;
+    }
+    
+    response.head = fullHead(mimeType, siblingStat.st_size, validators, encoding, true);
+    response.file = std::move(sibling);
+    response.fileLength = siblingStat.st_size;
+    response.bufferedFile = !options.sendfile;
+    return true;
+}
+
+std::shared_ptr<const CachedFile> Server::loadFile(const std::string& fullPath, int fd, const struct stat& fileStat,
+                                                   const MimeType& mimeType, uint64_t cacheGeneration) {
+    const size_t fileSize = fileStat.st_size;
+    auto cached = std::make_shared<CachedFile>();
+    if (!readWholeFile(fd, fileSize, cached->content)) {
+        return nullptr; // truncated underneath us, fall back to sending from disk
+    }
+    
+    cached->mimeType = &mimeType;
+    cached->size = fileStat.st_size;
+    cached->modified = fileStat.st_mtim;
+    cached->inode = fileStat.st_ino;
+    cached->contentHash = hashBytes(cached->content);
+    cached->etag = makeContentETag(cached->contentHash);
+    cached->validators = validatorHeaders(cached->etag, fileStat.st_mtim.tv_sec, cacheControl(fullPath));
+    cached->head = fullHead(mimeType, fileSize, cached->validators, ContentEncoding::Identity,
+                            isCompressible(mimeType.contentType));
+    cache().insert(fullPath, cached, cacheGeneration);
+    return cached;
+}
+
+std::shared_ptr<const CachedFile> Server::compressVariant(const std::string& fullPath, const CachedFile& identity,
+                                                          ContentEncoding encoding, CompressionLevel level,
+                                                          uint64_t cacheGeneration) {
+    auto compressed = std::make_shared<CachedFile>();
+    if (!compress(encoding, identity.content, level, compressed->content)) {
+        return nullptr;
+    }
+    
+    // Validated against the original file, like the identity entry
+    compressed->mimeType = identity.mimeType;
+    compressed->size = identity.size;
+    compressed->modified = identity.modified;
+    compressed->inode = identity.inode;
+    compressed->contentHash = identity.contentHash;
+    compressed->etag = makeContentETag(identity.contentHash, encodingName(encoding));
+    compressed->validators = validatorHeaders(compressed->etag, identity.modified.tv_sec, cacheControl(fullPath));
+    compressed->head = fullHead(*identity.mimeType, compressed->content.size(), compressed->validators, encoding, true);
+    cache().insert(fullPath, compressed, cacheGeneration, static_cast<size_t>(encoding));
+    return compressed;
+}
+
+void Server::precompressFiles(const std::vector<std::string>& paths) {
+    // Files are independent, so they spread over the pool; each one splits
+    // again per encoding, and idle workers steal those halves
+    WorkPool::Group group;
+    for (const std::string& path : paths) {
+        workPool.submit(group, [this, &path, &group]() { precompressFile(path, group); });
+    }
+    group.wait();
+    
+    // The other nodes' caches share the same immutable buffers instead of
+    // compressing everything again. Their generation is taken before the
+    // first cache is read, so a change in between voids the insert.
+    for (size_t domain = 1; domain < fileCaches.size(); ++domain) {
+        for (const std::string& path : paths) {
+            uint64_t generation = 0;
+            fileCaches[domain]->find(path, &generation);
+            for (size_t variant = 0; variant < FileCache::MAX_VARIANTS; ++variant) {
+                if (auto cached = fileCaches[0]->find(path, nullptr, variant)) {
+                    fileCaches[domain]->insert(path, std::move(cached), generation, variant);
+                }
+            }
+        }
+    }
+}
+
+void Server::precompressFile(const std::string& fullPath, WorkPool::Group& group) {
+    const MimeType& mimeType = mimeTypeFor(fullPath);
+    if (!cache().enabled() || !isCompressible(mimeType.contentType) ||
+        (watchMode && mimeType.contentType.starts_with("text/html"))) {
         return;
     }
     
-    // Read entire file
-    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-    file.close();
+    // Taken before reading, so a change that lands mid-read voids the inserts
+    uint64_t cacheGeneration = 0;
+    cache().find(fullPath, &cacheGeneration);
     
-    // Hot reload script
-    std::string hotReloadScript = R"(
-<script>
-(function() {
-    console.log('🔥 Hot reload enabled');
-    const eventSource = new EventSource('/sse');
-    eventSource.onmessage = function(event) {
-        if (event.data === 'reload') {
-            console.log('🔄 Reloading page due to file change');
-            window.location.reload();
+    UniqueFd file(open(fullPath.c_str(), O_RDONLY | O_CLOEXEC));
+    struct stat fileStat;
+    if (!file || fstat(file.get(), &fileStat) < 0 || !S_ISREG(fileStat.st_mode) ||
+        static_cast<size_t>(fileStat.st_size) < MIN_COMPRESSIBLE_SIZE ||
+        static_cast<size_t>(fileStat.st_size) > cache().maxEntrySize()) {
+        return;
+    }
+    
+    auto identity = loadFile(fullPath, file.get(), fileStat, mimeType, cacheGeneration);
+    if (!identity) {
+        return;
+    }
+    for (ContentEncoding encoding : {ContentEncoding::Brotli, ContentEncoding::Gzip}) {
+        struct stat siblingStat;
+        if (canCompress(encoding) && !openPrecompressed(fullPath, encoding, identity->modified, siblingStat)) {
+            workPool.submit(group, [this, fullPath, identity, encoding, cacheGeneration]() {
+                compressVariant(fullPath, *identity, encoding, CompressionLevel::Best, cacheGeneration);
+            });
         }
-    };
-    eventSource.onerror = function(event) {
-        console.log('❌ Hot reload connection lost');
-    };
-})();
-</script>
-)";
+    }
+}
+
+const char* Server::cacheControl(const std::string& path) const {
+    // A fingerprinted name changes whenever its content does; anything else
+    // is revalidated on every use, which the ETag turns into a cheap 304
+    if (!watchMode && isFingerprinted(path)) {
+        return "public, max-age=31536000, immutable";
+    }
+    return "no-cache";
+}
+
+bool Server::isUnchanged(const char* fullPath, const CachedFile& cached) {
+    struct stat fileStat;
+    return stat(fullPath, &fileStat) == 0 && S_ISREG(fileStat.st_mode) &&
+        fileStat.st_size == cached.size && fileStat.st_ino == cached.inode &&
+        fileStat.st_mtim.tv_sec == cached.modified.tv_sec &&
+        fileStat.st_mtim.tv_nsec == cached.modified.tv_nsec;
+}
+
+std::shared_ptr<const CachedFile> Server::loadHotReloadPage(const std::string& fullPath, int fd,
+                                                            const struct stat& fileStat, const MimeType& mimeType,
+                                                            uint64_t cacheGeneration) {
+    auto page = std::make_shared<CachedFile>();
+    if (!readWholeFile(fd, fileStat.st_size, page->content)) {
+        return nullptr;
+    }
     
-    // Inject script before closing </body> or </html> tag
+    // Inject script before closing </body> or </html> tag, or append it at
+    // the end; the page is sent around it, so the file bytes stay untouched
+    const std::string& content = page->content;
     size_t insertPos = content.find("</body>");
     if (insertPos == std::string::npos) {
         insertPos = content.find("</html>");
     }
+    page->scriptOffset = insertPos != std::string::npos ? insertPos : content.size();
     
-    if (insertPos != std::string::npos) {
-        content.insert(insertPos, hotReloadScript);
-    } else {
-        // If no closing tags found, append at the end
-        content += hotReloadScript;
+    // The file's bytes and the script's hash together identify the body
+    page->mimeType = &mimeType;
+    page->size = fileStat.st_size;
+    page->modified = fileStat.st_mtim;
+    page->inode = fileStat.st_ino;
+    page->contentHash = hashBytes(content);
+    char etagSuffix[16];
+    snprintf(etagSuffix, sizeof(etagSuffix), "hr%08x", HOT_RELOAD_SCRIPT_HASH);
+    page->etag = makeContentETag(page->contentHash, etagSuffix);
+    page->validators = validatorHeaders(page->etag, fileStat.st_mtim.tv_sec, cacheControl(fullPath));
+    page->head = okHead(mimeType, content.size() + HOT_RELOAD_SCRIPT.size());
+    page->head += page->validators;
+    if (content.size() <= cache().maxEntrySize()) {
+        cache().insert(fullPath, page, cacheGeneration, HOT_RELOAD_VARIANT);
     }
-    
-    // Send response
-    std::string headers = 
-        "HTTP/1.1 200 OK\r\n"
-        "Content-Type: text/html\r\n"
-        "Content-Length: " + std::to_string(content.length()) + "\r\n"
-        "\r\n";
-    send(clientSocket, headers.c_str(), headers.length(), 0);
-    send(clientSocket, content.c_str(), content.length(), 0);
+    return page;
 }
 
-std::string Server::getContentType(const std::string& path) {
-    size_t dotPos = path.find_last_of('.');
-    if (dotPos == std::string::npos) {
-        return "application/octet-stream";
+Response Server::hotReloadResponse(std::shared_ptr<const CachedFile> page, const HttpRequest& request) {
+    if (isNotModified(request, page->etag, page->modified.tv_sec)) {
+        return notModifiedResponse(page->validators, false);
     }
     
-    std::string extension = path.substr(dotPos + 1);
-    
-    if (extension == "html" || extension == "htm") return "text/html";
-    if (extension == "css") return "text/css";
-    if (extension == "js") return "application/javascript";
-    if (extension == "json") return "application/json";
-    if (extension == "png") return "image/png";
-    if (extension == "jpg" || extension == "jpeg") return "image/jpeg";
-    if (extension == "gif") return "image/gif";
-    if (extension == "txt") return "text/plain";
-    
-    return "application/octet-stream";
+    // File bytes up to the insertion point, the script, then the rest, all
+    // in one gathered write
+    const std::string_view content = page->content;
+    Response response;
+    response.head = page->head;
+    response.addBodySegment(content.substr(0, page->scriptOffset));
+    response.addBodySegment(HOT_RELOAD_SCRIPT);
+    response.addBodySegment(content.substr(page->scriptOffset));
+    response.bodyOwner = std::move(page);
+    return response;
 }
@@ -1,38 +1,155 @@
 #pragma once
 
+#include <atomic>
+#include <functional>
 #include <string>
 #include <unordered_map>
 #include <filesystem>
 #include <vector>
-#include <mutex>
+#include <span>
 
 // Linux socket headers
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <sys/stat.h>
+
+#include "access_log.h"
+#include "compression.h"
+#include "connection_limiter.h"
+#include "cpu_topology.h"
+#include "event_loop.h"
+#include "file_cache.h"
+#include "http_parser.h"
+#include "path_index.h"
+#include "response.h"
+#include "sse_hub.h"
+#include "timer_wheel.h"
+#include "tree_scan.h"
+#include "work_pool.h"
+
+// How accepted connections are driven
+enum class IoMode {
+    Thread, // one detached thread per connection, blocking sockets
+    Epoll,  // fixed set of edge-triggered epoll loops, non-blocking sockets
+    Uring   // same set of loops driven through io_uring, epoll where unsupported
+};
+
+struct ServerOptions {
+    IoMode ioMode = IoMode::Thread;
+    unsigned workers = 0; // epoll/uring worker loops, 0 = one per hardware thread
+    int keepAliveTimeout = 5; // idle seconds before a persistent connection is closed, 0 = no keep-alive
+    unsigned maxRequestsPerConnection = 100;
+    int headerTimeout = 10; // seconds from accept or a request's first byte to the end of its head, 0 = no limit
+    int bodyTimeout = 30; // seconds from the end of a request head to the end of its body, 0 = no limit
+    int sendTimeout = 30; // seconds a response may go without a byte written, 0 = no limit
+    unsigned maxConnections = 0; // open connections before new ones are answered 503, 0 = no limit
+    unsigned maxConnectionsPerIp = 0; // the same for the connections of one client address
+    bool sendfile = true; // zero-copy file bodies, false forces the buffered copy
+    size_t cacheBytes = 64 * 1024 * 1024; // in-memory file cache budget, 0 disables it
+    size_t maxCachedFileSize = 1024 * 1024; // larger files are always sent from disk
+    bool precompress = false; // gzip/brotli every cacheable text file at startup and on change
+    int reloadDebounceMs = 100; // file changes this close together trigger a single reload
+    bool reusePort = false; // epoll/uring: one SO_REUSEPORT listener per worker loop instead of a shared one
+    bool pinWorkers = false; // epoll/uring: pin each worker loop to a CPU of its own
+    bool numaAware = false; // spread pinned workers over NUMA nodes, with a file cache per node
+    unsigned poolThreads = 0; // threads for blocking file reads and compression, 0 = one per hardware thread
+    size_t poolQueueLimit = 1024; // queued blocking tasks before requests are turned away with 503
+    std::string accessLogPath; // structured access log file, empty = stdout
+    accesslog::Level logLevel = accesslog::Level::Info; // least severe entry written
+    unsigned logSample = 1; // keep one in this many successful requests
+    bool pathIndex = false; // watch the tree without hot reload, so lookups never touch the disk; implied by watch mode
+};
 
 class Server {
 public:
-    Server(const std::string& startPath, bool watchMode = false, int port = 8080);
+    Server(const std::string& startPath, bool watchMode = false, int port = 8080,
+           const ServerOptions& options = ServerOptions());
     
     void startWatching();
     void startServer();
 
+    // Shared by every I/O mode: answers the first complete request at the
+    // front of input and returns the bytes it consumed, or 0 if incomplete.
+    // With mayDefer, a response that needs blocking work only carries it.
+    size_t handleRequest(std::span<char> input, HttpParser& parser, unsigned requestsServed,
+                         Response& response, bool mayDefer = false);
+    // Runs a deferred response's blocking work on the pool, then onDone
+    // there. When the pool is saturated the response becomes a 503 instead
+    // and false is returned.
+    bool offload(Response& response, std::function<void()> onDone);
+    // Hands a connection to the SSE hub, which keeps it counted against the
+    // connection caps until it closes the stream
+    void handleSSE(int clientSocket, uint64_t lastEventId, uint32_t address);
+    // Counts a just-accepted connection against the connection caps. One
+    // over a cap is sent a 503 and false is returned; the caller closes it.
+    bool admitConnection(int clientSocket, uint32_t address);
+    // For every admitted connection, once it closes; the SSE hub's included
+    void releaseConnection(uint32_t address) { connectionLimiter.release(address); }
+    const ServerOptions& getOptions() const { return options; }
+    PhaseTimeouts phaseTimeouts() const;
+    FileCache::Stats cacheStats() const;
+    const std::vector<std::unique_ptr<WorkerStats>>& getWorkerStats() const { return workerStats; }
+    WorkPool::Stats poolStats() const { return workPool.stats(); }
+
 private:
     std::string startPath;
     bool watchMode;
     int port;
-    std::unordered_map<std::string, std::filesystem::file_time_type> fileTimestamps;
-    std::vector<int> sseClients; // Track SSE connections for hot reload (using int instead of SOCKET)
-    std::mutex sseClientsMutex;
+    ServerOptions options;
+    std::vector<CpuPlacement> placements; // worker CPUs, empty unless pinning
+    FileTree fileTree; // what the watcher last saw below startPath
+    PathIndex pathIndex; // files below startPath, live once the watcher is
+    ConnectionLimiter connectionLimiter; // global and per-address connection caps; outlives the hub releasing into it
+    SseHub sseHub; // hot reload subscribers
+    std::vector<std::unique_ptr<FileCache>> fileCaches; // one per NUMA node served, or just one
+    std::vector<size_t> workerCacheDomains; // fileCaches index of each worker loop
+    std::vector<std::unique_ptr<WorkerStats>> workerStats; // one per epoll worker loop
+    std::vector<std::string> recompressQueue; // changed files, recompressed after each watcher batch
+    std::vector<SseHub::Change> pageChanges; // changed URL paths for the next hot reload event
+    WorkPool workPool; // blocking work of the worker loops, and precompression
+    std::atomic<int64_t> lastSheddingReport{0}; // steady clock seconds of the last 503 warning
 
-    void checkForChanges();
+    int createListenSocket();
+    void runThreadPerConnection(int listenSocket);
+    void runEventLoops(int listenSocket);
+    unsigned workerCount() const;
+    FileCache& cache();
+    bool watchWithInotify();
+    bool checkForChanges(const std::string& directory, unsigned threads);
+    bool recordFileChange(const std::string& filePath);
+    bool recordFileDeletion(const std::string& filePath);
+    bool recordDirectoryDeletion(const std::string& directory);
+    // Whether a file whose metadata changed holds different bytes than before
+    bool contentChanged(const std::string& filePath);
+    void indexFile(const std::string& filePath, const struct stat& fileStat);
+    void unindexFile(const std::string& filePath);
+    void evictFile(const std::string& filePath);
+    void invalidateFile(const std::string& filePath);
+    void recompressChangedFiles();
     void scanDirectory();
-    void notifyClients(const std::string& message);
-    void handleClient(int clientSocket);
-    void handleSSE(int clientSocket);
-    void serveFile(int clientSocket, const std::string& requestedPath);
-    void serveHTMLWithHotReload(int clientSocket, const std::string& fullPath);
-    std::string getContentType(const std::string& path);
+    // Queues a hot reload change for a file below startPath
+    void notePageChange(const std::string& filePath, bool deleted);
+    void notifyClients();
+    void handleClient(int clientSocket, uint32_t address);
+    Response metricsResponse();
+    Response serveFile(std::string_view requestedPath, const HttpRequest& request, bool mayDefer);
+    Response cachedResponse(std::shared_ptr<const CachedFile> cached, ContentEncoding encoding,
+                            const HttpRequest& request);
+    bool precompressedResponse(const std::string& fullPath, ContentEncoding encoding, const MimeType& mimeType,
+                               const timespec& modified, const HttpRequest& request, Response& response);
+    std::shared_ptr<const CachedFile> loadFile(const std::string& fullPath, int fd, const struct stat& fileStat,
+                                               const MimeType& mimeType, uint64_t cacheGeneration);
+    std::shared_ptr<const CachedFile> compressVariant(const std::string& fullPath, const CachedFile& identity,
+                                                      ContentEncoding encoding, CompressionLevel level,
+                                                      uint64_t cacheGeneration);
+    void precompressFiles(const std::vector<std::string>& paths);
+    void precompressFile(const std::string& fullPath, WorkPool::Group& group);
+    const char* cacheControl(const std::string& path) const;
+    bool isUnchanged(const char* fullPath, const CachedFile& cached);
+    std::shared_ptr<const CachedFile> loadHotReloadPage(const std::string& fullPath, int fd,
+                                                        const struct stat& fileStat, const MimeType& mimeType,
+                                                        uint64_t cacheGeneration);
+    Response hotReloadResponse(std::shared_ptr<const CachedFile> page, const HttpRequest& request);
 };
@@ -0,0 +1,440 @@
+#include "sse_hub.h"
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "access_log.h"
+
+namespace {
+
+constexpr int MAX_EVENTS = 256;
+
+// A subscriber that falls this far behind is disconnected; EventSource
+// reconnects on its own and catches up through Last-Event-ID
+constexpr size_t MAX_QUEUED_BYTES = 64 * 1024;
+
+// Comments keep proxies from timing out idle streams and make writes to
+// vanished peers fail; a queue that has not moved for STALL_TIMEOUT is dropped
+constexpr auto HEARTBEAT_INTERVAL = std::chrono::seconds(15);
+constexpr auto STALL_TIMEOUT = std::chrono::seconds(30);
+
+// A steady stream of changes still gets a broadcast every this many windows
+constexpr int MAX_DEBOUNCE_WINDOWS = 10;
+
+// More changes than this in one event is a checkout or a build; reloading
+// beats swapping them one by one, and the event lists no paths
+constexpr size_t MAX_EVENT_PATHS = 32;
+
+// Events kept for clients that reconnect with Last-Event-ID
+constexpr size_t MAX_HISTORY = 64;
+
+const std::string STREAM_HEAD =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: keep-alive\r\n"
+    "Access-Control-Allow-Origin: *\r\n"
+    "\r\n";
+
+bool wouldBlock() {
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+void appendJsonString(std::string& out, std::string_view text) {
+    out += '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buffer[8];
+            snprintf(buffer, sizeof(buffer), "\\u%04x", static_cast<unsigned char>(c));
+            out += buffer;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+// Tells a client with no events to catch up on which version it is at
+std::string helloEvent(uint64_t version) {
+    const std::string id = std::to_string(version);
+    return "id: " + id + "\nevent: hello\ndata: {\"version\":" + id + "}\n\n";
+}
+
+// For a client too far behind to replay what it missed
+std::string reloadEvent(uint64_t version) {
+    const std::string id = std::to_string(version);
+    return "id: " + id + "\nevent: reload\ndata: {\"version\":" + id + ",\"paths\":[]}\n\n";
+}
+
+}
+
+SseHub::SseHub(std::chrono::milliseconds debounce, std::function<void(uint32_t address)> onClose)
+    : debounce(debounce), onClose(std::move(onClose)), epollFd(epoll_create1(EPOLL_CLOEXEC)),
+      wakeFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+      version(std::chrono::duration_cast<std::chrono::milliseconds>(
+                  std::chrono::system_clock::now().time_since_epoch()).count()) {
+    if (epollFd < 0 || wakeFd < 0) {
+        std::cerr << "Error creating SSE hub: " << strerror(errno) << std::endl;
+        return;
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = wakeFd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event) < 0) {
+        std::cerr << "Error registering SSE wake descriptor: " << strerror(errno) << std::endl;
+        close(epollFd);
+        epollFd = -1;
+    }
+}
+
+SseHub::~SseHub() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake();
+    if (thread.joinable()) {
+        thread.join();
+    }
+
+    // The server is going away with its counts, so onClose is not called
+    for (auto& [clientSocket, client] : clients) {
+        close(clientSocket);
+    }
+    for (const NewClient& client : newClients) {
+        close(client.socket);
+    }
+    if (epollFd >= 0) {
+        close(epollFd);
+    }
+    if (wakeFd >= 0) {
+        close(wakeFd);
+    }
+}
+
+bool SseHub::start() {
+    if (epollFd < 0 || wakeFd < 0) {
+        return false;
+    }
+    thread = std::thread(&SseHub::run, this);
+    return true;
+}
+
+void SseHub::subscribe(int clientSocket, uint64_t lastEventId, uint32_t address) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!stopping && thread.joinable()) {
+            newClients.push_back({clientSocket, lastEventId, address});
+            clientSocket = -1;
+        }
+    }
+    if (clientSocket >= 0) {
+        reject(clientSocket, address); // no hub thread to serve it
+        return;
+    }
+    wake();
+}
+
+void SseHub::publish(const Change& change) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const Clock::time_point now = Clock::now();
+        if (pendingChanges.empty()) {
+            firstPending = now;
+        }
+        lastPending = now;
+        auto it = std::find_if(pendingChanges.begin(), pendingChanges.end(),
+                               [&](const Change& pending) { return pending.path == change.path; });
+        if (it != pendingChanges.end()) {
+            it->hotSwappable = it->hotSwappable && change.hotSwappable;
+            coalesced.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            pendingChanges.push_back(change);
+        }
+    }
+    wake();
+}
+
+SseHub::Stats SseHub::stats() const {
+    Stats stats;
+    stats.clients = clientCount.load(std::memory_order_relaxed);
+    stats.broadcasts = broadcasts.load(std::memory_order_relaxed);
+    stats.coalesced = coalesced.load(std::memory_order_relaxed);
+    stats.disconnected = disconnected.load(std::memory_order_relaxed);
+    stats.replays = replays.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void SseHub::wake() {
+    uint64_t one = 1;
+    if (wakeFd >= 0 && write(wakeFd, &one, sizeof(one)) < 0 && !wouldBlock()) {
+        std::cerr << "Error waking SSE hub: " << strerror(errno) << std::endl;
+    }
+}
+
+void SseHub::run() {
+    epoll_event events[MAX_EVENTS];
+    std::vector<NewClient> sockets;
+    std::vector<Change> changes;
+    const auto heartbeat = std::make_shared<const std::string>(": heartbeat\n\n");
+    nextHeartbeat = Clock::now() + HEARTBEAT_INTERVAL;
+
+    while (true) {
+        Clock::time_point now = Clock::now();
+        Clock::time_point deadline = Clock::time_point::max();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) {
+                return;
+            }
+            sockets.swap(newClients);
+
+            // Trailing edge of the burst, or the cap for a burst that never ends
+            if (!pendingChanges.empty()) {
+                const Clock::time_point due =
+                    std::min(lastPending + debounce, firstPending + debounce * MAX_DEBOUNCE_WINDOWS);
+                if (now >= due) {
+                    changes.swap(pendingChanges);
+                } else {
+                    deadline = due;
+                }
+            }
+        }
+
+        addClients(sockets);
+        sockets.clear();
+        if (!changes.empty()) {
+            broadcast(makeEvent(changes), false);
+            broadcasts.fetch_add(1, std::memory_order_relaxed);
+            changes.clear();
+        }
+
+        if (now >= nextHeartbeat) {
+            broadcast(heartbeat, true);
+            dropStalledClients(now);
+            nextHeartbeat = now + HEARTBEAT_INTERVAL;
+        }
+        clientCount.store(clients.size(), std::memory_order_relaxed);
+
+        deadline = std::min(deadline, nextHeartbeat);
+        const auto wait = std::chrono::ceil<std::chrono::milliseconds>(deadline - now);
+        int count = epoll_wait(epollFd, events, MAX_EVENTS, static_cast<int>(std::max<int64_t>(wait.count(), 0)));
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "SSE epoll_wait failed: " << strerror(errno) << std::endl;
+            return;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            const int fd = events[i].data.fd;
+            if (fd == wakeFd) {
+                uint64_t value;
+                while (read(wakeFd, &value, sizeof(value)) > 0) {}
+                continue;
+            }
+
+            auto it = clients.find(fd);
+            if (it == clients.end()) {
+                continue; // dropped earlier in this batch
+            }
+
+            // EventSource never sends after its request; the peer going away
+            // shows up as a hang-up or end of stream
+            if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+                disconnect(fd);
+                continue;
+            }
+            if (events[i].events & EPOLLIN) {
+                char buffer[1024];
+                ssize_t bytesReceived;
+                while ((bytesReceived = recv(fd, buffer, sizeof(buffer), 0)) > 0 ||
+                       (bytesReceived < 0 && errno == EINTR)) {}
+                if (bytesReceived == 0 || !wouldBlock()) {
+                    disconnect(fd);
+                    continue;
+                }
+            }
+            if ((events[i].events & EPOLLOUT) && !flush(fd, it->second)) {
+                disconnect(fd);
+            }
+        }
+    }
+}
+
+SseHub::Frame SseHub::makeEvent(const std::vector<Change>& changes) {
+    ++version;
+    const bool listed = changes.size() <= MAX_EVENT_PATHS;
+    const bool hotSwappable = listed && std::all_of(changes.begin(), changes.end(),
+                                                    [](const Change& change) { return change.hotSwappable; });
+
+    const std::string id = std::to_string(version);
+    std::string frame = "id: " + id + (hotSwappable ? "\nevent: update" : "\nevent: reload") +
+        "\ndata: {\"version\":" + id + ",\"paths\":[";
+    if (listed) {
+        for (size_t i = 0; i < changes.size(); ++i) {
+            if (i > 0) {
+                frame += ',';
+            }
+            appendJsonString(frame, changes[i].path);
+        }
+    }
+    frame += "]}\n\n";
+
+    auto event = std::make_shared<const std::string>(std::move(frame));
+    history.emplace_back(version, event);
+    if (history.size() > MAX_HISTORY) {
+        history.pop_front();
+    }
+    return event;
+}
+
+void SseHub::enqueue(Client& client, const Frame& frame) {
+    client.queue.push_back(frame);
+    client.queuedBytes += frame->size();
+}
+
+void SseHub::addClients(std::vector<NewClient>& sockets) {
+    static const Frame streamHead = std::make_shared<const std::string>(STREAM_HEAD);
+
+    for (const auto [clientSocket, lastEventId, address] : sockets) {
+        // Thread-per-connection sockets arrive in blocking mode
+        int flags = fcntl(clientSocket, F_GETFL, 0);
+        if (flags < 0 || fcntl(clientSocket, F_SETFL, flags | O_NONBLOCK) < 0) {
+            reject(clientSocket, address);
+            continue;
+        }
+
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.fd = clientSocket;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, clientSocket, &event) < 0) {
+            std::cerr << "Error registering SSE client: " << strerror(errno) << std::endl;
+            reject(clientSocket, address);
+            continue;
+        }
+
+        Client& client = clients[clientSocket];
+        client.address = address;
+        enqueue(client, streamHead);
+        client.lastProgress = Clock::now();
+
+        // A reconnect gets the events it missed while away, or one reload
+        // if they are no longer kept
+        if (lastEventId == 0) {
+            enqueue(client, std::make_shared<const std::string>(helloEvent(version)));
+        } else if (lastEventId != version && !replay(client, lastEventId)) {
+            enqueue(client, std::make_shared<const std::string>(reloadEvent(version)));
+        }
+
+        if (!flush(clientSocket, client)) {
+            disconnect(clientSocket);
+            continue;
+        }
+        accesslog::message(accesslog::Level::Info, "SSE client connected for hot reload");
+    }
+}
+
+bool SseHub::replay(Client& client, uint64_t lastEventId) {
+    // Everything after lastEventId must still be kept
+    if (lastEventId > version || history.empty() || lastEventId + 1 < history.front().first) {
+        return false;
+    }
+    auto missed = std::upper_bound(history.begin(), history.end(), lastEventId,
+                                   [](uint64_t id, const auto& event) { return id < event.first; });
+    size_t bytes = 0;
+    for (auto it = missed; it != history.end(); ++it) {
+        bytes += it->second->size();
+    }
+    if (bytes > MAX_QUEUED_BYTES / 2) {
+        return false;
+    }
+    for (; missed != history.end(); ++missed) {
+        enqueue(client, missed->second);
+    }
+    replays.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void SseHub::broadcast(const Frame& frame, bool heartbeat) {
+    const Clock::time_point now = Clock::now();
+    for (auto it = clients.begin(); it != clients.end();) {
+        const int clientSocket = it->first;
+        Client& client = it->second;
+        ++it; // disconnect() erases this client
+
+        if (heartbeat && !client.queue.empty()) {
+            continue; // still backed up; the stall check deals with it
+        }
+
+        if (client.queuedBytes + frame->size() > MAX_QUEUED_BYTES) {
+            disconnect(clientSocket);
+            continue;
+        }
+        if (client.queue.empty()) {
+            client.lastProgress = now;
+        }
+        enqueue(client, frame);
+        if (!flush(clientSocket, client)) {
+            disconnect(clientSocket);
+        }
+    }
+}
+
+bool SseHub::flush(int clientSocket, Client& client) {
+    // Edge-triggered: write until the queue is empty or the socket is full
+    while (!client.queue.empty()) {
+        const std::string& frame = *client.queue.front();
+        ssize_t written = send(clientSocket, frame.data() + client.sent, frame.size() - client.sent,
+                               MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return wouldBlock(); // EPOLLOUT resumes once the socket drains
+        }
+
+        client.lastProgress = Clock::now();
+        client.sent += written;
+        if (client.sent == frame.size()) {
+            client.queuedBytes -= frame.size();
+            client.queue.pop_front();
+            client.sent = 0;
+        }
+    }
+    return true;
+}
+
+void SseHub::dropStalledClients(Clock::time_point now) {
+    for (auto it = clients.begin(); it != clients.end();) {
+        const int clientSocket = it->first;
+        const Client& client = it->second;
+        ++it;
+        if (!client.queue.empty() && now - client.lastProgress >= STALL_TIMEOUT) {
+            disconnect(clientSocket);
+        }
+    }
+}
+
+void SseHub::disconnect(int clientSocket) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, clientSocket, nullptr);
+    close(clientSocket);
+    auto it = clients.find(clientSocket);
+    const uint32_t address = it->second.address;
+    clients.erase(it);
+    disconnected.fetch_add(1, std::memory_order_relaxed);
+    onClose(address);
+}
+
+void SseHub::reject(int clientSocket, uint32_t address) {
+    close(clientSocket);
+    onClose(address);
+}
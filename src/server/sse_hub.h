@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Server-sent events fan-out for hot reload. Subscribers are non-blocking
+// sockets driven by one epoll thread of their own, each with a bounded
+// outbound queue, so a stalled browser only ever delays itself. Published
+// changes are debounced: a burst of them goes out as one event,
+//
+//   id: <version>
+//   event: update | reload
+//   data: {"version":<version>,"paths":["/css/site.css",...]}
+//
+// "update" when every path can be swapped into the page in place, "reload"
+// otherwise. Versions count up from the wall clock at startup, so an id
+// from an earlier run is always older than anything this one sent. The
+// last events are kept, and a client that reconnects with Last-Event-ID
+// gets just the ones it missed, or a reload if they are gone.
+class SseHub {
+public:
+    struct Stats {
+        size_t clients = 0;
+        uint64_t broadcasts = 0;
+        uint64_t coalesced = 0;    // changes folded into a pending one
+        uint64_t replays = 0;      // reconnects sent the events they missed
+        uint64_t disconnected = 0; // slow, stalled or vanished subscribers dropped
+    };
+
+    // A changed URL path; hotSwappable ones (stylesheets, images) can be
+    // updated without reloading the page
+    struct Change {
+        std::string path;
+        bool hotSwappable;
+    };
+
+    // onClose is called from the hub thread with the address a subscriber
+    // was passed with, once the hub has closed its socket
+    SseHub(std::chrono::milliseconds debounce, std::function<void(uint32_t address)> onClose);
+    ~SseHub();
+
+    SseHub(const SseHub&) = delete;
+    SseHub& operator=(const SseHub&) = delete;
+
+    bool start();
+
+    // Takes over a socket whose request asked for the event stream; the hub
+    // sends the response head and closes the socket when the client goes away.
+    // lastEventId is the client's Last-Event-ID, 0 for a new stream; address
+    // is handed back to onClose then.
+    void subscribe(int clientSocket, uint64_t lastEventId, uint32_t address);
+
+    // Queues a change for the next event, which goes out once no further
+    // change has arrived for the debounce window
+    void publish(const Change& change);
+
+    Stats stats() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+    using Frame = std::shared_ptr<const std::string>;
+
+    struct NewClient {
+        int socket;
+        uint64_t lastEventId;
+        uint32_t address;
+    };
+
+    struct Client {
+        std::deque<Frame> queue; // frames are shared by every subscriber
+        size_t queuedBytes = 0;
+        size_t sent = 0;         // bytes of queue.front() already written
+        Clock::time_point lastProgress;
+        uint32_t address = 0;    // client IPv4 address, for onClose
+    };
+
+    std::chrono::milliseconds debounce;
+    std::function<void(uint32_t)> onClose;
+    int epollFd;
+    int wakeFd;
+    std::thread thread;
+
+    // Handed over by other threads, guarded by mutex
+    std::mutex mutex;
+    std::vector<NewClient> newClients;
+    std::vector<Change> pendingChanges;
+    Clock::time_point firstPending;
+    Clock::time_point lastPending;
+    bool stopping = false;
+
+    std::atomic<size_t> clientCount{0};
+    std::atomic<uint64_t> broadcasts{0};
+    std::atomic<uint64_t> coalesced{0};
+    std::atomic<uint64_t> replays{0};
+    std::atomic<uint64_t> disconnected{0};
+
+    // Hub thread only
+    std::unordered_map<int, Client> clients;
+    Clock::time_point nextHeartbeat;
+    uint64_t version;                               // id of the latest event
+    std::deque<std::pair<uint64_t, Frame>> history; // latest events by id, for replay
+
+    void run();
+    void wake();
+    void addClients(std::vector<NewClient>& sockets);
+    Frame makeEvent(const std::vector<Change>& changes);
+    void enqueue(Client& client, const Frame& frame);
+    // Queues the kept events after lastEventId; false if some are gone
+    bool replay(Client& client, uint64_t lastEventId);
+    void broadcast(const Frame& frame, bool heartbeat);
+    bool flush(int clientSocket, Client& client);
+    void dropStalledClients(Clock::time_point now);
+    void disconnect(int clientSocket);
+    // Closes a socket that never became a subscriber
+    void reject(int clientSocket, uint32_t address);
+};
@@ -0,0 +1,116 @@
+#include "timer_wheel.h"
+#include <algorithm>
+#include <bit>
+#include <climits>
+#include <utility>
+
+namespace {
+
+constexpr uint64_t levelSpan(unsigned level) {
+    return uint64_t(1) << (TimerWheel::SLOT_BITS * level);
+}
+
+}
+
+TimerWheel::TimerWheel(Clock::time_point start) : start(start) {}
+
+uint64_t TimerWheel::tickAt(Clock::time_point time) const {
+    if (time <= start) {
+        return 0;
+    }
+    const auto elapsed = time - start;
+    return static_cast<uint64_t>((elapsed + TICK - Clock::duration(1)) / TICK);
+}
+
+uint64_t TimerWheel::schedule(uint64_t tick, int socket, uint64_t connectionId) {
+    tick = std::clamp(tick, current + 1, current + levelSpan(LEVELS) - 1);
+    insert({socket, connectionId, tick});
+    ++count;
+    return tick;
+}
+
+void TimerWheel::insert(const Timer& timer) {
+    // The lowest level whose span covers the distance; the timer is moved
+    // down once the wheel reaches its slot there, which is never past its tick
+    const uint64_t distance = timer.tick - current;
+    unsigned level = 0;
+    while (level + 1 < LEVELS && distance >= levelSpan(level + 1)) {
+        ++level;
+    }
+    const unsigned slot = (timer.tick >> (SLOT_BITS * level)) & (SLOTS - 1);
+    slots[level][slot].push_back(timer);
+    occupied[level] |= uint64_t(1) << slot;
+}
+
+void TimerWheel::advance(Clock::time_point now, std::vector<Timer>& expired) {
+    const uint64_t target = now > start ? static_cast<uint64_t>((now - start) / TICK) : 0;
+    while (current < target) {
+        if (count == 0) {
+            current = target;
+            return;
+        }
+        ++current;
+
+        // Every level whose index turned over with this tick hands its slot
+        // down, the highest first so its timers can cascade all the way
+        unsigned top = 0;
+        while (top + 1 < LEVELS && (current & (levelSpan(top + 1) - 1)) == 0) {
+            ++top;
+        }
+        for (unsigned level = top; level > 0; --level) {
+            const unsigned slot = (current >> (SLOT_BITS * level)) & (SLOTS - 1);
+            // Each lands on a lower level, never back in this slot
+            for (const Timer& timer : slots[level][slot]) {
+                insert(timer);
+            }
+            slots[level][slot].clear();
+            occupied[level] &= ~(uint64_t(1) << slot);
+        }
+
+        const unsigned slot = current & (SLOTS - 1);
+        std::vector<Timer>& due = slots[0][slot];
+        if (!due.empty()) {
+            expired.insert(expired.end(), due.begin(), due.end());
+            count -= due.size();
+            due.clear(); // keeps its capacity for the next lap
+            occupied[0] &= ~(uint64_t(1) << slot);
+        }
+    }
+}
+
+int TimerWheel::timeoutMs(Clock::time_point now) const {
+    if (count == 0) {
+        return -1;
+    }
+
+    // The first occupied slot of each level after the one the wheel is at,
+    // found by rotating that level's bitmap to start there
+    uint64_t next = UINT64_MAX;
+    for (unsigned level = 0; level < LEVELS; ++level) {
+        if (occupied[level] == 0) {
+            continue;
+        }
+        const uint64_t index = (current >> (SLOT_BITS * level)) + 1;
+        const uint64_t rotated = std::rotr(occupied[level], static_cast<int>(index & (SLOTS - 1)));
+        next = std::min(next, (index + std::countr_zero(rotated)) << (SLOT_BITS * level));
+    }
+
+    const auto wait = std::chrono::ceil<std::chrono::milliseconds>(start + next * TICK - now);
+    return static_cast<int>(std::clamp<int64_t>(wait.count(), 0, INT_MAX));
+}
+
+Deadline ConnectionTimes::deadline(const PhaseTimeouts& timeouts, bool writing, bool idle, bool readingBody) const {
+    auto after = [](Clock::time_point since, std::chrono::seconds limit, metrics::Timeout phase) {
+        return limit.count() > 0 ? Deadline{since + limit, phase} : Deadline{Clock::time_point::max(), phase};
+    };
+    if (writing) {
+        return after(lastWrite, timeouts.send, metrics::Timeout::Send);
+    }
+    if (idle) {
+        return after(lastWrite, timeouts.idle, metrics::Timeout::Idle);
+    }
+    if (readingBody) {
+        return after(bodyStarted, timeouts.body, metrics::Timeout::Body);
+    }
+    return after(requestStarted, timeouts.header, metrics::Timeout::Header);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "metrics.h"
+
+// Hierarchical timer wheel for connection deadlines: four levels of 64
+// slots with a 100 ms tick, so level 0 spans 6.4 s, each level above spans
+// 64 times the one below, and the top reaches about 19 days. Scheduling
+// and firing are O(1); a timer far out sits in a coarse slot and is moved
+// down a level each time the wheel reaches that slot, until it lands in
+// level 0 and fires on its own tick.
+//
+// Timers are never cancelled. A connection remembers the tick of the one
+// entry it has in the wheel; when an entry fires that no longer matches,
+// or whose connection has since moved its deadline later, the loop drops
+// or reschedules it. Not thread-safe: each worker loop owns its wheel.
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr auto TICK = std::chrono::milliseconds(100);
+    static constexpr unsigned LEVELS = 4;
+    static constexpr unsigned SLOT_BITS = 6;
+    static constexpr uint64_t SLOTS = uint64_t(1) << SLOT_BITS;
+
+    struct Timer {
+        int socket;
+        uint64_t connectionId;
+        uint64_t tick; // the tick it fired on, as schedule() returned it
+    };
+
+    explicit TimerWheel(Clock::time_point start = Clock::now());
+
+    // First tick at or after time
+    uint64_t tickAt(Clock::time_point time) const;
+    // Fires on tick, or on the next tick if that has passed. Ticks beyond
+    // the top level are brought in to its end. Returns the tick it will fire on.
+    uint64_t schedule(uint64_t tick, int socket, uint64_t connectionId);
+    // Moves the wheel up to now, appending every timer that came due
+    void advance(Clock::time_point now, std::vector<Timer>& expired);
+    // Milliseconds until the next tick that fires or cascades a timer, -1 if
+    // none is scheduled; an epoll_wait timeout
+    int timeoutMs(Clock::time_point now) const;
+    size_t size() const { return count; }
+
+private:
+    Clock::time_point start;
+    uint64_t current = 0; // last tick advanced to
+    std::array<std::array<std::vector<Timer>, SLOTS>, LEVELS> slots;
+    std::array<uint64_t, LEVELS> occupied{}; // a bit for every slot holding timers
+    size_t count = 0;
+
+    void insert(const Timer& timer);
+};
+
+// Limits on the phases of a connection; 0 leaves a phase unlimited
+struct PhaseTimeouts {
+    std::chrono::seconds idle{0};   // keep-alive wait after a response
+    std::chrono::seconds header{0}; // from accept or the first byte of a request to the end of its head
+    std::chrono::seconds body{0};   // from the end of the head to the end of the body
+    std::chrono::seconds send{0};   // a pending response without a byte written
+};
+
+// When a connection's current phase runs out, and which phase that is
+struct Deadline {
+    TimerWheel::Clock::time_point at = TimerWheel::Clock::time_point::max();
+    metrics::Timeout phase = metrics::Timeout::Idle;
+};
+
+// What the phase deadlines of one connection are measured from. A request
+// head has to be complete within the header timeout of its first byte,
+// however slowly it trickles in, so a client cannot hold a connection by
+// sending a byte at a time.
+struct ConnectionTimes {
+    using Clock = TimerWheel::Clock;
+
+    Clock::time_point requestStarted; // accept, or the first byte of the request being read
+    Clock::time_point bodyStarted;    // end of that request's head, epoch until then
+    Clock::time_point lastWrite;      // last response bytes written, or the response finished
+    uint64_t timerTick = 0;           // tick of the connection's entry in the wheel, 0 if none
+
+    // writing: responses are pending; idle: nothing buffered after a served
+    // request; readingBody: the buffered request's head is complete
+    Deadline deadline(const PhaseTimeouts& timeouts, bool writing, bool idle, bool readingBody) const;
+};
@@ -0,0 +1,522 @@
+#include "tree_scan.h"
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <thread>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int64_t NANOSECONDS_PER_SECOND = 1'000'000'000;
+
+// Timestamps come from a clock that ticks every few milliseconds, so an
+// entry added right after a directory was listed can leave its mtime as it
+// was. Only an mtime older than this before the scan started proves the
+// listing is still complete.
+constexpr int64_t UNTRUSTED_AGE = NANOSECONDS_PER_SECOND;
+
+constexpr unsigned FILE_MASK = STATX_TYPE | STATX_MODE | STATX_INO | STATX_SIZE | STATX_MTIME;
+
+// An entry of the directory being listed, its name in the worker's scratch buffer
+struct Listed {
+    uint32_t offset;
+    uint32_t length;
+    bool directory;
+};
+
+int64_t toNanoseconds(const statx_timestamp& time) {
+    return time.tv_sec * NANOSECONDS_PER_SECOND + time.tv_nsec;
+}
+
+int64_t wallClockNow() {
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec * NANOSECONDS_PER_SECOND + now.tv_nsec;
+}
+
+std::string joinPath(const std::string& directory, std::string_view name) {
+    std::string path;
+    path.reserve(directory.size() + 1 + name.size());
+    path += directory;
+    path += '/';
+    path += name;
+    return path;
+}
+
+}
+
+bool isIgnoredFile(std::string_view filename) {
+    return filename.starts_with(".") ||
+        filename.ends_with(".tmp") ||
+        filename.ends_with(".swp") ||
+        filename.ends_with(".log");
+}
+
+struct FileTree::ScanJob {
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<Directory*> pending;
+    size_t busy = 0; // directories being scanned; the job is done when none are and none are pending
+    bool reportAdded = true;
+    int64_t trustedBefore = 0;
+    TreeChanges changes;
+    int64_t fileDelta = 0;
+};
+
+std::string_view FileTree::Directory::name() const {
+    return std::string_view(path).substr(path.rfind('/') + 1);
+}
+
+void FileTree::build(const std::string& root, unsigned threads) {
+    this->root = root;
+    directoryByPath.clear();
+    freeDirectories.clear();
+    directories.clear();
+    fileCount = 0;
+
+    Directory& top = directories.emplace_back();
+    top.path = root;
+    directoryByPath.emplace(top.path, &top);
+    run(&top, threads, false);
+}
+
+TreeChanges FileTree::scan(const std::string& directory, unsigned threads) {
+    Directory* start = ensureDirectory(directory);
+    if (start == nullptr) {
+        return {};
+    }
+    return run(start, threads, true);
+}
+
+TreeChanges FileTree::run(Directory* start, unsigned threads, bool reportAdded) {
+    ScanJob job;
+    job.reportAdded = reportAdded;
+    job.trustedBefore = wallClockNow() - UNTRUSTED_AGE;
+    job.pending.push_back(start);
+
+    // The calling thread scans too; helpers that start after the last
+    // directory was taken find nothing to do and return
+    std::vector<std::thread> helpers;
+    for (unsigned i = 1; i < threads; ++i) {
+        helpers.emplace_back([this, &job] { work(job); });
+    }
+    work(job);
+    for (std::thread& helper : helpers) {
+        helper.join();
+    }
+
+    fileCount += job.fileDelta;
+    return std::move(job.changes);
+}
+
+void FileTree::work(ScanJob& job) {
+    TreeChanges changes;
+    int64_t fileDelta = 0;
+    std::vector<Directory*> found;
+
+    std::unique_lock<std::mutex> lock(job.mutex);
+    while (true) {
+        job.wake.wait(lock, [&job] { return !job.pending.empty() || job.busy == 0; });
+        if (job.pending.empty()) {
+            break;
+        }
+        Directory* directory = job.pending.back();
+        job.pending.pop_back();
+        ++job.busy;
+        lock.unlock();
+
+        found.clear();
+        scanDirectory(*directory, job, changes, fileDelta, found);
+
+        lock.lock();
+        --job.busy;
+        job.pending.insert(job.pending.end(), found.begin(), found.end());
+        if (!found.empty() || job.busy == 0) {
+            job.wake.notify_all();
+        }
+    }
+
+    job.fileDelta += fileDelta;
+    auto append = [](std::vector<std::string>& to, std::vector<std::string>& from) {
+        to.insert(to.end(), std::make_move_iterator(from.begin()), std::make_move_iterator(from.end()));
+    };
+    append(job.changes.added, changes.added);
+    append(job.changes.modified, changes.modified);
+    append(job.changes.deleted, changes.deleted);
+}
+
+void FileTree::scanDirectory(Directory& directory, ScanJob& job, TreeChanges& changes, int64_t& fileDelta,
+                             std::vector<Directory*>& found) {
+    int fd = open(directory.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT || errno == ENOTDIR) {
+            // Gone since its parent was listed; the parent's next listing drops the node
+            clearDirectory(directory, &changes.deleted, fileDelta);
+        }
+        return; // unreadable: keep what we knew
+    }
+
+    struct statx self;
+    if (statx(fd, "", AT_EMPTY_PATH | AT_STATX_DONT_SYNC, STATX_INO | STATX_MTIME, &self) < 0) {
+        close(fd);
+        return;
+    }
+    const int64_t modified = toNanoseconds(self.stx_mtime);
+
+    if (modified == directory.modified && self.stx_ino == directory.inode) {
+        // Same entries as last time, only the files themselves may have changed
+        size_t kept = 0;
+        for (const File& file : directory.files) {
+            const std::string_view name = directory.nameOf(file);
+            struct statx info;
+            if (statx(fd, name.data(), AT_STATX_DONT_SYNC, FILE_MASK, &info) < 0 || !S_ISREG(info.stx_mode)) {
+                // The directory changed within its mtime after all; list it next time
+                changes.deleted.push_back(joinPath(directory.path, name));
+                directory.deadNameBytes += file.nameLength + 1;
+                directory.modified = -1;
+                --fileDelta;
+                continue;
+            }
+            File current{info.stx_ino, static_cast<int64_t>(info.stx_size), toNanoseconds(info.stx_mtime),
+                         file.contentHash, file.nameOffset, file.nameLength};
+            if (current.inode != file.inode || current.size != file.size || current.modified != file.modified) {
+                changes.modified.push_back(joinPath(directory.path, name));
+            }
+            directory.files[kept++] = current;
+        }
+        directory.files.resize(kept);
+        close(fd);
+        found.insert(found.end(), directory.subdirectories.begin(), directory.subdirectories.end());
+        return;
+    }
+
+    // List the directory into scratch space that lives as long as the thread.
+    // The records are dirent64s; glibc only wraps getdents64 from 2.30
+    thread_local std::string listedNames;
+    thread_local std::vector<Listed> listed;
+    listedNames.clear();
+    listed.clear();
+
+    alignas(dirent64) char buffer[32 * 1024];
+    long length;
+    while ((length = syscall(SYS_getdents64, fd, buffer, sizeof(buffer))) > 0) {
+        for (long position = 0; position < length;) {
+            auto* entry = reinterpret_cast<const dirent64*>(buffer + position);
+            position += entry->d_reclen;
+
+            const std::string_view name(entry->d_name);
+            if (name == "." || name == "..") {
+                continue;
+            }
+            bool isDirectory = entry->d_type == DT_DIR;
+            if (entry->d_type == DT_UNKNOWN) {
+                // Some file systems leave the type to a stat; symlinked directories are not followed
+                struct statx kind;
+                isDirectory = statx(fd, entry->d_name, AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC, STATX_TYPE, &kind) == 0 &&
+                    S_ISDIR(kind.stx_mode);
+            }
+            if (!isDirectory && isIgnoredFile(name)) {
+                continue;
+            }
+            listed.push_back({static_cast<uint32_t>(listedNames.size()), static_cast<uint32_t>(name.size()), isDirectory});
+            listedNames.append(name);
+            listedNames.push_back('\0');
+        }
+    }
+    if (length < 0) {
+        close(fd);
+        return;
+    }
+
+    auto nameOf = [](const Listed& entry) {
+        return std::string_view(listedNames.data() + entry.offset, entry.length);
+    };
+    std::sort(listed.begin(), listed.end(), [&](const Listed& a, const Listed& b) { return nameOf(a) < nameOf(b); });
+
+    // Merge the sorted listing with the sorted records from last time
+    std::string names;
+    std::vector<File> files;
+    std::vector<Directory*> subdirectories;
+    names.reserve(listedNames.size());
+    files.reserve(listed.size());
+    size_t oldFile = 0;
+    size_t oldDirectory = 0;
+    for (const Listed& entry : listed) {
+        const std::string_view name = nameOf(entry);
+
+        if (entry.directory) {
+            while (oldDirectory < directory.subdirectories.size() &&
+                   directory.subdirectories[oldDirectory]->name() < name) {
+                dropDirectory(*directory.subdirectories[oldDirectory++], &changes.deleted, fileDelta);
+            }
+            if (oldDirectory < directory.subdirectories.size() &&
+                directory.subdirectories[oldDirectory]->name() == name) {
+                subdirectories.push_back(directory.subdirectories[oldDirectory++]);
+            } else {
+                subdirectories.push_back(createDirectory(&directory, name));
+            }
+            continue;
+        }
+
+        while (oldFile < directory.files.size() && directory.nameOf(directory.files[oldFile]) < name) {
+            changes.deleted.push_back(joinPath(directory.path, directory.nameOf(directory.files[oldFile++])));
+            --fileDelta;
+        }
+        const File* previous = nullptr;
+        if (oldFile < directory.files.size() && directory.nameOf(directory.files[oldFile]) == name) {
+            previous = &directory.files[oldFile++];
+        }
+
+        // Follows symlinks, so a link to a file is served like the file
+        struct statx info;
+        if (statx(fd, name.data(), AT_STATX_DONT_SYNC, FILE_MASK, &info) < 0 || !S_ISREG(info.stx_mode)) {
+            if (previous != nullptr) {
+                changes.deleted.push_back(joinPath(directory.path, name));
+                --fileDelta;
+            }
+            continue;
+        }
+        File file{info.stx_ino, static_cast<int64_t>(info.stx_size), toNanoseconds(info.stx_mtime),
+                  previous != nullptr ? previous->contentHash : 0, static_cast<uint32_t>(names.size()),
+                  static_cast<uint32_t>(name.size())};
+        names.append(name);
+        names.push_back('\0'); // so a name can be handed to statx as it is
+
+        if (previous == nullptr) {
+            ++fileDelta;
+            if (job.reportAdded) {
+                changes.added.push_back(joinPath(directory.path, name));
+            }
+        } else if (file.inode != previous->inode || file.size != previous->size || file.modified != previous->modified) {
+            changes.modified.push_back(joinPath(directory.path, name));
+        }
+        files.push_back(file);
+    }
+    for (; oldFile < directory.files.size(); ++oldFile) {
+        changes.deleted.push_back(joinPath(directory.path, directory.nameOf(directory.files[oldFile])));
+        --fileDelta;
+    }
+    for (; oldDirectory < directory.subdirectories.size(); ++oldDirectory) {
+        dropDirectory(*directory.subdirectories[oldDirectory], &changes.deleted, fileDelta);
+    }
+    close(fd);
+
+    names.shrink_to_fit();
+    files.shrink_to_fit();
+    directory.names = std::move(names);
+    directory.files = std::move(files);
+    directory.subdirectories = std::move(subdirectories);
+    directory.deadNameBytes = 0;
+    directory.modified = modified < job.trustedBefore ? modified : -1;
+    directory.inode = self.stx_ino;
+    found.insert(found.end(), directory.subdirectories.begin(), directory.subdirectories.end());
+}
+
+bool FileTree::update(const std::string& path, const FileState& state) {
+    const size_t slash = path.rfind('/');
+    Directory* directory = slash == std::string::npos ? nullptr : ensureDirectory(std::string_view(path).substr(0, slash));
+    if (directory == nullptr) {
+        return false;
+    }
+    const std::string_view name = std::string_view(path).substr(slash + 1);
+    const int64_t modified = state.modified.tv_sec * NANOSECONDS_PER_SECOND + state.modified.tv_nsec;
+
+    auto it = lowerBound(*directory, name);
+    if (it != directory->files.end() && directory->nameOf(*it) == name) {
+        it->inode = state.inode;
+        it->size = state.size;
+        it->modified = modified;
+        return false;
+    }
+    File file{static_cast<uint64_t>(state.inode), state.size, modified, 0,
+              static_cast<uint32_t>(directory->names.size()), static_cast<uint32_t>(name.size())};
+    directory->names.append(name);
+    directory->names.push_back('\0');
+    directory->files.insert(it, file);
+    ++fileCount;
+    return true;
+}
+
+bool FileTree::remove(const std::string& path) {
+    const size_t slash = path.rfind('/');
+    Directory* directory = slash == std::string::npos ? nullptr : findDirectory(std::string_view(path).substr(0, slash));
+    if (directory == nullptr) {
+        return false;
+    }
+    const std::string_view name = std::string_view(path).substr(slash + 1);
+    auto it = lowerBound(*directory, name);
+    if (it == directory->files.end() || directory->nameOf(*it) != name) {
+        return false;
+    }
+    directory->deadNameBytes += it->nameLength + 1;
+    directory->files.erase(it);
+    --fileCount;
+
+    // Rewrite the arena once most of it is names of removed files
+    if (directory->deadNameBytes > directory->names.size() / 2) {
+        std::string names;
+        names.reserve(directory->names.size() - directory->deadNameBytes);
+        for (File& file : directory->files) {
+            const std::string_view fileName = directory->nameOf(file);
+            file.nameOffset = static_cast<uint32_t>(names.size());
+            names.append(fileName);
+            names.push_back('\0');
+        }
+        directory->names = std::move(names);
+        directory->deadNameBytes = 0;
+    }
+    return true;
+}
+
+uint64_t FileTree::contentHash(const std::string& path) {
+    const File* file = findFile(path);
+    return file != nullptr ? file->contentHash : 0;
+}
+
+void FileTree::setContentHash(const std::string& path, uint64_t hash) {
+    if (File* file = findFile(path)) {
+        file->contentHash = hash;
+    }
+}
+
+std::vector<std::string> FileTree::removeDirectory(const std::string& directory) {
+    std::vector<std::string> deleted;
+    Directory* node = findDirectory(directory);
+    if (node == nullptr) {
+        return deleted;
+    }
+    int64_t fileDelta = 0;
+    if (directory == root) {
+        clearDirectory(*node, &deleted, fileDelta);
+    } else {
+        if (Directory* parent = findDirectory(std::string_view(directory).substr(0, directory.rfind('/')))) {
+            std::erase(parent->subdirectories, node);
+            parent->modified = -1; // its listing no longer says what is on disk
+        }
+        dropDirectory(*node, &deleted, fileDelta);
+    }
+    fileCount += fileDelta;
+    return deleted;
+}
+
+size_t FileTree::memoryUsage() const {
+    size_t bytes = directories.size() * sizeof(Directory) +
+        directoryByPath.bucket_count() * sizeof(void*) +
+        directoryByPath.size() * (sizeof(std::string_view) + 2 * sizeof(void*));
+    for (const Directory& directory : directories) {
+        bytes += directory.path.capacity() + directory.names.capacity() +
+            directory.files.capacity() * sizeof(File) +
+            directory.subdirectories.capacity() * sizeof(Directory*);
+    }
+    return bytes;
+}
+
+void FileTree::forEach(const std::function<void(const std::string& path, const FileState& state)>& visit) const {
+    std::string path;
+    for (const Directory& directory : directories) {
+        if (directory.removed) {
+            continue;
+        }
+        for (const File& file : directory.files) {
+            path.assign(directory.path);
+            path += '/';
+            path += directory.nameOf(file);
+            FileState state;
+            state.inode = file.inode;
+            state.size = file.size;
+            state.modified.tv_sec = file.modified / NANOSECONDS_PER_SECOND;
+            state.modified.tv_nsec = file.modified % NANOSECONDS_PER_SECOND;
+            visit(path, state);
+        }
+    }
+}
+
+FileTree::Directory* FileTree::findDirectory(std::string_view path) {
+    auto it = directoryByPath.find(path);
+    return it == directoryByPath.end() ? nullptr : it->second;
+}
+
+FileTree::File* FileTree::findFile(const std::string& path) {
+    const size_t slash = path.rfind('/');
+    Directory* directory = slash == std::string::npos ? nullptr : findDirectory(std::string_view(path).substr(0, slash));
+    if (directory == nullptr) {
+        return nullptr;
+    }
+    const std::string_view name = std::string_view(path).substr(slash + 1);
+    auto it = lowerBound(*directory, name);
+    return it != directory->files.end() && directory->nameOf(*it) == name ? &*it : nullptr;
+}
+
+FileTree::Directory* FileTree::ensureDirectory(std::string_view path) {
+    if (Directory* directory = findDirectory(path)) {
+        return directory;
+    }
+    // Directories the tree has not listed yet, say ones the watcher reports
+    // before any scan reached them; their next scan lists them
+    const size_t slash = path.rfind('/');
+    if (slash == std::string_view::npos || path.size() <= root.size() || !path.starts_with(root) ||
+        path[root.size()] != '/') {
+        return nullptr;
+    }
+    Directory* parent = ensureDirectory(path.substr(0, slash));
+    if (parent == nullptr) {
+        return nullptr;
+    }
+    const std::string_view name = path.substr(slash + 1);
+    Directory* directory = createDirectory(parent, name);
+    auto position = std::lower_bound(parent->subdirectories.begin(), parent->subdirectories.end(), name,
+                                     [](const Directory* a, std::string_view b) { return a->name() < b; });
+    parent->subdirectories.insert(position, directory);
+    parent->modified = -1; // the node may not exist on disk; the next listing settles it
+    return directory;
+}
+
+FileTree::Directory* FileTree::createDirectory(Directory* parent, std::string_view name) {
+    std::lock_guard<std::mutex> lock(structureMutex);
+    Directory* directory;
+    if (!freeDirectories.empty()) {
+        directory = freeDirectories.back();
+        freeDirectories.pop_back();
+        *directory = Directory();
+    } else {
+        directory = &directories.emplace_back();
+    }
+    directory->path = joinPath(parent->path, name);
+    directoryByPath.emplace(directory->path, directory);
+    return directory;
+}
+
+void FileTree::clearDirectory(Directory& directory, std::vector<std::string>* deleted, int64_t& fileDelta) {
+    if (deleted != nullptr) {
+        for (const File& file : directory.files) {
+            deleted->push_back(joinPath(directory.path, directory.nameOf(file)));
+        }
+    }
+    fileDelta -= static_cast<int64_t>(directory.files.size());
+    for (Directory* subdirectory : directory.subdirectories) {
+        dropDirectory(*subdirectory, deleted, fileDelta);
+    }
+    directory.files = {};
+    directory.names = {};
+    directory.subdirectories = {};
+    directory.deadNameBytes = 0;
+    directory.modified = -1;
+}
+
+void FileTree::dropDirectory(Directory& directory, std::vector<std::string>* deleted, int64_t& fileDelta) {
+    clearDirectory(directory, deleted, fileDelta);
+    std::lock_guard<std::mutex> lock(structureMutex);
+    directoryByPath.erase(directory.path);
+    directory = Directory();
+    directory.removed = true;
+    freeDirectories.push_back(&directory);
+}
+
+std::vector<FileTree::File>::iterator FileTree::lowerBound(Directory& directory, std::string_view name) {
+    return std::lower_bound(directory.files.begin(), directory.files.end(), name,
+                            [&directory](const File& file, std::string_view key) { return directory.nameOf(file) < key; });
+}
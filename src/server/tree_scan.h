@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+#include <time.h>
+
+// Editor swap files, logs and dotfiles never trigger a reload
+bool isIgnoredFile(std::string_view filename);
+
+// What change detection compares of a file, as statx(2) reports it
+struct FileState {
+    ino_t inode = 0;
+    off_t size = 0;
+    timespec modified{};
+};
+
+// Files that appeared, changed or disappeared in a scan, by full path
+struct TreeChanges {
+    std::vector<std::string> added;
+    std::vector<std::string> modified;
+    std::vector<std::string> deleted;
+
+    bool empty() const { return added.empty() && modified.empty() && deleted.empty(); }
+};
+
+// Every regular, non-ignored file below the served root, for watch mode
+// and the path index on trees of a million files. Scans fan out over
+// threads by directory, listing each one with getdents64 and statx'ing its
+// files relative to the directory's fd. A file costs a fixed 40-byte record
+// plus its name, interned into one buffer per directory, rather than a heap
+// string of its full path in a hash node.
+//
+// A directory whose mtime has not moved since it was last listed has the
+// same entries, so its listing is reused and only its files are statx'd
+// again: file contents change without touching the directory's mtime.
+//
+// Not thread-safe: the watcher thread owns the tree, scan() parallelizes
+// internally.
+class FileTree {
+public:
+    FileTree() = default;
+    FileTree(const FileTree&) = delete;
+    FileTree& operator=(const FileTree&) = delete;
+
+    // Forgets everything and scans root from scratch, reporting nothing
+    void build(const std::string& root, unsigned threads);
+
+    // Rescans directory, the root or a directory below it, and reports what
+    // changed since the tree last saw it. Directories that cannot be read
+    // keep the files they had.
+    TreeChanges scan(const std::string& directory, unsigned threads);
+
+    // Records one file the watcher saw written; true if it is new
+    bool update(const std::string& path, const FileState& state);
+    // False if the file was not known
+    bool remove(const std::string& path);
+    // Hash of the file's bytes as last seen, 0 until someone computed one.
+    // Kept across mtime changes, so it can tell whether the bytes changed too.
+    uint64_t contentHash(const std::string& path);
+    void setContentHash(const std::string& path, uint64_t hash);
+    // Forgets directory and everything below it, returning the files it held
+    std::vector<std::string> removeDirectory(const std::string& directory);
+
+    size_t size() const { return fileCount; }
+    // Bytes held by the records, names and directories
+    size_t memoryUsage() const;
+    void forEach(const std::function<void(const std::string& path, const FileState& state)>& visit) const;
+
+private:
+    struct File {
+        uint64_t inode;
+        int64_t size;
+        int64_t modified; // ns since the epoch
+        uint64_t contentHash; // 0 if never hashed
+        uint32_t nameOffset; // into Directory::names
+        uint32_t nameLength;
+    };
+
+    struct Directory {
+        std::string path;
+        int64_t modified = -1; // mtime when last listed, -1 if the listing cannot be trusted
+        uint64_t inode = 0;
+        std::string names; // arena of the file names
+        uint32_t deadNameBytes = 0; // names of removed files, reclaimed on the next listing
+        std::vector<File> files; // sorted by name
+        std::vector<Directory*> subdirectories; // sorted by name
+        bool removed = false;
+
+        std::string_view nameOf(const File& file) const { return {names.data() + file.nameOffset, file.nameLength}; }
+        std::string_view name() const;
+    };
+
+    struct ScanJob;
+
+    std::string root;
+    std::deque<Directory> directories; // stable addresses; removed ones are reused
+    std::vector<Directory*> freeDirectories;
+    std::unordered_map<std::string_view, Directory*> directoryByPath; // keys view Directory::path
+    std::mutex structureMutex; // directories, freeDirectories and directoryByPath during a scan
+    size_t fileCount = 0;
+
+    TreeChanges run(Directory* start, unsigned threads, bool reportAdded);
+    void work(ScanJob& job);
+    void scanDirectory(Directory& directory, ScanJob& job, TreeChanges& changes, int64_t& fileDelta,
+                       std::vector<Directory*>& found);
+    Directory* findDirectory(std::string_view path);
+    File* findFile(const std::string& path);
+    Directory* ensureDirectory(std::string_view path);
+    Directory* createDirectory(Directory* parent, std::string_view name);
+    void clearDirectory(Directory& directory, std::vector<std::string>* deleted, int64_t& fileDelta);
+    void dropDirectory(Directory& directory, std::vector<std::string>* deleted, int64_t& fileDelta);
+    static std::vector<File>::iterator lowerBound(Directory& directory, std::string_view name);
+};
@@ -0,0 +1,604 @@
+#include "uring_loop.h"
+#include "metrics.h"
+#include "server.h"
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr unsigned RING_ENTRIES = 1024;
+constexpr size_t MAX_PIPELINED_RESPONSES = 16;
+constexpr size_t RECEIVE_SIZE = 16384;
+
+// Buffered file bodies go through a small pool of registered buffers, so
+// the kernel never has to pin and map user pages per read
+constexpr size_t BUFFER_COUNT = 16;
+constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+// Spliced file bodies move through the pipe this much at a time
+constexpr int PIPE_SIZE = 256 * 1024;
+
+// Longest the loop sleeps between timer wheel turns; a deadline scheduled
+// during a sleep fires at most this late
+constexpr int MAX_TIMER_WAIT_MS = 1000;
+
+// Completions carry the socket and the operation in their user data
+uint64_t tag(int fd, uint8_t op) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(fd)) << 8) | op;
+}
+
+}
+
+bool UringLoop::supported() {
+    static const bool result = [] {
+        IoUring probe(8);
+        return probe.valid() &&
+            probe.supports({IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_SEND,
+                            IORING_OP_SPLICE, IORING_OP_READ_FIXED, IORING_OP_READ, IORING_OP_TIMEOUT});
+    }();
+    return result;
+}
+
+UringLoop::UringLoop(Server& server, int listenSocket, WorkerStats& stats)
+    : server(server), listenSocket(listenSocket), stats(stats), ring(RING_ENTRIES),
+      timeouts(server.phaseTimeouts()) {
+    if (!ring.valid()) {
+        return;
+    }
+
+    // Accepts name the listening socket by its slot in the registered table
+    fixedListenSocket = ring.registerFiles(&listenSocket, 1) == 0;
+
+    bufferMemory = std::make_unique<char[]>(BUFFER_COUNT * BUFFER_SIZE);
+    iovec buffers[BUFFER_COUNT];
+    for (size_t i = 0; i < BUFFER_COUNT; ++i) {
+        buffers[i] = {bufferMemory.get() + i * BUFFER_SIZE, BUFFER_SIZE};
+        freeBuffers.push_back(static_cast<int>(i));
+    }
+    // Older kernels charge registered buffers against RLIMIT_MEMLOCK; plain
+    // reads into the same memory still work without them
+    fixedBuffers = ring.registerBuffers(buffers, BUFFER_COUNT) == 0;
+}
+
+UringLoop::~UringLoop() {
+    for (auto& [clientSocket, connection] : connections) {
+        close(clientSocket);
+        for (int end : connection.pipe) {
+            if (end >= 0) close(end);
+        }
+    }
+}
+
+void UringLoop::run() {
+    // Registered ring descriptors belong to the thread that registers them
+    ring.registerRingFd();
+
+    armAccept();
+    armWake();
+    armTimeout();
+
+    while (true) {
+        // Everything queued while handling the last batch goes out with the wait
+        if (ring.submit(1) < 0 && errno != EBUSY) {
+            std::cerr << "io_uring_enter failed: " << strerror(errno) << std::endl;
+            return;
+        }
+        ring.drainCompletions([this](const io_uring_cqe& cqe) { onCompletion(cqe); });
+    }
+}
+
+void UringLoop::armAccept() {
+    io_uring_sqe* sqe = ring.nextSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fixedListenSocket ? 0 : listenSocket;
+    sqe->flags = fixedListenSocket ? IOSQE_FIXED_FILE : 0;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->ioprio = multishotAccept ? IORING_ACCEPT_MULTISHOT : 0;
+    sqe->user_data = tag(listenSocket, static_cast<uint8_t>(Op::Accept));
+}
+
+void UringLoop::armTimeout() {
+    // Until the wheel's next tick that fires a timer, or the longest sleep
+    int wait = timers.timeoutMs(Clock::now());
+    if (wait < 0 || wait > MAX_TIMER_WAIT_MS) {
+        wait = MAX_TIMER_WAIT_MS;
+    }
+    wait = std::max(wait, 1);
+    timerInterval.tv_sec = wait / 1000;
+    timerInterval.tv_nsec = (wait % 1000) * 1000000L;
+
+    io_uring_sqe* sqe = ring.nextSqe();
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<uint64_t>(&timerInterval);
+    sqe->len = 1;
+    sqe->user_data = tag(listenSocket, static_cast<uint8_t>(Op::Timeout));
+}
+
+void UringLoop::armWake() {
+    io_uring_sqe* sqe = ring.nextSqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = resumeQueue.fd();
+    sqe->addr = reinterpret_cast<uint64_t>(&wakeCount);
+    sqe->len = sizeof(wakeCount);
+    sqe->user_data = tag(resumeQueue.fd(), static_cast<uint8_t>(Op::Wake));
+}
+
+void UringLoop::resumeParked() {
+    for (auto [clientSocket, id] : resumeQueue.take()) {
+        auto it = connections.find(clientSocket);
+        if (it == connections.end() || it->second.id != id || !it->second.parked) {
+            continue; // closed while the pool was busy
+        }
+        it->second.parked = false;
+        it->second.resumed = true;
+        if (it->second.inFlight == 0) {
+            advance(clientSocket, it->second);
+        }
+    }
+}
+
+void UringLoop::onCompletion(const io_uring_cqe& cqe) {
+    const Op op = static_cast<Op>(cqe.user_data & 0xff);
+    const int fd = static_cast<int>(cqe.user_data >> 8);
+    switch (op) {
+    case Op::Accept:
+        onAccept(cqe);
+        return;
+    case Op::Timeout:
+        expireTimers();
+        armTimeout();
+        return;
+    case Op::Wake:
+        resumeParked();
+        armWake();
+        return;
+    default:
+        break;
+    }
+
+    auto it = connections.find(fd);
+    if (it == connections.end()) {
+        return;
+    }
+    Connection& connection = it->second;
+    --connection.inFlight;
+    if (!onResult(op, cqe.res, connection)) {
+        connection.failed = true;
+    }
+
+    // The rest of a linked chain completes first
+    if (connection.inFlight > 0) {
+        return;
+    }
+    if (connection.failed) {
+        closeConnection(fd);
+    } else {
+        advance(fd, connection);
+    }
+}
+
+void UringLoop::onAccept(const io_uring_cqe& cqe) {
+    if (cqe.res >= 0) {
+        const uint64_t startedAt = metrics::now();
+        const int clientSocket = cqe.res;
+        // A multishot accept cannot hand each connection its own address
+        // buffer; ask for it only when a per-address cap needs it
+        sockaddr_in peer{};
+        if (server.getOptions().maxConnectionsPerIp > 0) {
+            socklen_t peerLength = sizeof(peer);
+            getpeername(clientSocket, reinterpret_cast<sockaddr*>(&peer), &peerLength);
+        }
+        if (!server.admitConnection(clientSocket, peer.sin_addr.s_addr)) {
+            close(clientSocket);
+            if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                armAccept();
+            }
+            return;
+        }
+        Connection& connection = connections.try_emplace(clientSocket, &responseQueues).first->second;
+        connection.id = ++nextConnectionId;
+        connection.address = peer.sin_addr.s_addr;
+        connection.times.requestStarted = connection.times.lastWrite = Clock::now();
+        stats.add(stats.accepted);
+        metrics::countConnectionOpened();
+        advance(clientSocket, connection);
+        metrics::record(metrics::Stage::Accept, startedAt);
+    } else if (cqe.res == -EINVAL && multishotAccept) {
+        multishotAccept = false; // before 5.19, accept one at a time
+    } else if (cqe.res != -EAGAIN && cqe.res != -ECONNABORTED && cqe.res != -EINTR) {
+        std::cerr << "Accept failed: " << strerror(-cqe.res) << std::endl;
+    }
+
+    // A multishot accept stays armed until a completion says otherwise
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        armAccept();
+    }
+}
+
+bool UringLoop::onResult(Op op, int result, Connection& connection) {
+    if (result == -ECANCELED) {
+        // The link broke at a short read or splice; whatever did arrive is
+        // still in the pipe or buffer and goes out on the next turn. A
+        // cancelled receive ends the connection.
+        if (op == Op::Receive) {
+            connection.input.resize(connection.receiveOffset);
+            connection.receiving = false;
+            return false;
+        }
+        return true;
+    }
+
+    Response* response = connection.pending.empty() ? nullptr : &connection.pending.front();
+    switch (op) {
+    case Op::Receive:
+        connection.receiving = false;
+        connection.input.resize(connection.receiveOffset + std::max(result, 0));
+        if (result == 0) {
+            connection.closing = true; // no complete request will ever arrive
+            return true;
+        }
+        // Bytes trickling into a request do not move its deadline; only the
+        // first one after an idle spell starts the header clock
+        if (result > 0 && connection.receiveOffset == 0 && connection.requestsServed > 0) {
+            connection.times.requestStarted = Clock::now();
+        }
+        return result > 0;
+    case Op::Send:
+        if (result < 0) return false;
+        if (result > 0) connection.times.lastWrite = Clock::now();
+        response->sent += result;
+        response->bytesSent += result;
+        metrics::countBytesOut(result);
+        return true;
+    case Op::SpliceIn:
+        if (result == -EINVAL && connection.pipeBytes == 0) {
+            response->bufferedFile = true; // file system cannot splice, copy instead
+            return true;
+        }
+        if (result <= 0) return false; // error, or the file shrank underneath us
+        response->fileOffset += result;
+        response->fileLength -= result;
+        connection.pipeBytes += result;
+        return true;
+    case Op::SpliceOut:
+        if (result < 0) return false;
+        if (result > 0) connection.times.lastWrite = Clock::now();
+        connection.pipeBytes -= result;
+        response->bytesSent += result;
+        metrics::countBytesOut(result);
+        return true;
+    case Op::Read:
+        if (result <= 0) return false;
+        response->fileOffset += result;
+        response->fileLength -= result;
+        connection.bufferBytes = result;
+        connection.bufferSent = 0;
+        return true;
+    case Op::SendBuffer:
+        if (result < 0) return false;
+        if (result > 0) connection.times.lastWrite = Clock::now();
+        connection.bufferSent += result;
+        response->bytesSent += result;
+        metrics::countBytesOut(result);
+        if (connection.bufferSent == connection.bufferBytes) {
+            connection.bufferBytes = 0;
+            connection.bufferSent = 0;
+        }
+        return true;
+    default:
+        return true;
+    }
+}
+
+void UringLoop::advance(int clientSocket, Connection& connection) {
+    while (true) {
+        // Answer every complete request already buffered, in order
+        RequestArena::Scope arenaScope(connection.arena);
+        while (!connection.closing && !connection.parked && connection.pending.size() < MAX_PIPELINED_RESPONSES) {
+            Response response;
+            size_t consumed = server.handleRequest(connection.input, connection.parser,
+                                                   connection.requestsServed, response, !connection.resumed);
+            if (consumed == 0) {
+                break;
+            }
+            // The request stays buffered while the pool works for it, and is
+            // parsed again when the connection is resumed
+            if (response.blockingWork &&
+                server.offload(response, [this, clientSocket, id = connection.id]() {
+                    resumeQueue.push(clientSocket, id);
+                })) {
+                connection.parked = true;
+                break;
+            }
+            connection.resumed = false;
+            connection.input.erase(0, consumed);
+            ++connection.requestsServed;
+            stats.add(stats.requests);
+            connection.closing = !response.keepAlive && !response.sse;
+            const Clock::time_point now = Clock::now();
+            connection.times.requestStarted = now; // of whatever follows in the buffer
+            connection.times.bodyStarted = {};
+            if (connection.pending.empty()) {
+                connection.times.lastWrite = now; // the send clock starts with the first response
+            }
+            connection.pending.push_back(std::move(response));
+            if (connection.pending.back().sse) {
+                break; // the socket leaves the loop once it gets there
+            }
+        }
+        if (connection.parser.headComplete() && connection.times.bodyStarted == Clock::time_point()) {
+            connection.times.bodyStarted = Clock::now();
+        }
+
+        if (!connection.pending.empty()) {
+            Response& response = connection.pending.front();
+            if (response.sse) {
+                // Nothing is in flight, so the hub can take the socket as is
+                const uint64_t lastEventId = response.lastEventId;
+                releaseBuffer(connection);
+                for (int end : connection.pipe) {
+                    if (end >= 0) close(end);
+                }
+                const uint32_t address = connection.address;
+                connections.erase(clientSocket);
+                stats.add(stats.closed);
+                metrics::countConnectionClosed();
+                server.handleSSE(clientSocket, lastEventId, address);
+                return;
+            }
+            if (response.startedAt == 0) {
+                response.startedAt = metrics::now();
+            }
+            if (writeNext(clientSocket, connection, response)) {
+                armTimer(clientSocket, connection);
+                return; // its completion brings us back here
+            }
+            metrics::record(metrics::Stage::Send, response.startedAt);
+            response.finishLog();
+            releaseBuffer(connection);
+            connection.pending.pop_front();
+            if (connection.pending.empty()) {
+                connection.arena.reset(); // nothing built in it is alive
+            }
+            continue;
+        }
+
+        if (connection.parked) {
+            return; // resumeParked() carries on
+        }
+        if (connection.closing) {
+            closeConnection(clientSocket);
+            return;
+        }
+        receive(clientSocket, connection);
+        armTimer(clientSocket, connection);
+        return;
+    }
+}
+
+bool UringLoop::writeNext(int clientSocket, Connection& connection, Response& response) {
+    while (true) {
+        // Head and in-memory body in one gathered send. MSG_MORE holds back a
+        // partial segment while a file body or another part is about to follow.
+        const size_t count = response.unsentBuffers(connection.buffers);
+        if (count > 0) {
+            const bool more = response.fileLength > 0 || response.nextPart < response.parts.size();
+            connection.message = msghdr{};
+            connection.message.msg_iov = connection.buffers;
+            connection.message.msg_iovlen = count;
+
+            io_uring_sqe* sqe = ring.nextSqe();
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = clientSocket;
+            sqe->addr = reinterpret_cast<uint64_t>(&connection.message);
+            sqe->msg_flags = MSG_NOSIGNAL | (more ? MSG_MORE : 0);
+            sqe->user_data = tag(clientSocket, static_cast<uint8_t>(Op::Send));
+            ++connection.inFlight;
+            return true;
+        }
+
+        if (response.fileLength > 0 || connection.pipeBytes > 0 || connection.bufferBytes > 0) {
+            return writeFileChunk(clientSocket, connection, response);
+        }
+        if (!response.startNextPart()) {
+            return false;
+        }
+    }
+}
+
+bool UringLoop::writeFileChunk(int clientSocket, Connection& connection, Response& response) {
+    if (!response.bufferedFile || connection.pipeBytes > 0) {
+        if (connection.pipe[0] < 0) {
+            if (pipe2(connection.pipe, O_CLOEXEC) < 0) {
+                response.bufferedFile = true;
+                return writeFileChunk(clientSocket, connection, response);
+            }
+            fcntl(connection.pipe[1], F_SETPIPE_SZ, PIPE_SIZE); // best effort
+        }
+
+        // File to pipe, linked to pipe to socket: two operations, no copy
+        // through userspace. A short splice in breaks the link, and the
+        // bytes it did move go out on the next turn.
+        size_t chunk = connection.pipeBytes;
+        if (chunk == 0) {
+            chunk = std::min<size_t>(response.fileLength, PIPE_SIZE);
+            io_uring_sqe* sqe = ring.nextSqe();
+            sqe->opcode = IORING_OP_SPLICE;
+            sqe->fd = connection.pipe[1];
+            sqe->off = static_cast<uint64_t>(-1);
+            sqe->splice_fd_in = response.file.get();
+            sqe->splice_off_in = static_cast<uint64_t>(response.fileOffset);
+            sqe->len = static_cast<uint32_t>(chunk);
+            sqe->flags = IOSQE_IO_LINK;
+            sqe->user_data = tag(clientSocket, static_cast<uint8_t>(Op::SpliceIn));
+            ++connection.inFlight;
+        }
+        io_uring_sqe* sqe = ring.nextSqe();
+        sqe->opcode = IORING_OP_SPLICE;
+        sqe->fd = clientSocket;
+        sqe->off = static_cast<uint64_t>(-1);
+        sqe->splice_fd_in = connection.pipe[0];
+        sqe->splice_off_in = static_cast<uint64_t>(-1);
+        sqe->len = static_cast<uint32_t>(chunk);
+        sqe->user_data = tag(clientSocket, static_cast<uint8_t>(Op::SpliceOut));
+        ++connection.inFlight;
+        return true;
+    }
+
+    if (connection.buffer < 0) {
+        if (freeBuffers.empty()) {
+            waitingForBuffer.push_back(clientSocket);
+            return true; // resumed by releaseBuffer()
+        }
+        connection.buffer = freeBuffers.back();
+        freeBuffers.pop_back();
+    }
+    char* buffer = bufferMemory.get() + connection.buffer * BUFFER_SIZE;
+
+    // File into the registered buffer, linked to buffer to socket
+    size_t chunk = connection.bufferBytes - connection.bufferSent;
+    if (chunk == 0) {
+        chunk = std::min(response.fileLength, BUFFER_SIZE);
+        io_uring_sqe* sqe = ring.nextSqe();
+        sqe->opcode = fixedBuffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe->fd = response.file.get();
+        sqe->off = static_cast<uint64_t>(response.fileOffset);
+        sqe->addr = reinterpret_cast<uint64_t>(buffer);
+        sqe->len = static_cast<uint32_t>(chunk);
+        sqe->buf_index = static_cast<uint16_t>(connection.buffer);
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->user_data = tag(clientSocket, static_cast<uint8_t>(Op::Read));
+        ++connection.inFlight;
+    }
+    const bool more = response.fileLength > chunk || response.nextPart < response.parts.size();
+    io_uring_sqe* sqe = ring.nextSqe();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = clientSocket;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer + connection.bufferSent);
+    sqe->len = static_cast<uint32_t>(chunk);
+    sqe->msg_flags = MSG_NOSIGNAL | (more ? MSG_MORE : 0);
+    sqe->user_data = tag(clientSocket, static_cast<uint8_t>(Op::SendBuffer));
+    ++connection.inFlight;
+    return true;
+}
+
+void UringLoop::receive(int clientSocket, Connection& connection) {
+    // The parser rejects anything that outgrows MAX_REQUEST_SIZE, so the
+    // buffer never grows past that plus one receive
+    connection.receiveOffset = connection.input.size();
+    connection.input.resize(connection.receiveOffset + RECEIVE_SIZE);
+    connection.receiving = true;
+
+    io_uring_sqe* sqe = ring.nextSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = clientSocket;
+    sqe->addr = reinterpret_cast<uint64_t>(connection.input.data() + connection.receiveOffset);
+    sqe->len = RECEIVE_SIZE;
+    sqe->user_data = tag(clientSocket, static_cast<uint8_t>(Op::Receive));
+    ++connection.inFlight;
+}
+
+void UringLoop::releaseBuffer(Connection& connection) {
+    if (connection.buffer < 0) {
+        return;
+    }
+    freeBuffers.push_back(connection.buffer);
+    connection.buffer = -1;
+    connection.bufferBytes = 0;
+    connection.bufferSent = 0;
+
+    // Hand it straight to a connection that has been waiting for one
+    while (!waitingForBuffer.empty()) {
+        const int clientSocket = waitingForBuffer.front();
+        waitingForBuffer.pop_front();
+        auto it = connections.find(clientSocket);
+        if (it != connections.end() && it->second.inFlight == 0 && !it->second.pending.empty()) {
+            advance(clientSocket, it->second);
+            return;
+        }
+    }
+}
+
+Deadline UringLoop::deadlineOf(const Connection& connection) const {
+    // While a receive is in flight the input is sized for it
+    const size_t buffered = connection.receiving ? connection.receiveOffset : connection.input.size();
+    return connection.times.deadline(timeouts, !connection.pending.empty(),
+                                     buffered == 0 && connection.requestsServed > 0,
+                                     connection.parser.headComplete());
+}
+
+void UringLoop::armTimer(int clientSocket, Connection& connection) {
+    if (connection.parked || connection.failed) {
+        return;
+    }
+    const Deadline deadline = deadlineOf(connection);
+    if (deadline.at == Clock::time_point::max()) {
+        return;
+    }
+    // An entry already firing sooner is enough: it re-arms for the rest
+    const uint64_t tick = timers.tickAt(deadline.at);
+    if (connection.times.timerTick == 0 || tick < connection.times.timerTick) {
+        connection.times.timerTick = timers.schedule(tick, clientSocket, connection.id);
+    }
+}
+
+void UringLoop::expireTimers() {
+    const Clock::time_point now = Clock::now();
+    expiredTimers.clear();
+    timers.advance(now, expiredTimers);
+    for (const TimerWheel::Timer& timer : expiredTimers) {
+        auto it = connections.find(timer.socket);
+        if (it == connections.end() || it->second.id != timer.connectionId ||
+            it->second.times.timerTick != timer.tick) {
+            continue; // closed, or superseded by an entry firing sooner
+        }
+        Connection& connection = it->second;
+        connection.times.timerTick = 0;
+        if (connection.parked || connection.failed) {
+            continue;
+        }
+
+        const Deadline deadline = deadlineOf(connection);
+        if (deadline.at > now) {
+            armTimer(timer.socket, connection); // the deadline moved on since this was scheduled
+            continue;
+        }
+        metrics::countTimeout(deadline.phase);
+        if (connection.inFlight == 0) {
+            closeConnection(timer.socket); // waiting for a registered buffer
+        } else {
+            // Fails the receive or send the kernel holds, and the last of
+            // them to complete closes the connection
+            connection.failed = true;
+            shutdown(timer.socket, SHUT_RDWR);
+        }
+    }
+}
+
+void UringLoop::closeConnection(int clientSocket) {
+    auto it = connections.find(clientSocket);
+    if (it == connections.end()) {
+        return;
+    }
+    Connection& connection = it->second;
+    if (!connection.pending.empty() && connection.pending.front().startedAt != 0) {
+        connection.pending.front().finishLog(); // cut off part way
+    }
+    releaseBuffer(connection);
+    for (int end : connection.pipe) {
+        if (end >= 0) close(end);
+    }
+    std::erase(waitingForBuffer, clientSocket);
+    server.releaseConnection(connection.address);
+    connections.erase(it);
+    close(clientSocket);
+    stats.add(stats.closed);
+    metrics::countConnectionClosed();
+}
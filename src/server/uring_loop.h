@@ -0,0 +1,127 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "event_loop.h"
+#include "http_parser.h"
+#include "io_uring.h"
+#include "request_arena.h"
+#include "response.h"
+#include "timer_wheel.h"
+
+class Server;
+
+// io_uring worker loop, the alternative to EventLoop. Connections arrive
+// from one multishot accept on the registered listening socket; every
+// receive, send and file read is an operation on the ring, so a whole batch
+// of connections is driven by a single io_uring_enter per turn. File bodies
+// are spliced through a pipe, or read into registered buffers when
+// sendfile-style zero copy is turned off.
+class UringLoop {
+public:
+    UringLoop(Server& server, int listenSocket, WorkerStats& stats);
+    ~UringLoop();
+
+    UringLoop(const UringLoop&) = delete;
+    UringLoop& operator=(const UringLoop&) = delete;
+
+    // Whether the running kernel has every operation the loop submits
+    static bool supported();
+
+    bool valid() const { return ring.valid() && resumeQueue.fd() >= 0; }
+    void run();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Op : uint8_t {
+        Accept,
+        Receive,
+        Send,       // head and in-memory body
+        SpliceIn,   // file into the connection's pipe
+        SpliceOut,  // pipe into the socket
+        Read,       // file into a registered buffer
+        SendBuffer, // registered buffer into the socket
+        Timeout,
+        Wake        // the resume queue's eventfd
+    };
+
+    // A connection is half-duplex: it is either receiving or writing its
+    // pending responses, so at most one operation chain is in flight
+    struct Connection {
+        uint64_t id = 0;
+        RequestArena arena;           // what pending responses are built in; outlives them
+        std::string input;
+        HttpParser parser;
+        std::pmr::deque<Response> pending; // pipelined responses, answered in order
+        unsigned requestsServed = 0;
+        unsigned inFlight = 0;        // operations the kernel still owns
+        bool closing = false;         // close once pending responses are written
+        bool failed = false;          // close as soon as nothing is in flight
+        bool receiving = false;
+        bool parked = false;          // the pool is doing blocking work for the next request
+        bool resumed = false;         // that work is done, answer the request inline
+        size_t receiveOffset = 0;     // input size before the receive in flight
+        uint32_t address = 0;         // client IPv4 address, counted by the connection caps
+        ConnectionTimes times;
+
+        // Kept here so they outlive the send that points at them
+        msghdr message{};
+        iovec buffers[Response::MAX_BUFFERS];
+
+        int pipe[2] = {-1, -1};
+        size_t pipeBytes = 0;        // spliced in from the file, not yet out
+        int buffer = -1;             // registered buffer held for a file body
+        size_t bufferBytes = 0;
+        size_t bufferSent = 0;
+
+        explicit Connection(std::pmr::memory_resource* responses) : pending(responses) {}
+    };
+
+    Server& server;
+    int listenSocket;
+    WorkerStats& stats;
+    IoUring ring;
+    bool fixedListenSocket = false;
+    bool multishotAccept = true;
+    bool fixedBuffers = false;
+    std::unique_ptr<char[]> bufferMemory;
+    std::vector<int> freeBuffers;
+    std::deque<int> waitingForBuffer; // connections with a buffered file body to send
+    __kernel_timespec timerInterval{}; // of the Timeout in flight
+    PhaseTimeouts timeouts;
+    TimerWheel timers;
+    std::vector<TimerWheel::Timer> expiredTimers; // reused by every expireTimers()
+    std::pmr::unsynchronized_pool_resource responseQueues; // pending queues recycle their nodes here
+    std::unordered_map<int, Connection> connections;
+    uint64_t nextConnectionId = 0;
+    ResumeQueue resumeQueue;
+    uint64_t wakeCount = 0; // eventfd read target
+
+    void armAccept();
+    void armTimeout();
+    void armWake();
+    void resumeParked();
+    void onCompletion(const io_uring_cqe& cqe);
+    void onAccept(const io_uring_cqe& cqe);
+    bool onResult(Op op, int result, Connection& connection);
+    void advance(int clientSocket, Connection& connection);
+    bool writeNext(int clientSocket, Connection& connection, Response& response);
+    bool writeFileChunk(int clientSocket, Connection& connection, Response& response);
+    void receive(int clientSocket, Connection& connection);
+    void releaseBuffer(Connection& connection);
+    Deadline deadlineOf(const Connection& connection) const;
+    // Makes sure the wheel fires no later than the connection's current deadline
+    void armTimer(int clientSocket, Connection& connection);
+    void expireTimers();
+    void closeConnection(int clientSocket);
+};
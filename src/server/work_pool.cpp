@@ -0,0 +1,221 @@
+#include "work_pool.h"
+
+namespace {
+
+// The worker the calling thread is, if it belongs to a pool
+thread_local const WorkPool* currentPool = nullptr;
+thread_local void* currentWorker = nullptr;
+
+// Counters with a single writer need no read-modify-write
+void bump(std::atomic<uint64_t>& counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+}
+
+bool WorkPool::StealingDeque::push(Task* task) {
+    const int64_t b = bottom.load(std::memory_order_relaxed);
+    const int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= CAPACITY) {
+        return false;
+    }
+    tasks[b & (CAPACITY - 1)].store(task, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+WorkPool::Task* WorkPool::StealingDeque::pop() {
+    const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+    if (t > b) {
+        bottom.store(b + 1, std::memory_order_relaxed); // empty
+        return nullptr;
+    }
+
+    Task* task = tasks[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (t == b) {
+        // Last task: race the thieves for it
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            task = nullptr;
+        }
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return task;
+}
+
+WorkPool::Task* WorkPool::StealingDeque::steal() {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b) {
+        return nullptr;
+    }
+    Task* task = tasks[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return nullptr; // lost to the owner or another thief
+    }
+    return task;
+}
+
+size_t WorkPool::StealingDeque::size() const {
+    const int64_t size = bottom.load(std::memory_order_relaxed) - top.load(std::memory_order_relaxed);
+    return size > 0 ? static_cast<size_t>(size) : 0;
+}
+
+void WorkPool::Group::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return pending.load() == 0; });
+}
+
+void WorkPool::Group::finish() {
+    if (pending.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(mutex);
+        done.notify_all();
+    }
+}
+
+WorkPool::WorkPool(unsigned threads, size_t queueLimit) : queueLimit(queueLimit) {
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i]->thread = std::thread([this, i] { run(*workers[i], i); });
+    }
+}
+
+WorkPool::~WorkPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker->thread.join();
+        while (Task* task = worker->deque.pop()) {
+            delete task;
+        }
+    }
+    for (Task* task : queue) {
+        delete task;
+    }
+}
+
+bool WorkPool::trySubmit(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queue.size() >= queueLimit) {
+            rejected.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        available.fetch_add(1);
+        queue.push_back(new Task(std::move(task)));
+    }
+    wake.notify_one();
+    return true;
+}
+
+void WorkPool::submit(Group& group, Task task) {
+    group.pending.fetch_add(1);
+    auto* wrapped = new Task([&group, task = std::move(task)] {
+        task();
+        group.finish();
+    });
+
+    if (currentPool == this) {
+        // Counted before it is published, so a sleeper that misses the
+        // push still sees there is work
+        available.fetch_add(1);
+        if (static_cast<Worker*>(currentWorker)->deque.push(wrapped)) {
+            notifySleeper();
+            return;
+        }
+        available.fetch_sub(1);
+    } else {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (queue.size() < queueLimit) {
+            available.fetch_add(1);
+            queue.push_back(wrapped);
+            lock.unlock();
+            wake.notify_one();
+            return;
+        }
+    }
+    (*wrapped)();
+    delete wrapped;
+}
+
+WorkPool::Stats WorkPool::stats() const {
+    Stats stats;
+    stats.threads = workers.size();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.queued = queue.size();
+    }
+    for (const auto& worker : workers) {
+        stats.local += worker->deque.size();
+        stats.executed += worker->executed.load(std::memory_order_relaxed);
+        stats.stolen += worker->stolen.load(std::memory_order_relaxed);
+    }
+    stats.rejected = rejected.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void WorkPool::run(Worker& self, size_t index) {
+    currentPool = this;
+    currentWorker = &self;
+
+    while (true) {
+        if (Task* task = findTask(self, index)) {
+            available.fetch_sub(1);
+            (*task)();
+            delete task;
+            bump(self.executed);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        sleeping.fetch_add(1);
+        wake.wait(lock, [this] { return stopping || available.load() > 0; });
+        sleeping.fetch_sub(1);
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+WorkPool::Task* WorkPool::findTask(Worker& self, size_t index) {
+    // Newest own task first, while its data is still in this core's cache
+    if (Task* task = self.deque.pop()) {
+        return task;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!queue.empty()) {
+            Task* task = queue.front();
+            queue.pop_front();
+            return task;
+        }
+    }
+    // Oldest task of the next busy worker, starting past ourselves so
+    // thieves spread out
+    for (size_t i = 1; i < workers.size(); ++i) {
+        Worker& victim = *workers[(index + i) % workers.size()];
+        if (Task* task = victim.deque.steal()) {
+            bump(self.stolen);
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+void WorkPool::notifySleeper() {
+    // Sleepers register under the mutex before checking for work, so taking
+    // it here means the one we wake is really waiting
+    if (sleeping.load() > 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        wake.notify_one();
+    }
+}
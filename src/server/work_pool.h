@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool for the work that has to block: reading files
+// into the cache and compressing them. Every worker owns a lock-free deque;
+// tasks spawned on a worker go there, and idle workers steal from the other
+// end. Tasks from outside the pool enter through one bounded queue, so a
+// flood of cache misses is turned away instead of piling up in memory.
+class WorkPool {
+public:
+    using Task = std::function<void()>;
+
+    struct Stats {
+        size_t threads = 0;
+        size_t queued = 0;    // waiting in the shared queue
+        size_t local = 0;     // waiting in worker deques
+        uint64_t executed = 0;
+        uint64_t stolen = 0;
+        uint64_t rejected = 0; // turned away by a full shared queue
+    };
+
+    // Outstanding tasks of one batch, so whoever submitted it can wait
+    class Group {
+    public:
+        void wait();
+
+    private:
+        friend class WorkPool;
+        std::atomic<size_t> pending{0};
+        std::mutex mutex;
+        std::condition_variable done;
+
+        void finish();
+    };
+
+    WorkPool(unsigned threads, size_t queueLimit);
+    ~WorkPool();
+
+    WorkPool(const WorkPool&) = delete;
+    WorkPool& operator=(const WorkPool&) = delete;
+
+    // Queues a task from outside the pool; false when the shared queue is full
+    bool trySubmit(Task task);
+
+    // Adds a task to a batch. On a worker it goes to that worker's deque;
+    // elsewhere it is queued, or run right away when the queue is full, so
+    // batch work slows its submitter down instead of being dropped.
+    void submit(Group& group, Task task);
+
+    Stats stats() const;
+
+private:
+    // Chase-Lev deque: the owner pushes and pops at the bottom without
+    // locking, thieves take from the top with one compare-and-swap
+    class StealingDeque {
+    public:
+        static constexpr int64_t CAPACITY = 1024;
+
+        bool push(Task* task);
+        Task* pop();
+        Task* steal();
+        size_t size() const;
+
+    private:
+        alignas(64) std::atomic<int64_t> top{0};
+        alignas(64) std::atomic<int64_t> bottom{0};
+        std::atomic<Task*> tasks[CAPACITY] = {};
+    };
+
+    struct alignas(64) Worker {
+        StealingDeque deque;
+        std::atomic<uint64_t> executed{0};
+        std::atomic<uint64_t> stolen{0};
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    size_t queueLimit;
+
+    mutable std::mutex mutex; // guards queue and sleeping waits
+    std::condition_variable wake;
+    std::deque<Task*> queue;
+    std::atomic<int64_t> available{0}; // tasks in the queue and every deque
+    std::atomic<unsigned> sleeping{0};
+    std::atomic<uint64_t> rejected{0};
+    bool stopping = false;
+
+    void run(Worker& self, size_t index);
+    Task* findTask(Worker& self, size_t index);
+    void notifySleeper();
+};